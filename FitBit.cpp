@@ -27,8 +27,16 @@
  
  */
 
+#include <algorithm>
 #include "FitBit.h"
 
+// comparator of sequence indices, longer sequences first
+struct FitBitLongerFirst {
+    struct data** x_data;
+    FitBitLongerFirst(struct data** a_x_data) : x_data(a_x_data) {}
+    bool operator()(NCAT a, NCAT b) const { return x_data[a]->n > x_data[b]->n; }
+};
+
 FitBit::FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_tol_mode) {
     this->nS = a_nS;
     this->nO = a_nO;
@@ -65,9 +73,22 @@ FitBit::FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_
     this->dirBm1 = NULL;
     this->xndat = 0;
     this->x_data = 0;
+    this->nact = 0;
+    this->x_order = NULL;
+    this->split = 0;
+    this->nchunk = 0;
+    this->chunk = NULL;
+    this->nacc = 0;
+    this->acc = NULL;
+    this->acc_by_chunk = 0;
+    this->acc_mem = NULL;
+    this->acc_block = NULL;
+    this->acc_stride = 0;
+    this->acc_rows = NULL;
     this->projecttosimplex = 1;
     this->Cslice = 0;
     this->tag = 0;
+    this->kernel = FitBit::pickKernel(a_nS, a_nO);
 }
 
 FitBit::FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_tol_mode, NPAR a_projecttosimplex){
@@ -106,9 +127,22 @@ FitBit::FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_
     this->dirBm1 = NULL;
     this->xndat = 0;
     this->x_data = 0;
+    this->nact = 0;
+    this->x_order = NULL;
+    this->split = 0;
+    this->nchunk = 0;
+    this->chunk = NULL;
+    this->nacc = 0;
+    this->acc = NULL;
+    this->acc_by_chunk = 0;
+    this->acc_mem = NULL;
+    this->acc_block = NULL;
+    this->acc_stride = 0;
+    this->acc_rows = NULL;
     this->projecttosimplex = a_projecttosimplex;
     this->Cslice = 0;
     this->tag = 0;
+    this->kernel = FitBit::pickKernel(a_nS, a_nO);
 }
 
 FitBit::~FitBit() {
@@ -139,6 +173,19 @@ FitBit::~FitBit() {
     if(this->dirPIm1 != NULL) free(this->dirPIm1);
     if(this->dirAm1 != NULL) free2D<NUMBER>(this->dirAm1, (NDAT)this->nS);
     if(this->dirBm1 != NULL) free2D<NUMBER>(this->dirBm1, (NDAT)this->nS);
+    if(this->x_order != NULL) free(this->x_order);
+    if(this->chunk != NULL) free(this->chunk);
+    if(this->acc != NULL) free(this->acc);
+    if(this->acc_mem != NULL) free(this->acc_mem);
+    if(this->acc_rows != NULL) free(this->acc_rows);
+}
+
+NPAR FitBit::pickKernel(NPAR a_nS, NPAR a_nO) {
+    if(a_nS==2 && a_nO==2)
+        return FBK_2S2O;
+    else if(a_nS==3 && a_nO==2)
+        return FBK_3S2O;
+    return FBK_GENERIC;
 }
 
 void FitBit::init(NUMBER* &a_PI, NUMBER** &a_A, NUMBER** &a_B) {
@@ -184,6 +231,100 @@ void FitBit::link(NUMBER *a_PI, NUMBER **a_A, NUMBER **a_B, NCAT a_xndat, struct
     this->B  = a_B;
     this->xndat = a_xndat;
     this->x_data = a_x_data;
+    // order sequences by length so that the ones stepped together in lanes end at about the same time
+    if(this->x_order != NULL) free(this->x_order);
+    this->x_order = Calloc(NCAT, (size_t)a_xndat);
+    this->nact = 0;
+    for(NCAT x=0; x<a_xndat; x++)
+        if( a_x_data[x]->cnt==0 )
+            this->x_order[this->nact++] = x;
+    std::stable_sort(this->x_order, this->x_order + this->nact, FitBitLongerFirst(a_x_data));
+    makeChunks(1, 1);
+}
+
+void FitBit::makeChunks(NCAT a_nchunk, NCAT align) {
+    NCAT x, c = 0;
+    NUMBER rows = 0, acc = 0;
+    if(a_nchunk<1) a_nchunk = 1;
+    if(this->chunk != NULL) free(this->chunk);
+    this->chunk = Calloc(NCAT, (size_t)a_nchunk+1);
+    for(x=0; x<this->nact; x++)
+        rows += this->x_data[ this->x_order[x] ]->n;
+    for(x=0; x<this->nact; x++) {
+        acc += this->x_data[ this->x_order[x] ]->n;
+        // close a chunk once it has its share of rows, long sequences come first and get chunks of their own
+        if( (x+1)%align==0 && (c+1)<a_nchunk && acc*a_nchunk>=rows*(c+1) )
+            this->chunk[++c] = x+1;
+    }
+    if(this->chunk[c]!=this->nact)
+        this->chunk[++c] = this->nact;
+    this->nchunk = c;
+}
+
+void FitBit::initAccumulators(int a_nacc) {
+    int a;
+    NPAR i;
+    size_t line = 64/sizeof(NUMBER); // numbers per cache line
+    if(this->acc != NULL) free(this->acc);
+    if(this->acc_mem != NULL) free(this->acc_mem);
+    if(this->acc_rows != NULL) free(this->acc_rows);
+    this->nacc = a_nacc;
+    // PI, A, B, den of one accumulator, padded so that threads do not share cache lines
+    this->acc_stride = (size_t)this->nS * (size_t)(1 + this->nS + this->nO + 1);
+    this->acc_stride = ((this->acc_stride + line - 1) / line) * line;
+    this->acc_mem = Calloc(NUMBER, this->acc_stride * (size_t)a_nacc + line);
+    this->acc_block = this->acc_mem + ( line - ((size_t)this->acc_mem / sizeof(NUMBER)) % line ) % line;
+    this->acc_rows = Calloc(NUMBER*, (size_t)a_nacc * 2 * (size_t)this->nS);
+    this->acc = Calloc(struct accumulator, (size_t)a_nacc);
+    for(a=0; a<a_nacc; a++) {
+        NUMBER *block = this->acc_block + (size_t)a * this->acc_stride;
+        NUMBER **rows = this->acc_rows + (size_t)a * 2 * (size_t)this->nS;
+        this->acc[a].PI = block;
+        this->acc[a].A = rows;
+        this->acc[a].B = rows + this->nS;
+        for(i=0; i<this->nS; i++) {
+            this->acc[a].A[i] = block + this->nS + i*this->nS;
+            this->acc[a].B[i] = block + this->nS + this->nS*this->nS + i*this->nO;
+        }
+        this->acc[a].den = block + this->nS + this->nS*this->nS + this->nS*this->nO;
+    }
+}
+
+void FitBit::toZeroAccumulators(struct accumulator *target) {
+    memset(this->acc_block, 0, sizeof(NUMBER) * this->acc_stride * (size_t)this->nacc);
+    for(int a=0; a<this->nacc; a++) {
+        NUMBER *block = this->acc_block + (size_t)a * this->acc_stride;
+        NUMBER **rows = this->acc_rows + (size_t)a * 2 * (size_t)this->nS;
+        this->acc[a].PI  = (target->PI  != NULL)?block:NULL;
+        this->acc[a].A   = (target->A   != NULL)?rows:NULL;
+        this->acc[a].B   = (target->B   != NULL)?(rows + this->nS):NULL;
+        this->acc[a].den = (target->den != NULL)?(block + this->nS + this->nS*this->nS + this->nS*this->nO):NULL;
+    }
+}
+
+void FitBit::reduceAccumulators(struct accumulator *target) {
+    int a, step;
+    NPAR i, j;
+    size_t k;
+    // pairwise, the same tree for the same number of accumulators
+    for(step=1; step<this->nacc; step*=2)
+        for(a=0; a+step<this->nacc; a+=2*step) {
+            NUMBER *to = this->acc_block + (size_t)a * this->acc_stride;
+            NUMBER *from = this->acc_block + (size_t)(a+step) * this->acc_stride;
+            for(k=0; k<this->acc_stride; k++)
+                to[k] += from[k];
+        }
+    struct accumulator *sum = &this->acc[0];
+    for(i=0; i<this->nS; i++) {
+        if(target->PI != NULL) target->PI[i] += sum->PI[i];
+        if(target->A != NULL)
+            for(j=0; j<this->nS; j++)
+                target->A[i][j] += sum->A[i][j];
+        if(target->B != NULL)
+            for(j=0; j<this->nO; j++)
+                target->B[i][j] += sum->B[i][j];
+        if(target->den != NULL) target->den[i] += sum->den[i];
+    }
 }
 
 void FitBit::toZero(NUMBER *a_PI, NUMBER **a_A, NUMBER **a_B) {
@@ -55,8 +55,23 @@ enum FIT_BIT_VAR {
     FBV_A  = 2, // A
     FBV_B  = 3  // B
 };
+
+// forward-backward kernel used for the sequences of a fit bit
+enum FIT_BIT_KERNEL {
+    FBK_GENERIC = 0, // runtime nS, nO
+    FBK_2S2O    = 1, // classic BKT, nS=2, nO=2
+    FBK_3S2O    = 2  // nS=3, nO=2
+};
 #endif /* fit bit enums*/
 
+// sums of gradients or Baum-Welch counts over sequences, NULL parts are not summed
+struct accumulator {
+    NUMBER *PI;
+    NUMBER **A;
+    NUMBER **B;
+    NUMBER *den;
+};
+
 class FitBit {
 public:
     NPAR nO, nS; // copies
@@ -90,9 +105,18 @@ public:
     NUMBER **dirBm1; // previous step direction
     NCAT xndat; // number of sequences of data
     struct data** x_data; // sequences of data
+    NCAT nact; // number of sequences not blocked from fitting
+    NCAT *x_order; // indices of sequences not blocked from fitting, longest first, set by link()
     NPAR projecttosimplex; // whether projection to simplex should be done
     NPAR Cslice; // current slice during L2 norm penalty fitting
     NPAR tag; // multippurpose
+    NPAR kernel; // forward-backward kernel, see FIT_BIT_KERNEL, picked once by nS, nO
+    NPAR split; // 1 - chunks of sequences are tasks idle threads can steal (oversized skill under the skill scheduler)
+    NCAT nchunk; // number of chunks of x_order for sequence-level parallelism, 1 by default
+    NCAT *chunk; // chunk c is x_order[chunk[c]] .. x_order[chunk[c+1]-1], chunks have about the same number of rows
+    int nacc; // number of per-thread accumulators for parallel chunks, 0 - sums go right to the target
+    struct accumulator *acc; // per-thread accumulators, each in a block of its own padded to cache lines
+    NPAR acc_by_chunk; // 1 - one accumulator per chunk instead (sums do not depend on threads), see -R
     
     FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_tol_mode);
     FitBit(NPAR a_nS, NPAR a_nO, NCAT a_nK, NCAT a_nG, NUMBER a_tol, NPAR a_tol_mode, NPAR a_projecttosimplex);
@@ -100,12 +124,18 @@ public:
     void init(enum FIT_BIT_SLOT fbs);
     void negate(enum FIT_BIT_SLOT fbs);
     void link(NUMBER *a_PI, NUMBER **a_A, NUMBER **a_B, NCAT a_xndat, struct data** a_x_data);
+    void makeChunks(NCAT a_nchunk, NCAT align); // cut x_order into up to a_nchunk chunks, at multiples of align
+    void initAccumulators(int a_nacc); // one per thread of the team running the chunks
+    void toZeroAccumulators(struct accumulator *target); // zero, and sum only the parts target has
+    void reduceAccumulators(struct accumulator *target); // add up in a fixed tree order, then add to target
+    inline struct accumulator* accumulatorOf(NCAT c) { return this->acc_by_chunk ? &this->acc[c] : &this->acc[omp_get_thread_num()]; } // for chunk c
     void toZero(enum FIT_BIT_SLOT fbs);
     void destroy(enum FIT_BIT_SLOT fbs);
     void copy(enum FIT_BIT_SLOT sourse_fbs, enum FIT_BIT_SLOT target_fbs);
     void add(enum FIT_BIT_SLOT sourse_fbs, enum FIT_BIT_SLOT target_fbs);
     bool checkConvergence(FitResult *fr);
     void doLog10ScaleGentle(enum FIT_BIT_SLOT fbs);
+    static NPAR pickKernel(NPAR a_nS, NPAR a_nO);
 
     // adding penalties
     void addL2Penalty(enum FIT_BIT_VAR fbv, param* param, NUMBER factor);
@@ -120,6 +150,10 @@ private:
     void get(enum FIT_BIT_SLOT fbs, NUMBER* &a_PI, NUMBER** &a_A, NUMBER** &a_B);
     void add(NUMBER *soursePI, NUMBER **sourseA, NUMBER **sourseB, NUMBER *targetPI, NUMBER **targetA, NUMBER **targetB);
     void copy(NUMBER* &soursePI, NUMBER** &sourseA, NUMBER** &sourseB, NUMBER* &targetPI, NUMBER** &targetA, NUMBER** &targetB);
+    NUMBER *acc_mem; // memory of accumulators, as allocated
+    NUMBER *acc_block; // memory of accumulators, aligned to a cache line, acc_stride numbers per accumulator
+    size_t acc_stride;
+    NUMBER **acc_rows; // rows of A and B of the accumulators
 };
 
 #endif /* defined(__HMM__FitBit__) */
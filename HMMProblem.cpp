@@ -36,8 +36,23 @@
 #include "utils.h"
 #include "FitBit.h"
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "HMMProblem.h"
 #include <map>
+#include <algorithm>
+
+// orders skills (or groups) by decreasing cost, see getFitSchedule
+struct CostlierFirst {
+    NUMBER *cost;
+    CostlierFirst(NUMBER *a_cost) : cost(a_cost) {}
+    bool operator()(NCAT a, NCAT b) const { return cost[a] > cost[b]; }
+};
+
+static struct workspace fit_ws = {NULL, 0}; // scratch memory for alpha, beta, c, one per fitting thread
+#pragma omp threadprivate(fit_ws)
 
 HMMProblem::HMMProblem() {
 }
@@ -63,6 +78,7 @@ HMMProblem::HMMProblem(struct param *param) {
 void HMMProblem::init(struct param *param) {
 	this->p = param;
 	this->non01constraints = true;
+    this->dynamic_params = 0; // parameters are the pi, A, B rows
     this->null_obs_ratio = Calloc(NUMBER, (size_t)this->p->nO);
     this->neg_log_lik = 0;
     this->null_skill_obs = 0;
@@ -173,6 +189,7 @@ HMMProblem::~HMMProblem() {
 }
 
 void HMMProblem::destroy() {
+    freeWorkspace(&fit_ws);
 	// destroy model data
     if(this->null_obs_ratio != NULL) free(this->null_obs_ratio);
 	if(this->pi != NULL) free2D<NUMBER>(this->pi, this->sizes[0]);
@@ -353,267 +370,545 @@ NUMBER HMMProblem::getSumLogPOPara(NCAT xndat, struct data** x_data) {
 
 void HMMProblem::initAlpha(NCAT xndat, struct data** x_data) {
 	NPAR nS = this->p->nS;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) //PAR
+    int parallel_now = this->p->parallel==2;
+    #pragma omp parallel for schedule(dynamic) if(parallel_now)
 	for(NCAT x=0; x<xndat; x++) {
-        NDAT t;
-        NPAR i;
 		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-		// alpha
-		if( x_data[x]->alpha == NULL ) {
-			x_data[x]->alpha = Calloc(NUMBER*, (size_t)x_data[x]->n);
-			for(t=0; t<x_data[x]->n; t++)
-				x_data[x]->alpha[t] = Calloc(NUMBER, (size_t)nS);
-			
-		} else {
-			for(t=0; t<x_data[x]->n; t++)
-				for(i=0; i<nS; i++)
-					x_data[x]->alpha[t][i] = 0.0;
-		}
+		// alpha, memory is in the workspace (see bindFitWorkspace)
+        memset(x_data[x]->alpha, 0, sizeof(NUMBER)*(size_t)x_data[x]->n*(size_t)nS);
 		// p_O_param
 		x_data[x]->p_O_param = 0.0;
 		x_data[x]->loglik = 0.0;
         // c - scaling
-		if( x_data[x]->c == NULL ) {
-            x_data[x]->c = Calloc(NUMBER, (size_t)x_data[x]->n);
-        } else {
-			for(t=0; t<x_data[x]->n; t++)
-                x_data[x]->c[t] = 0.0;
-        }
+        memset(x_data[x]->c, 0, sizeof(NUMBER)*(size_t)x_data[x]->n);
 	} // for all groups in skill
 }
 
-void HMMProblem::initXiGamma(NCAT xndat, struct data** x_data) {
-    NPAR nS = this->p->nS;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) //PAR
+void HMMProblem::initBeta(NCAT xndat, struct data** x_data) {
+	NPAR nS = this->p->nS;
+    int parallel_now = this->p->parallel==2;
+    #pragma omp parallel for schedule(dynamic) if(parallel_now)
 	for(NCAT x=0; x<xndat; x++) {
-        NDAT t;
-        NPAR i, j;
 		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-		// Xi
-		if( x_data[x]->gamma == NULL ) {
-			x_data[x]->gamma = Calloc(NUMBER*, (size_t)x_data[x]->n);
-			for(t=0; t<x_data[x]->n; t++)
-				x_data[x]->gamma[t] = Calloc(NUMBER, (size_t)nS);
-			
-		} else {
-			for(t=0; t<x_data[x]->n; t++)
-				for(i=0; i<nS; i++)
-					x_data[x]->gamma[t][i] = 0.0;
-		}
-		// Gamma
-		if( x_data[x]->xi == NULL ) {
-			x_data[x]->xi = Calloc(NUMBER**, (size_t)x_data[x]->n);
-			for(t=0; t<x_data[x]->n; t++) {
-				x_data[x]->xi[t] = Calloc(NUMBER*, (size_t)nS);
-				for(i=0; i<nS; i++)
-					x_data[x]->xi[t][i] = Calloc(NUMBER, (size_t)nS);
+		// beta, memory is in the workspace (see bindFitWorkspace)
+        memset(x_data[x]->beta, 0, sizeof(NUMBER)*(size_t)x_data[x]->n*(size_t)nS);
+	} // for all groups in skill
+} // initBeta
+
+void HMMProblem::bindFitWorkspace(FitBit *fb) {
+    bindWorkspace(&fit_ws, fb->xndat, fb->x_data, this->p->nS);
+}
+
+void HMMProblem::getParamRows(struct data* dt, NUMBER* &a_PI, NUMBER** &a_A, NUMBER** &a_B) {
+    NCAT x = 0;
+    switch(this->p->structure)
+    {
+        case STRUCTURE_SKILL:
+            x = dt->k;
+            break;
+        case STRUCTURE_GROUP:
+            x = dt->g;
+            break;
+        default:
+            fprintf(stderr,"Solver specified is not supported.\n");
+            exit(1);
+            break;
+    }
+    a_PI = this->pi[x];
+    a_A  = this->A[x];
+    a_B  = this->B[x];
+}
+
+template<class V>
+NDAT HMMProblem::computeAlphaAndPOParamView(FitBit *fb) {
+	initAlpha(fb->xndat, fb->x_data);
+    NDAT  ndat = 0;
+    if(fb->split) { // oversized fit bit under the skill scheduler, idle threads steal chunks
+        #pragma omp taskloop grainsize(1) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                ndat += computeAlphaAndPOParamSeq<V>(fb->x_data[ fb->x_order[x] ]);
+    } else {
+        int parallel_now = this->p->parallel==2;
+        #pragma omp parallel for schedule(dynamic) if(parallel_now) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                ndat += computeAlphaAndPOParamSeq<V>(fb->x_data[ fb->x_order[x] ]);
+    }
+    return ndat;
+}
+
+template<class V>
+NDAT HMMProblem::computeAlphaAndPOParamSeq(struct data* dt) {
+    //    NUMBER mult_c, old_pOparam, neg_sum_log_c;
+	if( dt->cnt!=0 ) return 0; // ... and the thing has not been computed yet (e.g. from group to skill)
+    NPAR nS = this->p->nS;
+    V pv(this, dt); // parameters of this sequence
+    NDAT t;
+    NPAR i, j, o;
+	for(t=0; t<dt->n; t++) {
+		o = dt->obs[t];
+
+        if(t==0) { // it's alpha(1,i)
+            // compute \alpha_1(i) = \pi_i b_i(o_1)
+			for(i=0; i<nS; i++) {
+				dt->alpha[t*nS+i] = pv.pi(i) * pv.b(i,o); // if observatiob unknown use 1
+                if(this->p->scaled==1) dt->c[t] += dt->alpha[t*nS+i];
+            }
+		} else { // it's alpha(t,i)
+			// compute \alpha_{t}(i) = b_j(o_{t})\sum_{j=1}^N{\alpha_{t-1}(j) a_{ji}}
+			for(i=0; i<nS; i++) {
+				for(j=0; j<nS; j++) {
+					dt->alpha[t*nS+i] += dt->alpha[(t-1)*nS+j] * pv.a(j,i);
+				}
+				dt->alpha[t*nS+i] *= pv.b(i,o); // if observatiob unknown use 1
+                if(this->p->scaled==1) dt->c[t] += dt->alpha[t*nS+i];
 			}
-			
-		} else {
-			for(t=0; t<x_data[x]->n; t++)
-				for(i=0; i<nS; i++)
-					for(j=0; j<nS; j++)
-						x_data[x]->xi[t][i][j] = 0.0;
 		}
-	} // for all groups in skill
+        // scale \alpha_{t}(i) - same for t=1 or otherwise
+        if(this->p->scaled==1) {
+            dt->c[t] = 1/dt->c[t];//safe0num();
+            for(i=0; i<nS; i++) dt->alpha[t*nS+i] *= dt->c[t];
+        }
+        
+        if(this->p->scaled==1)  dt->loglik += log(dt->c[t]);
+	} // for all observations within skill-group
+    if(this->p->scaled==1)  dt->p_O_param = exp( -dt->loglik );
+    else {
+        dt->p_O_param = 0; // 0 for non-scaled
+        for(i=0; i<nS; i++) dt->p_O_param += dt->alpha[(dt->n-1)*nS+i];
+        dt->loglik = -safelog(dt->p_O_param);
+    }
+    return dt->n;
 }
 
-void HMMProblem::initBeta(NCAT xndat, struct data** x_data) {
-	NPAR nS = this->p->nS;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) //PAR
-	for(NCAT x=0; x<xndat; x++) {
-        NDAT t;
-        NPAR i;
-		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-		// beta
-		if( x_data[x]->beta == NULL ) {
-			x_data[x]->beta = Calloc(NUMBER*, (size_t)x_data[x]->n);
-			for(t=0; t<x_data[x]->n; t++)
-				x_data[x]->beta[t] = Calloc(NUMBER, (size_t)nS);
-			
+template<class V>
+void HMMProblem::computeBetaView(FitBit *fb) {
+	initBeta(fb->xndat, fb->x_data);
+    if(fb->split) { // oversized fit bit under the skill scheduler, idle threads steal chunks
+        #pragma omp taskloop grainsize(1)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                computeBetaSeq<V>(fb->x_data[ fb->x_order[x] ]);
+    } else {
+        int parallel_now = this->p->parallel==2;
+        #pragma omp parallel for schedule(dynamic) if(parallel_now)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                computeBetaSeq<V>(fb->x_data[ fb->x_order[x] ]);
+    }
+}
+
+template<class V>
+void HMMProblem::computeBetaSeq(struct data* dt) {
+	if( dt->cnt!=0 ) return; // ... and the thing has not been computed yet (e.g. from group to skill)
+    NPAR nS = this->p->nS;
+    V pv(this, dt); // parameters of this sequence
+    int t;
+    NPAR i, j, o;
+    NUMBER b_o[nS]; // b_j(o_{t+1})
+	for(t=(NDAT)(dt->n)-1; t>=0; t--) {
+		if( t==(dt->n-1) ) { // last \beta
+			// \beta_T(i) = 1
+			for(i=0; i<nS; i++)
+				dt->beta[t*nS+i] = (this->p->scaled==1)?dt->c[t]:1.0;;
 		} else {
-			for(t=0; t<x_data[x]->n; t++)
-				for(i=0; i<nS; i++)
-					x_data[x]->beta[t][i] = 0.0;
+			// \beta_t(i) = \sum_{j=1}^N{beta_{t+1}(j) a_{ij} b_j(o_{t+1})}
+            o = dt->obs[t+1]; // next observation
+            for(j=0; j<nS; j++)
+                b_o[j] = pv.b(j,o); // if observatiob unknown use 1
+			for(i=0; i<nS; i++) {
+				for(j=0; j<nS; j++)
+					dt->beta[t*nS+i] += dt->beta[(t+1)*nS+j] * pv.a(i,j) * b_o[j];
+                // scale
+                if(this->p->scaled==1) dt->beta[t*nS+i] *= dt->c[t];
+            }
 		}
-	} // for all groups in skill
-} // initBeta
+	} // for all observations, starting with last one
+}
 
-NDAT HMMProblem::computeAlphaAndPOParam(NCAT xndat, struct data** x_data) {
-    //    NUMBER mult_c, old_pOparam, neg_sum_log_c;
-	initAlpha(xndat, x_data);
+template<class V>
+NDAT HMMProblem::accumulateBaumWelchSeq(FitBit *fb, struct data* dt, struct accumulator *acc) {
+	if( dt->cnt!=0 ) return 0; // ... and the thing has not been computed yet (e.g. from group to skill)
     NPAR nS = this->p->nS;
+    int t;
+    NPAR i, j, o_t, o_tp1;
+    NUMBER denom, xi, gamma, b_o[nS], prod[nS][nS], beta_t[nS], beta_tp1[nS]; // xi and gamma of one time slice only
+    V pv(this, dt); // parameters of this sequence
+    // last \beta_T(i) = 1
+    for(i=0; i<nS; i++)
+        beta_tp1[i] = (this->p->scaled==1)?dt->c[dt->n-1]:1.0;
+    for(t=(int)(dt->n)-2; t>=0; t--) { // gamma of the last time slice is not counted
+        o_t   = dt->obs[t];
+        o_tp1 = dt->obs[t+1];
+        for(j=0; j<nS; j++)
+            b_o[j] = pv.b(j,o_tp1); // if observatiob unknown use 1
+        // \xi_t(i,j) and \gamma_t(i), folded into counts right away
+        denom = 0.0;
+		for(i=0; i<nS; i++) {
+			for(j=0; j<nS; j++) {
+                prod[i][j] = dt->alpha[t*nS+i] * pv.a(i,j) * beta_tp1[j] * b_o[j];
+                denom += prod[i][j];
+            }
+        }
+        denom = (denom>0)?denom:1;
+		for(i=0; i<nS; i++) {
+            gamma = 0.0;
+			for(j=0; j<nS; j++) {
+                xi = prod[i][j] / denom;
+                gamma += xi;
+                if(acc->A != NULL) acc->A[i][j] += xi;
+            }
+            acc->den[i] += gamma;
+            if(acc->B != NULL && o_t>=0) acc->B[i][o_t] += gamma;
+            if(acc->PI != NULL && t==0) acc->PI[i] += gamma / fb->xndat;
+        }
+        // \beta_t(i) = \sum_{j=1}^N{beta_{t+1}(j) a_{ij} b_j(o_{t+1})}
+		for(i=0; i<nS; i++) {
+            beta_t[i] = 0.0;
+			for(j=0; j<nS; j++)
+				beta_t[i] += beta_tp1[j] * pv.a(i,j) * b_o[j];
+            if(this->p->scaled==1) beta_t[i] *= dt->c[t];
+        }
+        for(i=0; i<nS; i++)
+            beta_tp1[i] = beta_t[i];
+    } // for all observations, starting with last one
+    return dt->n;
+}
+
+void HMMProblem::accumulateBaumWelch(FitBit *fb, NUMBER *b_PI, NUMBER **b_A_num, NUMBER **b_B_num, NUMBER *b_den) {
+    struct accumulator target = {b_PI, b_A_num, b_B_num, b_den};
+    if(this->dynamic_params)
+        accumulateChunks(fb, &HMMProblem::accumulateBaumWelchSeq<ParamGetters>, &target);
+    else
+        accumulateChunks(fb, &HMMProblem::accumulateBaumWelchSeq<ParamRows>, &target);
+}
+
+template<int nS, int nO>
+void HMMProblem::getFixedParams(struct data* dt, NUMBER *a_PI, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]) {
+    NPAR i, j, m;
+    for(i=0; i<nS; i++) { // getters are called once per sequence, not per time slice
+        a_PI[i] = getPI(dt,i);
+        for(j=0; j<nS; j++)
+            a_A[i][j] = getA(dt,i,j);
+        for(m=0; m<nO; m++)
+            a_B[i][m] = getB(dt,i,m);
+    }
+}
+
+template<int nS, int nO>
+NDAT HMMProblem::computeAlphaAndPOParamFixed(FitBit *fb) {
+	initAlpha(fb->xndat, fb->x_data);
+    if(fb->nact==0) return 0;
+    NUMBER a_PI[nS], a_A[nS][nS], a_B[nS][nO];
+    getFixedParams<nS,nO>(fb->x_data[fb->x_order[0]], a_PI, a_A, a_B); // all sequences of the fit bit share parameters (fitKernel)
     NDAT  ndat = 0;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) reduction(+:ndat) //PAR
-	for(NCAT x=0; x<xndat; x++) {
-        NDAT t;
-        NPAR i, j, o;
-		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-        ndat += x_data[x]->n; // reduction'ed
-		for(t=0; t<x_data[x]->n; t++) {
-//			o = x_data[x]->obs[t];
-			o = this->p->dat_obs[ x_data[x]->ix[t] ];//->get( x_data[x]->ix[t] );
-
-            if(t==0) { // it's alpha(1,i)
-                // compute \alpha_1(i) = \pi_i b_i(o_1)
-				for(i=0; i<nS; i++) {
-					x_data[x]->alpha[t][i] = getPI(x_data[x],i) * ((o<0)?1:getB(x_data[x],i,o)); // if observatiob unknown use 1
-                    if(this->p->scaled==1) x_data[x]->c[t] += x_data[x]->alpha[t][i];
+    if(fb->split) { // oversized fit bit under the skill scheduler, idle threads steal chunks
+        #pragma omp taskloop grainsize(1) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x0=fb->chunk[c]; x0<fb->chunk[c+1]; x0+=FB_LANES) // lanes of sequences, longest first
+                ndat += computeAlphaAndPOParamLanes<nS,nO>(fb, x0, fb->chunk[c+1], a_PI, a_A, a_B);
+    } else {
+        int parallel_now = this->p->parallel==2;
+        #pragma omp parallel for schedule(dynamic) if(parallel_now) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x0=fb->chunk[c]; x0<fb->chunk[c+1]; x0+=FB_LANES) // lanes of sequences, longest first
+                ndat += computeAlphaAndPOParamLanes<nS,nO>(fb, x0, fb->chunk[c+1], a_PI, a_A, a_B);
+    }
+    return ndat;
+}
+
+template<int nS, int nO>
+NDAT HMMProblem::computeAlphaAndPOParamLanes(FitBit *fb, NCAT x0, NCAT x1, NUMBER *a_PI, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]) {
+    NPAR scaled = this->p->scaled;
+    NDAT  ndat = 0;
+    struct data *dt[FB_LANES];
+    NDAT n[FB_LANES], t;
+    NPAR i, j, l, o[FB_LANES];
+    NUMBER a_prev[nS][FB_LANES], a_cur[nS][FB_LANES], b_o[nS][FB_LANES], c[FB_LANES], sum;
+    for(l=0; l<FB_LANES; l++) {
+        if( x0+l<x1 ) { // lanes do not reach past the chunk, another thread may have the next one
+            dt[l] = fb->x_data[ fb->x_order[x0+l] ];
+            n[l] = dt[l]->n;
+            ndat += n[l]; // reduction'ed
+        } else { // empty lane
+            dt[l] = NULL;
+            n[l] = 0;
+        }
+    }
+	for(t=0; t<n[0]; t++) { // first lane is the longest
+        for(l=0; l<FB_LANES; l++)
+            o[l] = (t<n[l])?dt[l]->obs[t]:-1; // lanes that have ended see an unknown observation
+        for(i=0; i<nS; i++)
+            #pragma omp simd
+            for(l=0; l<FB_LANES; l++)
+                b_o[i][l] = (o[l]<0)?1:a_B[i][o[l]]; // if observatiob unknown use 1
+        if(t==0) { // it's alpha(1,i)
+			for(i=0; i<nS; i++)
+                #pragma omp simd
+                for(l=0; l<FB_LANES; l++)
+                    a_cur[i][l] = a_PI[i] * b_o[i][l];
+		} else { // it's alpha(t,i)
+			for(i=0; i<nS; i++)
+                #pragma omp simd private(sum)
+                for(l=0; l<FB_LANES; l++) {
+                    sum = 0.0;
+                    for(j=0; j<nS; j++)
+                        sum += a_prev[j][l] * a_A[j][i];
+                    a_cur[i][l] = sum * b_o[i][l];
                 }
-			} else { // it's alpha(t,i)
-				// compute \alpha_{t}(i) = b_j(o_{t})\sum_{j=1}^N{\alpha_{t-1}(j) a_{ji}}
-				for(i=0; i<nS; i++) {
-					for(j=0; j<nS; j++) {
-						x_data[x]->alpha[t][i] += x_data[x]->alpha[t-1][j] * getA(x_data[x],j,i);
-					}
-					x_data[x]->alpha[t][i] *= ((o<0)?1:getB(x_data[x],i,o)); // if observatiob unknown use 1
-                    if(this->p->scaled==1) x_data[x]->c[t] += x_data[x]->alpha[t][i];
-				}
-			}
-            // scale \alpha_{t}(i) - same for t=1 or otherwise
-            if(this->p->scaled==1) {
-                x_data[x]->c[t] = 1/x_data[x]->c[t];//safe0num();
-                for(i=0; i<nS; i++) x_data[x]->alpha[t][i] *= x_data[x]->c[t];
+		}
+        if(scaled==1) {
+            #pragma omp simd
+            for(l=0; l<FB_LANES; l++) {
+                c[l] = 0.0;
+                for(i=0; i<nS; i++) c[l] += a_cur[i][l];
+                c[l] = 1/c[l];
+                for(i=0; i<nS; i++) a_cur[i][l] *= c[l];
             }
-            
-            if(this->p->scaled==1)  x_data[x]->loglik += log(x_data[x]->c[t]);
-		} // for all observations within skill-group
-        if(this->p->scaled==1)  x_data[x]->p_O_param = exp( -x_data[x]->loglik );
+        }
+        for(l=0; l<FB_LANES && t<n[l]; l++) { // lanes are sorted, stop at the first one that ended
+            for(i=0; i<nS; i++) dt[l]->alpha[t*nS+i] = a_cur[i][l];
+            if(scaled==1) {
+                dt[l]->c[t] = c[l];
+                dt[l]->loglik += log(c[l]);
+            }
+        }
+        memcpy(a_prev, a_cur, sizeof(a_cur));
+	} // for all observations within lanes
+    for(l=0; l<FB_LANES && dt[l]!=NULL; l++) {
+        if(scaled==1)  dt[l]->p_O_param = exp( -dt[l]->loglik );
         else {
-            x_data[x]->p_O_param = 0; // 0 for non-scaled
-            for(i=0; i<nS; i++) x_data[x]->p_O_param += x_data[x]->alpha[x_data[x]->n-1][i];
-            x_data[x]->loglik = -safelog(x_data[x]->p_O_param);
+            dt[l]->p_O_param = 0; // 0 for non-scaled
+            for(i=0; i<nS; i++) dt[l]->p_O_param += dt[l]->alpha[(dt[l]->n-1)*nS+i];
+            dt[l]->loglik = -safelog(dt[l]->p_O_param);
         }
-	} // for all groups in skill
+    }
     return ndat;
 }
 
-void HMMProblem::computeBeta(NCAT xndat, struct data** x_data) {
-	initBeta(xndat, x_data);
-    NPAR nS = this->p->nS;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) //PAR
-	for(NCAT x=0; x<xndat; x++) {
-        int t;
-        NPAR i, j, o;
-		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-		for(t=(NDAT)(x_data[x]->n)-1; t>=0; t--) {
-			if( t==(x_data[x]->n-1) ) { // last \beta
-				// \beta_T(i) = 1
-				for(i=0; i<nS; i++)
-					x_data[x]->beta[t][i] = (this->p->scaled==1)?x_data[x]->c[t]:1.0;;
-			} else {
-				// \beta_t(i) = \sum_{j=1}^N{beta_{t+1}(j) a_{ij} b_j(o_{t+1})}
-                //				o = x_data[x]->obs[t+1]; // next observation
-                o = this->p->dat_obs[ x_data[x]->ix[t+1] ];//->get( x_data[x]->ix[t+1] );
-				for(i=0; i<nS; i++) {
-					for(j=0; j<nS; j++)
-						x_data[x]->beta[t][i] += x_data[x]->beta[t+1][j] * getA(x_data[x],i,j) * ((o<0)?1:getB(x_data[x],j,o)); // if observatiob unknown use 1
-                    // scale
-                    if(this->p->scaled==1) x_data[x]->beta[t][i] *= x_data[x]->c[t];
+template<int nS, int nO>
+void HMMProblem::computeBetaFixed(FitBit *fb) {
+	initBeta(fb->xndat, fb->x_data);
+    if(fb->nact==0) return;
+    NUMBER a_PI[nS], a_A[nS][nS], a_B[nS][nO];
+    getFixedParams<nS,nO>(fb->x_data[fb->x_order[0]], a_PI, a_A, a_B); // all sequences of the fit bit share parameters (fitKernel)
+    if(fb->split) { // oversized fit bit under the skill scheduler, idle threads steal chunks
+        #pragma omp taskloop grainsize(1)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x0=fb->chunk[c]; x0<fb->chunk[c+1]; x0+=FB_LANES) // lanes of sequences, longest first
+                computeBetaLanes<nS,nO>(fb, x0, fb->chunk[c+1], a_A, a_B);
+    } else {
+        int parallel_now = this->p->parallel==2;
+        #pragma omp parallel for schedule(dynamic) if(parallel_now)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x0=fb->chunk[c]; x0<fb->chunk[c+1]; x0+=FB_LANES) // lanes of sequences, longest first
+                computeBetaLanes<nS,nO>(fb, x0, fb->chunk[c+1], a_A, a_B);
+    }
+}
+
+template<int nS, int nO>
+void HMMProblem::computeBetaLanes(FitBit *fb, NCAT x0, NCAT x1, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]) {
+    NPAR scaled = this->p->scaled;
+    struct data *dt[FB_LANES];
+    NDAT n[FB_LANES], t[FB_LANES], u;
+    NPAR i, j, l, o[FB_LANES];
+    NUMBER b_prev[nS][FB_LANES], b_cur[nS][FB_LANES], b_o[nS][FB_LANES], c[FB_LANES], sum;
+    for(l=0; l<FB_LANES; l++) {
+        if( x0+l<x1 ) { // lanes do not reach past the chunk, another thread may have the next one
+            dt[l] = fb->x_data[ fb->x_order[x0+l] ];
+            n[l] = dt[l]->n;
+        } else { // empty lane
+            dt[l] = NULL;
+            n[l] = 0;
+        }
+    }
+    // lanes are aligned at their ends, step u is time slice n-1-u of every lane
+	for(u=0; u<n[0]; u++) { // first lane is the longest
+        for(l=0; l<FB_LANES; l++) {
+            t[l] = n[l]-1-u;
+            c[l] = (u<n[l] && scaled==1)?dt[l]->c[ t[l] ]:1.0;
+        }
+        if(u==0) { // last \beta_T(i) = 1
+			for(i=0; i<nS; i++)
+                #pragma omp simd
+                for(l=0; l<FB_LANES; l++)
+                    b_cur[i][l] = c[l];
+        } else {
+            // \beta_t(i) = \sum_{j=1}^N{beta_{t+1}(j) a_{ij} b_j(o_{t+1})}
+            for(l=0; l<FB_LANES; l++)
+                o[l] = (u<n[l])?dt[l]->obs[ t[l]+1 ]:-1; // next observation, lanes that have ended see an unknown one
+            for(j=0; j<nS; j++)
+                #pragma omp simd
+                for(l=0; l<FB_LANES; l++)
+                    b_o[j][l] = (o[l]<0)?1:a_B[j][o[l]]; // if observatiob unknown use 1
+			for(i=0; i<nS; i++)
+                #pragma omp simd private(sum)
+                for(l=0; l<FB_LANES; l++) {
+                    sum = 0.0;
+                    for(j=0; j<nS; j++)
+                        sum += b_prev[j][l] * a_A[i][j] * b_o[j][l];
+                    b_cur[i][l] = (scaled==1)?(sum * c[l]):sum;
                 }
-			}
-		} // for all observations, starting with last one
-	} // for all groups within skill
+        }
+        for(l=0; l<FB_LANES && u<n[l]; l++) // lanes are sorted, stop at the first one that ended
+            for(i=0; i<nS; i++) dt[l]->beta[t[l]*nS+i] = b_cur[i][l];
+        memcpy(b_prev, b_cur, sizeof(b_cur));
+	} // for all observations, starting with last one
+}
+
+// kernel for the sequences of a fit bit: a fixed one only if they all resolve to the same row of parameters (by skill,
+// or a group's fit bit by group), e.g. Baum-Welch by group links sequences of a skill that have rows of their groups
+NPAR HMMProblem::fitKernel(FitBit *fb) {
+    if(this->dynamic_params || fb->kernel==FBK_GENERIC) return FBK_GENERIC;
+    NUMBER *a_PI, *a_PI0 = NULL, **a_A, **a_B;
+    for(NCAT x=0; x<fb->xndat; x++) {
+        getParamRows(fb->x_data[x], a_PI, a_A, a_B);
+        if(x==0) a_PI0 = a_PI;
+        else if(a_PI != a_PI0) return FBK_GENERIC;
+    }
+    return fb->kernel;
 }
 
-void HMMProblem::computeXiGamma(NCAT xndat, struct data** x_data){
-	HMMProblem::initXiGamma(xndat, x_data);
+NDAT HMMProblem::computeAlphaAndPOParam(FitBit *fb) {
+    switch(fitKernel(fb)) { // fixed kernels read parameters once per fit bit, its sequences share them
+        case FBK_2S2O:
+            return computeAlphaAndPOParamFixed<2,2>(fb);
+        case FBK_3S2O:
+            return computeAlphaAndPOParamFixed<3,2>(fb);
+        default:
+            if(this->dynamic_params)
+                return computeAlphaAndPOParamView<ParamGetters>(fb);
+            return computeAlphaAndPOParamView<ParamRows>(fb);
+    }
+}
+
+void HMMProblem::computeBeta(FitBit *fb) {
+    switch(fitKernel(fb)) { // fixed kernels read parameters once per fit bit, its sequences share them
+        case FBK_2S2O:
+            computeBetaFixed<2,2>(fb);
+            break;
+        case FBK_3S2O:
+            computeBetaFixed<3,2>(fb);
+            break;
+        default:
+            if(this->dynamic_params)
+                computeBetaView<ParamGetters>(fb);
+            else
+                computeBetaView<ParamRows>(fb);
+            break;
+    }
+}
+
+template<class V>
+NDAT HMMProblem::setGradPISeq(FitBit *fb, struct data* dt, struct accumulator *acc) {
+    if( dt->cnt!=0 ) return 0;
+    NDAT t = 0;
+    NPAR i, o;
     NPAR nS = this->p->nS;
-//    int parallel_now = this->p->parallel==2; //PAR
-//    #pragma omp parallel for schedule(dynamic) if(parallel_now) //PAR
-	for(NCAT x=0; x<xndat; x++) {
-        NDAT t;
-        NPAR i, j, o_tp1;
-        NUMBER denom;
-		if( x_data[x]->cnt!=0 ) continue; // ... and the thing has not been computed yet (e.g. from group to skill)
-        
-		for(t=0; t<(x_data[x]->n-1); t++) { // -1 is important
-            //			o_tp1 = x_data[x]->obs[t+1];
-            o_tp1 = this->p->dat_obs[ x_data[x]->ix[t+1] ];//->get( x_data[x]->ix[t+1] );
-            
-            denom = 0.0;
-			for(i=0; i<nS; i++) {
-				for(j=0; j<nS; j++) {
-                    denom += x_data[x]->alpha[t][i] * getA(x_data[x],i,j) * x_data[x]->beta[t+1][j] * ((o_tp1<0)?1:getB(x_data[x],j,o_tp1));
-                }
-            }
-			for(i=0; i<nS; i++) {
-				for(j=0; j<nS; j++) {
-                    x_data[x]->xi[t][i][j] = x_data[x]->alpha[t][i] * getA(x_data[x],i,j) * x_data[x]->beta[t+1][j] * ((o_tp1<0)?1:getB(x_data[x],j,o_tp1)) / ((denom>0)?denom:1); //
-                    x_data[x]->gamma[t][i] += x_data[x]->xi[t][i][j];
-                }
+    V pv(this, dt); // parameters of this sequence
+    o = dt->obs[t];
+    for(i=0; i<nS; i++) {
+        acc->PI[i] -= dt->beta[t*nS+i] * pv.b(i,o) / safe0num(dt->p_O_param);
+    }
+    return dt->n;
+}
+
+template<class V>
+NDAT HMMProblem::setGradASeq(FitBit *fb, struct data* dt, struct accumulator *acc) {
+    if( dt->cnt!=0 ) return 0;
+    NDAT t;
+    NPAR o, i, j;
+    NPAR nS = this->p->nS;
+    V pv(this, dt); // parameters of this sequence
+    for(t=1; t<dt->n; t++) {
+        o = dt->obs[t];
+        for(i=0; i<nS; i++)
+            for(j=0; j<nS; j++)
+                acc->A[i][j] -= dt->beta[t*nS+j] * pv.b(j,o) * dt->alpha[(t-1)*nS+i] / safe0num(dt->p_O_param);
+    }
+    return dt->n;
+}
+
+template<class V>
+NDAT HMMProblem::setGradBSeq(FitBit *fb, struct data* dt, struct accumulator *acc) {
+    if( dt->cnt!=0 ) return 0;
+    NDAT t;
+    NPAR o, o0, i, j;
+    NPAR nS = this->p->nS;
+    V pv(this, dt); // parameters of this sequence
+    for(t=0; t<dt->n; t++) { // Levinson MMFST
+        o  = dt->obs[t];
+        o0 = dt->obs[0];
+        if(o<0) // if no observation -- skip
+            continue;
+        for(j=0; j<nS; j++)
+            if(t==0) {
+                acc->B[j][o] -= (o0==o) * pv.pi(j) * dt->beta[j];
+            } else {
+                for(i=0; i<nS; i++)
+                    acc->B[j][o] -= ( dt->alpha[(t-1)*nS+i] * pv.a(i,j) * dt->beta[t*nS+j] /*+ (o0==o) * getPI(dt,j) * dt->beta[0][j]*/ ) / safe0num(dt->p_O_param); // Levinson MMFST
             }
-        
-		} // for all observations within skill-group
-	} // for all groups in skill
+    }
+    return dt->n;
+}
+
+NDAT HMMProblem::accumulateChunks(FitBit *fb, SeqAccumulate f, struct accumulator *target) {
+    NDAT ndat = 0;
+    if(fb->nacc==0) { // in the order of sequences, right into the target
+        for(NCAT x=0; x<fb->xndat; x++)
+            ndat += (this->*f)(fb, fb->x_data[x], target);
+        return ndat;
+    }
+    fb->toZeroAccumulators(target);
+    if(fb->split) { // oversized fit bit under the skill scheduler, idle threads steal chunks
+        #pragma omp taskloop grainsize(1) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                ndat += (this->*f)(fb, fb->x_data[ fb->x_order[x] ], fb->accumulatorOf(c));
+    } else {
+        int parallel_now = this->p->parallel==2;
+        #pragma omp parallel for schedule(dynamic) if(parallel_now) reduction(+:ndat)
+        for(NCAT c=0; c<fb->nchunk; c++)
+            for(NCAT x=fb->chunk[c]; x<fb->chunk[c+1]; x++)
+                ndat += (this->*f)(fb, fb->x_data[ fb->x_order[x] ], fb->accumulatorOf(c));
+    }
+    fb->reduceAccumulators(target);
+    return ndat;
 }
 
 void HMMProblem::setGradPI(FitBit *fb){
     if(this->p->block_fitting[0]>0) return;
-    NDAT t = 0, ndat = 0;
-    NPAR i, o;
-    struct data* dt;
-    for(NCAT x=0; x<fb->xndat; x++) {
-        dt = fb->x_data[x];
-        if( dt->cnt!=0 ) continue;
-        ndat += dt->n;
-        o = this->p->dat_obs[ dt->ix[t] ];//->get( dt->ix[t] );
-        for(i=0; i<this->p->nS; i++) {
-            fb->gradPI[i] -= dt->beta[t][i] * ((o<0)?1:getB(dt,i,o)) / safe0num(dt->p_O_param);
-        }
-    }
+    struct accumulator target = {fb->gradPI, NULL, NULL, NULL};
+    NDAT ndat;
+    if(this->dynamic_params)
+        ndat = accumulateChunks(fb, &HMMProblem::setGradPISeq<ParamGetters>, &target);
+    else
+        ndat = accumulateChunks(fb, &HMMProblem::setGradPISeq<ParamRows>, &target);
     if( this->p->Cslices>0 ) // penalty
         fb->addL2Penalty(FBV_PI, this->p, (NUMBER)ndat);
 }
 
 void HMMProblem::setGradA (FitBit *fb){
     if(this->p->block_fitting[1]>0) return;
-    NDAT t, ndat = 0;
-    NPAR o, i, j;
-    struct data* dt;
-    for(NCAT x=0; x<fb->xndat; x++) {
-        dt = fb->x_data[x];
-        if( dt->cnt!=0 ) continue;
-        ndat += dt->n;
-        for(t=1; t<dt->n; t++) {
-            o = this->p->dat_obs[ dt->ix[t] ];//->get( dt->ix[t] );
-            for(i=0; i<this->p->nS; i++)
-                for(j=0; j<this->p->nS; j++)
-                    fb->gradA[i][j] -= dt->beta[t][j] * ((o<0)?1:getB(dt,j,o)) * dt->alpha[t-1][i] / safe0num(dt->p_O_param);
-        }
-    }
+    struct accumulator target = {NULL, fb->gradA, NULL, NULL};
+    NDAT ndat;
+    if(this->dynamic_params)
+        ndat = accumulateChunks(fb, &HMMProblem::setGradASeq<ParamGetters>, &target);
+    else
+        ndat = accumulateChunks(fb, &HMMProblem::setGradASeq<ParamRows>, &target);
     if( this->p->Cslices>0 ) // penalty
         fb->addL2Penalty(FBV_A, this->p, (NUMBER)ndat);
 }
 
 void HMMProblem::setGradB (FitBit *fb){
     if(this->p->block_fitting[2]>0) return;
-    NDAT t, ndat = 0;
-    NPAR o, o0, i, j;
-    struct data* dt;
-    for(NCAT x=0; x<fb->xndat; x++) {
-        dt = fb->x_data[x];
-        if( dt->cnt!=0 ) continue;
-        ndat += dt->n;
-        for(t=0; t<dt->n; t++) { // Levinson MMFST
-            o  = this->p->dat_obs[ dt->ix[t] ];//->get( dt->ix[t] );
-            o0 = this->p->dat_obs[ dt->ix[0] ];//->get( dt->ix[t] );
-            if(o<0) // if no observation -- skip
-                continue;
-            for(j=0; j<this->p->nS; j++)
-                if(t==0) {
-                    fb->gradB[j][o] -= (o0==o) * getPI(dt,j) * dt->beta[0][j];
-                } else {
-                    for(i=0; i<this->p->nS; i++)
-                        fb->gradB[j][o] -= ( dt->alpha[t-1][i] * getA(dt,i,j) * dt->beta[t][j] /*+ (o0==o) * getPI(dt,j) * dt->beta[0][j]*/ ) / safe0num(dt->p_O_param); // Levinson MMFST
-                }
-        }
-    }
+    struct accumulator target = {NULL, NULL, fb->gradB, NULL};
+    NDAT ndat;
+    if(this->dynamic_params)
+        ndat = accumulateChunks(fb, &HMMProblem::setGradBSeq<ParamGetters>, &target);
+    else
+        ndat = accumulateChunks(fb, &HMMProblem::setGradBSeq<ParamRows>, &target);
     if( this->p->Cslices>0 ) // penalty
         fb->addL2Penalty(FBV_B, this->p, (NUMBER)ndat);
 }
@@ -621,8 +916,8 @@ void HMMProblem::setGradB (FitBit *fb){
 NDAT HMMProblem::computeGradients(FitBit *fb){
     fb->toZero(FBS_GRAD);
     
-    NDAT ndat = computeAlphaAndPOParam(fb->xndat, fb->x_data);
-    computeBeta(fb->xndat, fb->x_data);
+    NDAT ndat = computeAlphaAndPOParam(fb);
+    computeBeta(fb);
 
     if(fb->pi != NULL && this->p->block_fitting[0]==0) setGradPI(fb);
     if(fb->A  != NULL && this->p->block_fitting[1]==0) setGradA(fb);
@@ -631,6 +926,10 @@ NDAT HMMProblem::computeGradients(FitBit *fb){
 } // computeGradients()
 
 void HMMProblem::toFile(const char *filename) {
+    if(this->p->binarymodel != 0) {
+        toFileBin(filename);
+        return;
+    }
     switch(this->p->structure)
     {
         case STRUCTURE_SKILL:
@@ -659,10 +958,8 @@ void HMMProblem::toFileSkill(const char *filename) {
 		fprintf(fid," %10.7f%s",this->null_obs_ratio[m],(m==(this->p->nO-1))?"\n":"\t");
     
 	NCAT k;
-	std::map<NCAT,std::string>::iterator it;
 	for(k=0;k<this->p->nK;k++) {
-		it = this->p->map_skill_bwd->find(k);
-		fprintf(fid,"%d\t%s\n",k,it->second.c_str());
+		fprintf(fid,"%d\t%s\n",k,vocabString(this->p->voc_skill, k));
 		NPAR i,j,m;
 		fprintf(fid,"PI\t");
 		for(i=0; i<this->p->nS; i++)
@@ -693,10 +990,8 @@ void HMMProblem::toFileGroup(const char *filename) {
 	for(NPAR m=0; m<this->p->nO; m++)
 		fprintf(fid," %10.7f%s",this->null_obs_ratio[m],(m==(this->p->nO-1))?"\n":"\t");
 	NCAT g;
-	std::map<NCAT,std::string>::iterator it;
 	for(g=0;g<this->p->nG;g++) {
-		it = this->p->map_group_bwd->find(g);
-		fprintf(fid,"%d\t%s\n",g,it->second.c_str());
+		fprintf(fid,"%d\t%s\n",g,vocabString(this->p->voc_group, g));
 		NPAR i,j,m;
 		fprintf(fid,"PI\t");
 		for(i=0; i<this->p->nS; i++)
@@ -713,7 +1008,92 @@ void HMMProblem::toFileGroup(const char *filename) {
 	fclose(fid);
 }
 
-void HMMProblem::producePCorrect(NUMBER*** group_skill_map, NUMBER* local_pred, NCAT* ks, NCAT nks, struct data* dt) {
+/*
+ * Binary model file, mapped into memory when read:
+ *  - header : struct bin_model_header, with offsets and sizes of the sections and a checksum of itself
+ *  - sections : enum BIN_MODEL_SECTION, each starts at a multiple of BIN_MODEL_ALIGN bytes, arrays as they are
+ *      in memory; parameters of a skill (or group) are one row of the BMS_PARAMS tensor, and the labels have the
+ *      hash table of struct vocab, so a reader looks up the labels it needs and reads only their rows
+ */
+
+static inline unsigned long long modelAlign(unsigned long long size) {
+    return (size + BIN_MODEL_ALIGN - 1) / BIN_MODEL_ALIGN * BIN_MODEL_ALIGN;
+}
+
+void HMMProblem::toFileBin(const char *filename) {
+	FILE *fid = fopen(filename,"wb");
+	if(fid == NULL) {
+		fprintf(stderr,"Can't write output model file %s\n",filename);
+		exit(1);
+	}
+    NPAR i, j, m, nS = this->p->nS, nO = this->p->nO;
+    bool by_group = this->p->structure==STRUCTURE_GROUP;
+    struct vocab *labels = by_group?this->p->voc_group:this->p->voc_skill;
+    NCAT x, nX = by_group?this->p->nG:this->p->nK;
+    size_t row = (size_t)(nS + nS*nS + nS*nO);
+    
+    struct bin_model_header h;
+    memset(&h, 0, sizeof(struct bin_model_header));
+    memcpy(h.magic, BIN_MODEL_MAGIC, 4);
+    h.version = bin_model_file_version;
+    h.size_t_size = (char)sizeof(size_t);
+    h.number_size = (char)sizeof(NUMBER);
+    h.structure = this->p->structure;
+    h.solver = this->p->solver;
+    h.solver_setting = this->p->solver_setting;
+    h.nS = nS;
+    h.nO = nO;
+    h.nZ = this->p->nZ;
+    h.nK = this->p->nK;
+    h.nG = this->p->nG;
+    h.nX = nX;
+    h.voc_mask = labels->mask;
+    
+    // rows of PI, A, B
+    NUMBER *params = Malloc(NUMBER, row*(size_t)MAX(nX,1));
+    for(x=0; x<nX; x++) {
+        NUMBER *r = &params[row*(size_t)x];
+        for(i=0; i<nS; i++)
+            r[i] = this->pi[x][i];
+        for(i=0; i<nS; i++)
+            for(j=0; j<nS; j++)
+                r[nS + i*nS + j] = this->A[x][i][j];
+        for(i=0; i<nS; i++)
+            for(m=0; m<nO; m++)
+                r[nS + nS*nS + i*nO + m] = this->B[x][i][m];
+    }
+    const void *sec[BMS_NUM] = {this->null_obs_ratio, params, labels->arena, labels->offset, labels->hash, labels->table};
+    h.section[BMS_NULL_RATIO][1] = (unsigned long long)nO*sizeof(NUMBER);
+    h.section[BMS_PARAMS][1]     = (unsigned long long)(row*(size_t)nX*sizeof(NUMBER));
+    h.section[BMS_VOC_ARENA][1]  = (unsigned long long)labels->size;
+    h.section[BMS_VOC_OFFSET][1] = (unsigned long long)(((size_t)nX+1)*sizeof(size_t));
+    h.section[BMS_VOC_HASH][1]   = (unsigned long long)((size_t)nX*sizeof(unsigned int));
+    h.section[BMS_VOC_TABLE][1]  = (unsigned long long)(((size_t)labels->mask+1)*sizeof(NCAT));
+    unsigned long long pos = modelAlign(sizeof(struct bin_model_header));
+    for(int s=0; s<BMS_NUM; s++) {
+        h.section[s][0] = pos;
+        pos += modelAlign(h.section[s][1]);
+    }
+    h.checksum = hashString((const char*)&h, sizeof(struct bin_model_header));
+    
+    char zero[BIN_MODEL_ALIGN];
+    memset(zero, 0, (size_t)BIN_MODEL_ALIGN);
+    fwrite(&h, sizeof(struct bin_model_header), 1, fid);
+    fwrite(zero, 1, (size_t)(modelAlign(sizeof(struct bin_model_header)) - sizeof(struct bin_model_header)), fid);
+    for(int s=0; s<BMS_NUM; s++) {
+        if(h.section[s][1] == 0) continue;
+        fwrite(sec[s], 1, (size_t)h.section[s][1], fid);
+        fwrite(zero, 1, (size_t)(modelAlign(h.section[s][1]) - h.section[s][1]), fid);
+    }
+    free(params);
+    if(ferror(fid)) {
+		fprintf(stderr,"Error writing output model file %s\n",filename);
+		exit(1);
+    }
+	fclose(fid);
+}
+
+void HMMProblem::producePCorrect(NUMBER** pL, NUMBER* local_pred, NCAT* ks, NCAT nks, struct data* dt) {
     NPAR m, i;
     NCAT k;
     NUMBER *local_pred_inner = init1D<NUMBER>(this->p->nO);
@@ -724,7 +1104,7 @@ void HMMProblem::producePCorrect(NUMBER*** group_skill_map, NUMBER* local_pred,
         dt->k = k;
         for(m=0; m<this->p->nO; m++)
             for(i=0; i<this->p->nS; i++)
-                local_pred_inner[m] += group_skill_map[dt->g][k][i] * getB(dt,i,m);
+                local_pred_inner[m] += pL[l][i] * getB(dt,i,m);
         for(m=0; m<this->p->nO; m++)
             local_pred[m] += local_pred_inner[m];
     }
@@ -735,11 +1115,149 @@ void HMMProblem::producePCorrect(NUMBER*** group_skill_map, NUMBER* local_pred,
     free(local_pred_inner);
 }
 
-//void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, StripedArray<NCAT*> *dat_multiskill) {
-void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, NCAT *dat_skill_stacked, NCAT *dat_skill_rcount, NDAT *dat_skill_rix, HMMProblem **hmms, NPAR nhmms, NPAR *hmm_idx) {
-	NDAT t;
+void HMMProblem::predictRow(struct predict_data *pd, NDAT t, struct data *dt, NUMBER *local_pred, NUMBER *pLe, NUMBER **pL, struct predict_metrics *pm) {
 	NCAT g, k;
 	NPAR i, j, m, o, isTarget = 0;
+	NPAR nS = pd->hmms[0]->p->nS, nO = pd->hmms[0]->p->nO;
+	char f_metrics_target_obs = pd->hmms[0]->p->metrics_target_obs;
+	int f_predictions = pd->hmms[0]->p->predictions;
+	NUMBER pLe_denom; // p(L|evidence) denominator
+	NUMBER p;
+	struct state_store *ss = pd->states;
+	HMMProblem *hmm;
+
+	o = pd->dat_obs[t];
+	g = pd->dat_group[t];
+	dt->g = g;
+	
+	hmm = (pd->nhmms==1)?pd->hmms[0]:pd->hmms[pd->hmm_idx[t]]; // if just one hmm, use 0's, otherwise take the index value
+	
+	isTarget = hmm->p->metrics_target_obs == o;
+	NCAT *ar;
+	int n;
+	if(hmm->p->multiskill==0) {
+		k = pd->dat_skill[t];
+		ar = &k;
+		n = 1;
+	} else {
+		k = pd->dat_skill_stacked[ pd->dat_skill_rix[t] ];
+		ar = &pd->dat_skill_stacked[ pd->dat_skill_rix[t] ];
+		n = pd->dat_skill_rcount[t];
+	}
+	
+	// deal with null skill
+	if(ar[0]<0) { // if no skill label
+		isTarget = hmm->null_skill_obs==o;
+		pm->rmse += pow(isTarget - hmm->null_obs_ratio[f_metrics_target_obs],2);
+		pm->accuracy += isTarget == (hmm->null_obs_ratio[f_metrics_target_obs]==maxn(hmm->null_obs_ratio,nO) && hmm->null_obs_ratio[f_metrics_target_obs] > 1/nO);
+		pm->ll -= isTarget*safelog(hmm->null_skill_obs_prob) + (1-isTarget)*safelog(1 - hmm->null_skill_obs_prob);
+		if(f_predictions>0) { // write predictions file if it was opened
+			for(m=0; m<nO; m++) {
+				if(pd->fid != NULL)
+					fprintf(pd->fid,"%12.10f%s",hmm->null_obs_ratio[m],(m<(nO-1))?"\t":"\n");//PRINTNOW
+				else
+					pd->dat_predict[ (size_t)t*nO + m ] = hmm->null_obs_ratio[m];
+			}
+		}
+		return;
+	}
+	// check if {g,k}'s were initialized
+	for(int l=0; l<n; l++) {
+		k = ar[l];
+		NDAT ix = findState(ss, g, k); // all pairs were added before predicting
+		pL[l] = &ss->p[ (size_t)ix*nS ];
+		if( ss->set[ix]==0 )
+		{
+			dt->k = k;
+			
+			for(i=0; i<nS; i++)
+				pL[l][i] = hmm->getPI(dt,i);
+			ss->set[ix] = 1;
+		}// pLo/pL not set
+	}// for all skills at this transaction
+	
+	// produce prediction and copy to result
+	hmm->producePCorrect(pL, local_pred, ar, n, dt); 
+	projectsimplex(local_pred, nO); // addition to make sure there's not side effects
+	
+	// if necessary guess the obsevaion using Pi and B
+	if(hmm->p->update_known=='g') {
+		NUMBER max_local_pred=0;
+		NPAR ix_local_pred=0;
+		for(m=0; m<nO; m++) {
+			if( local_pred[m]>max_local_pred ) {
+				max_local_pred = local_pred[m];
+				ix_local_pred = m;
+			}
+		}
+		o = ix_local_pred;
+	}
+	
+	// update pL
+	for(int l=0; l<n; l++) {
+		k = ar[l];
+		dt->k = k;
+		
+		if(o>-1) { // known observations //
+			// update p(L)
+			pLe_denom = 0.0;
+			// 1. pLe =  (L .* B(:,o)) ./ ( L'*B(:,o)+1e-8 );
+			for(i=0; i<nS; i++)
+				pLe_denom += pL[l][i] * hmm->getB(dt,i,o);  // TODO: this is local_pred[o]!!!
+			for(i=0; i<nS; i++)
+				pLe[i] = pL[l][i] * hmm->getB(dt,i,o) / safe0num(pLe_denom); 
+			// 2. L = (pLe'*A)';
+			for(i=0; i<nS; i++)
+				pL[l][i]= 0.0; 
+			for(j=0; j<nS; j++)
+				for(j=0; j<nS; j++)
+					for(i=0; i<nS; i++)
+						pL[l][j] += pLe[i] * hmm->getA(dt,i,j);//A[i][j]; 
+		} else { // unknown observation
+			// 2. L = (pL'*A)';
+			for(i=0; i<nS; i++)
+				pLe[i] = pL[l][i]; // copy first; 
+			for(i=0; i<nS; i++)
+				pL[l][i] = 0.0; // erase old value 
+			for(j=0; j<nS; j++)
+				for(i=0; i<nS; i++)
+					pL[l][j] += pLe[i] * hmm->getA(dt,i,j);
+		}// observations
+		projectsimplex(pL[l], nS); // addition to make sure there's not side effects 
+	}
+	
+	// write prediction out (after update)
+	// write prediction out (before pKnown update)
+	if(f_predictions>0 && pd->fid != NULL) { // write predictions file if it was opened
+		for(m=0; m<nO; m++)
+			fprintf(pd->fid,"%12.10f%s",local_pred[m],(m<(nO-1))?"\t": ((f_predictions==1)?"\n":"\t") );// if we print states of KCs, continut
+		if(f_predictions==2) { // if we print out states of KC's as welll
+			for(int l=0; l<n; l++) { // all KC here
+				fprintf(pd->fid,"%12.10f%s",pL[l][0], (l==(n-1) && l==(n-1))?"\n":"\t"); // nnon boost // if end of all states: end line//UNBOOST
+			}
+		}
+	} else if(f_predictions>0) { // keep them for writing out in the order of rows
+		for(m=0; m<nO; m++)
+			pd->dat_predict[ (size_t)t*nO + m ] = local_pred[m];
+		if(f_predictions==2) // states of KC's, by the (stacked) row
+			for(int l=0; l<n; l++)
+				pd->dat_state[ ((hmm->p->multiskill==0)?t:pd->dat_skill_rix[t]) + l ] = pL[l][0];
+	}
+
+	pm->rmse += pow(isTarget-local_pred[f_metrics_target_obs],2);
+	pm->rmse_no_null += pow(isTarget-local_pred[f_metrics_target_obs],2);
+	pm->accuracy += isTarget == (local_pred[f_metrics_target_obs]==maxn(local_pred,nO) && local_pred[f_metrics_target_obs]>1/nO);
+	pm->accuracy_no_null += isTarget == (local_pred[f_metrics_target_obs]==maxn(local_pred,nO) && local_pred[f_metrics_target_obs]>1/nO);
+	p = safe01num(local_pred[f_metrics_target_obs]);
+	pm->ll -= safelog(  p)*   isTarget  +  safelog(1-p)*(1-isTarget);
+	pm->ll_no_null -= safelog(  p)*   isTarget  +  safelog(1-p)*(1-isTarget);
+}
+
+//void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, StripedArray<NCAT*> *dat_multiskill) {
+void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, NCAT *dat_skill_stacked, NCAT *dat_skill_rcount, NDAT *dat_skill_rix, HMMProblem **hmms, NPAR nhmms, NPAR *hmm_idx, NUMBER *dat_predict, NUMBER *dat_state, struct state_store *states) {
+	NDAT t;
+	NCAT g;
+	NPAR i, m;
 	
 	NPAR nS = hmms[0]->p->nS, nO = hmms[0]->p->nO;
 	NCAT nK = hmms[0]->p->nK, nG = hmms[0]->p->nG;
@@ -763,19 +1281,44 @@ void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, N
 		}
 	}
 	
-	NUMBER *local_pred = init1D<NUMBER>(nO); // local prediction
-	NUMBER *pLe = init1D<NUMBER>(nS);// p(L|evidence);
-	NUMBER pLe_denom; // p(L|evidence) denominator
-	NUMBER ***group_skill_map = init3D<NUMBER>(nG, nK, nS);
-	
-	NUMBER ll = 0.0, ll_no_null = 0.0, rmse = 0.0, rmse_no_null = 0.0, accuracy = 0.0, accuracy_no_null = 0.0;
-	NUMBER p;
-	
-//	NUMBER *dat_predict = Calloc(NUMBER, N * nO);
-	
+	struct predict_data pd;
+	pd.dat_obs = dat_obs;
+	pd.dat_group = dat_group;
+	pd.dat_skill = dat_skill;
+	pd.dat_skill_stacked = dat_skill_stacked;
+	pd.dat_skill_rcount = dat_skill_rcount;
+	pd.dat_skill_rix = dat_skill_rix;
+	pd.hmms = hmms;
+	pd.nhmms = nhmms;
+	pd.hmm_idx = hmm_idx;
+	// states of all student-skill pairs, p(L) is set at the first row of the pair, unless the caller's states have it
+	struct state_store own_states;
+	if(states == NULL) {
+		initStateStore(&own_states, nS);
+		states = &own_states;
+	}
+	int max_n = 1; // most skills on a row
+	for(t=0; t<N; t++) {
+		NCAT *ar = (f_multiskill==0)?&dat_skill[t]:&dat_skill_stacked[ dat_skill_rix[t] ];
+		int n = (f_multiskill==0)?1:dat_skill_rcount[t];
+		if(ar[0]<0) continue; // null skill
+		for(int l=0; l<n; l++)
+			addState(states, dat_group[t], ar[l]);
+		if(n>max_n) max_n = n;
+	}
+	pd.states = states;
+	pd.fid = NULL;
+	pd.dat_predict = NULL;
+	pd.dat_state = NULL;
+	struct predict_metrics pm = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 	
 	FILE *fid = NULL; // file for storing prediction should that be necessary
-	if(f_predictions>0) {
+	bool keep = filename == NULL; // in the caller's arrays
+	if(keep) {
+		pd.dat_predict = dat_predict;
+		pd.dat_state = dat_state;
+	}
+	if(f_predictions>0 && !keep) {
 		fid = fopen(filename,"w");
 		if(fid == NULL)
 		{
@@ -784,197 +1327,112 @@ void HMMProblem::predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, N
 		}
 	}
 	
-	// initialize
-	struct data* dt = new data;
-	NDAT count = 0;
-//	NDAT d = 0;
-	HMMProblem *hmm;
-	
-	for(t=0; t<N; t++) {
-//		output_this = true;
-		o = dat_obs[t];
-		g = dat_group[t];
-		dt->g = g;
-		
-		hmm = (nhmms==1)?hmms[0]:hmms[hmm_idx[t]]; // if just one hmm, use 0's, otherwise take the index value
-		
-		isTarget = hmm->p->metrics_target_obs == o;
-		NCAT *ar;
-		int n;
-		if(f_multiskill==0) {
-			k = dat_skill[t];
-			ar = &k;
-			n = 1;
-		} else {
-			k = dat_skill_stacked[ dat_skill_rix[t] ];
-			ar = &dat_skill_stacked[ dat_skill_rix[t] ];
-			n = dat_skill_rcount[t];
+	// students are independent: their rows can be predicted in parallel, in the order of the file within a student
+	bool parallel = hmms[0]->p->parallel!=0 && (omp_get_max_threads()>1 || hmms[0]->p->reproducible==1);
+	if(!parallel) {
+		NUMBER *local_pred = init1D<NUMBER>(nO); // local prediction
+		NUMBER *pLe = init1D<NUMBER>(nS);// p(L|evidence);
+		NUMBER **pL = Malloc(NUMBER*, (size_t)max_n); // p(L) of the skills on the row
+		struct data* dt = new struct data;
+		pd.fid = fid;
+		for(t=0; t<N; t++)
+			predictRow(&pd, t, dt, local_pred, pLe, pL, &pm);
+		delete(dt);
+		free(pL);
+		free(local_pred);
+		free(pLe);
+	} else {
+		// rows, student-major (counting sort by student, stable)
+		NDAT *g_start = Calloc(NDAT, (size_t)nG+1);
+		NDAT *perm = Malloc(NDAT, (size_t)N);
+		for(t=0; t<N; t++) g_start[ dat_group[t]+1 ]++;
+		for(g=0; g<nG; g++) g_start[g+1] += g_start[g];
+		NDAT *g_pos = Malloc(NDAT, (size_t)nG);
+		memcpy(g_pos, g_start, sizeof(NDAT)*(size_t)nG);
+		for(t=0; t<N; t++) perm[ g_pos[ dat_group[t] ]++ ] = t;
+		free(g_pos);
+		// blocks of whole students of about equal rows, fixed size ones for reproducible sums
+		NDAT nblock = (hmms[0]->p->reproducible==1)?(N + FB_CHUNK_ROWS - 1)/FB_CHUNK_ROWS:(NDAT)(FB_CHUNKS_PER_THREAD*omp_get_max_threads());
+		if(nblock<1) nblock = 1;
+		NDAT block_rows = (N + nblock - 1)/nblock;
+		NCAT *block = Malloc(NCAT, (size_t)nG+1); // first student of a block
+		NDAT b = 0;
+		block[b++] = 0;
+		for(g=1; g<nG; g++)
+			if( g_start[g] >= (NDAT)(b*block_rows) ) block[b++] = g;
+		block[b] = nG;
+		nblock = b;
+		struct predict_metrics *bm = Calloc(struct predict_metrics, (size_t)nblock); // zeroes
+		if(f_predictions>0 && !keep) {
+			pd.dat_predict = Malloc(NUMBER, (size_t)N*nO);
+			if(f_predictions==2)
+				pd.dat_state = Malloc(NUMBER, (size_t)((f_multiskill==0)?N:hmms[0]->p->Nstacked));
 		}
-		
-		// deal with null skill
-		if(ar[0]<0) { // if no skill label
-			isTarget = hmm->null_skill_obs==o;
-			rmse += pow(isTarget - hmm->null_obs_ratio[f_metrics_target_obs],2);
-			accuracy += isTarget == (hmm->null_obs_ratio[f_metrics_target_obs]==maxn(hmm->null_obs_ratio,nO) && hmm->null_obs_ratio[f_metrics_target_obs] > 1/nO);
-//			rmse += pow(isTarget - hmm->null_skill_obs_prob,2);
-//			accuracy += isTarget == (hmm->null_skill_obs_prob>=0.5);
-			ll -= isTarget*safelog(hmm->null_skill_obs_prob) + (1-isTarget)*safelog(1 - hmm->null_skill_obs_prob);
-//			if(this->p->predictions>0 && output_this) // write predictions file if it was opened
-			for(m=0; m<nO; m++) {
-				fprintf(fid,"%12.10f%s",hmm->null_obs_ratio[m],(m<(nO-1))?"\t":"\n");//PRINTNOW
-//				d = (NDAT)m*N + t;
-//				dat_predict[ d ] = hmm->null_obs_ratio[m];
-			}
-			
-			continue;
+		#pragma omp parallel
+		{
+			NUMBER *local_pred = init1D<NUMBER>(nO); // local prediction
+			NUMBER *pLe = init1D<NUMBER>(nS);// p(L|evidence);
+			NUMBER **pL = Malloc(NUMBER*, (size_t)max_n); // p(L) of the skills on the row
+			struct data* dt = new struct data;
+			#pragma omp for schedule(dynamic)
+			for(NDAT c=0; c<nblock; c++)
+				for(NDAT r=g_start[ block[c] ]; r<g_start[ block[c+1] ]; r++)
+					predictRow(&pd, perm[r], dt, local_pred, pLe, pL, &bm[c]);
+			delete(dt);
+			free(pL);
+			free(local_pred);
+			free(pLe);
 		}
-		// check if {g,k}'s were initialized
-		for(int l=0; l<n; l++) {
-			k = ar[l];
-			if( group_skill_map[g][k][0]==0)
-			{
-				dt->k = k;
-				
-				for(i=0; i<nS; i++) {
-					group_skill_map[g][k][i] = hmm->getPI(dt,i);
-					count++;
-				}
-			}// pLo/pL not set
-		}// for all skills at this transaction
-		
-		// produce prediction and copy to result
-		hmm->producePCorrect(group_skill_map, local_pred, ar, n, dt); 
-		projectsimplex(local_pred, nO); // addition to make sure there's not side effects
-		
-		// if necessary guess the obsevaion using Pi and B
-		if(f_update_known=='g') {
-			NUMBER max_local_pred=0;
-			NPAR ix_local_pred=0;
-			for(m=0; m<nO; m++) {
-				if( local_pred[m]>max_local_pred ) {
-					max_local_pred = local_pred[m];
-					ix_local_pred = m;
-				}
-			}
-			o = ix_local_pred;
+		for(b=0; b<nblock; b++) { // merge in the order of blocks
+			pm.ll += bm[b].ll;
+			pm.ll_no_null += bm[b].ll_no_null;
+			pm.rmse += bm[b].rmse;
+			pm.rmse_no_null += bm[b].rmse_no_null;
+			pm.accuracy += bm[b].accuracy;
+			pm.accuracy_no_null += bm[b].accuracy_no_null;
 		}
-		
-		// update pL
-		for(int l=0; l<n; l++) {
-			k = ar[l];
-			dt->k = k;
-			
-			if(o>-1) { // known observations //
-				// update p(L)
-				pLe_denom = 0.0;
-				// 1. pLe =  (L .* B(:,o)) ./ ( L'*B(:,o)+1e-8 );
-				for(i=0; i<nS; i++)
-					pLe_denom += group_skill_map[g][k][i] * hmm->getB(dt,i,o);  // TODO: this is local_pred[o]!!!
-				for(i=0; i<nS; i++)
-					pLe[i] = group_skill_map[g][k][i] * hmm->getB(dt,i,o) / safe0num(pLe_denom); 
-				// 2. L = (pLe'*A)';
-				for(i=0; i<nS; i++)
-					group_skill_map[g][k][i]= 0.0; 
-				for(j=0; j<nS; j++)
-					for(j=0; j<nS; j++)
-						for(i=0; i<nS; i++)
-							group_skill_map[g][k][j] += pLe[i] * hmm->getA(dt,i,j);//A[i][j]; 
-			} else { // unknown observation
-				// 2. L = (pL'*A)';
-				for(i=0; i<nS; i++)
-					pLe[i] = group_skill_map[g][k][i]; // copy first; 
-				for(i=0; i<nS; i++)
-					group_skill_map[g][k][i] = 0.0; // erase old value 
-				for(j=0; j<nS; j++)
-					for(i=0; i<nS; i++)
-						group_skill_map[g][k][j] += pLe[i] * hmm->getA(dt,i,j);
-			}// observations
-			projectsimplex(group_skill_map[g][k], nS); // addition to make sure there's not side effects 
-		}
-		
-		// write prediction out (after update)
-		// write prediction out (before pKnown update)
-		if(f_predictions>0 /*&& output_this*/) { // write predictions file if it was opened
-			for(m=0; m<nO; m++) {
-				fprintf(fid,"%12.10f%s",local_pred[m],(m<(nO-1))?"\t": ((f_predictions==1)?"\n":"\t") );// if we print states of KCs, continut
-//				d = (NDAT)m*N + t;
-//				dat_predict[ d ] = local_pred[m];
-			}
-			if(f_predictions==2) { // if we print out states of KC's as welll
-				for(int l=0; l<n; l++) { // all KC here
-					fprintf(fid,"%12.10f%s",group_skill_map[g][ ar[l] ][0], (l==(n-1) && l==(n-1))?"\n":"\t"); // nnon boost // if end of all states: end line//UNBOOST
-//					fprintf(fid,"%12.10f%s",gsm(g, ar[l] )[0], (l==(n-1) && l==(n-1))?"\n":"\t"); // if end of all states: end line //BOOST
+		free(bm);
+		free(block);
+		free(perm);
+		free(g_start);
+		// write predictions out in the order of rows
+		if(f_predictions>0 && !keep) {
+			for(t=0; t<N; t++) {
+				NCAT *ar = (f_multiskill==0)?&dat_skill[t]:&dat_skill_stacked[ dat_skill_rix[t] ];
+				if(ar[0]<0) { // null skill
+					for(m=0; m<nO; m++)
+						fprintf(fid,"%12.10f%s",pd.dat_predict[ (size_t)t*nO + m ],(m<(nO-1))?"\t":"\n");
+					continue;
+				}
+				for(m=0; m<nO; m++)
+					fprintf(fid,"%12.10f%s",pd.dat_predict[ (size_t)t*nO + m ],(m<(nO-1))?"\t": ((f_predictions==1)?"\n":"\t") );
+				if(f_predictions==2) {
+					int n = (f_multiskill==0)?1:dat_skill_rcount[t];
+					NDAT ix = (f_multiskill==0)?t:dat_skill_rix[t];
+					for(int l=0; l<n; l++)
+						fprintf(fid,"%12.10f%s",pd.dat_state[ix + l], (l==(n-1))?"\n":"\t");
 				}
 			}
+			free(pd.dat_predict);
+			if(pd.dat_state != NULL) free(pd.dat_state);
 		}
-
-		rmse += pow(isTarget-local_pred[f_metrics_target_obs],2);
-		rmse_no_null += pow(isTarget-local_pred[f_metrics_target_obs],2);
-		accuracy += isTarget == (local_pred[f_metrics_target_obs]==maxn(local_pred,nO) && local_pred[f_metrics_target_obs]>1/nO);
-		accuracy_no_null += isTarget == (local_pred[f_metrics_target_obs]==maxn(local_pred,nO) && local_pred[f_metrics_target_obs]>1/nO);
-		p = safe01num(local_pred[f_metrics_target_obs]);
-		ll -= safelog(  p)*   isTarget  +  safelog(1-p)*(1-isTarget);
-		ll_no_null -= safelog(  p)*   isTarget  +  safelog(1-p)*(1-isTarget);
-	} // for all data
+	}
 	
-	delete(dt);
-	free(local_pred);
-	free(pLe);
-	free3D<NUMBER>(group_skill_map, nG, nK);
+	if(states == &own_states)
+		freeStateStore(&own_states);
 
-	rmse = sqrt(rmse / N);
-	rmse_no_null = sqrt(rmse_no_null / (N - N_null));
+	NUMBER rmse = sqrt(pm.rmse / N);
+	NUMBER rmse_no_null = sqrt(pm.rmse_no_null / (N - N_null));
 	if(metrics != NULL) {
-		metrics[0] = ll;
-		metrics[1] = ll_no_null;
+		metrics[0] = pm.ll;
+		metrics[1] = pm.ll_no_null;
 		metrics[2] = rmse;
 		metrics[3] = rmse_no_null;
-		metrics[4] = accuracy/N;
-		metrics[5] = accuracy_no_null/(N-N_null);
+		metrics[4] = pm.accuracy/N;
+		metrics[5] = pm.accuracy_no_null/(N-N_null);
 	}
 	
-	
-//	if(f_predictions>0) {
-//		ofstream fout(filename,ios::out);
-//		char str[1024];
-//		if(!fout)
-//		{
-//			fprintf(stderr,"WARNINT! Failed to open output prediction file %s for writing\n",filename);
-//			//exit(1); // do not exit with error
-//		}
-//		
-//		for(NDAT t=0; t<N; t++) {
-//			for(m=0; m<nO; m++) {
-//				d = (NDAT)m*N + t;
-//				sprintf(str,"%12.10f%s",dat_predict[d],(m<(nO-1))?"\t": ((f_predictions==1)?"\n":"\t") );
-//				fout << str;
-//			}
-////			if(f_predictions==2) { // if we print out states of KC's as welll
-////				if(f_multiskill==0) {
-////					k = dat_skill[t];
-////					ar = &k;
-////					v = dat_known[t];
-////					var = &v;
-////					n = 1;
-////				} else {
-////					k = dat_skill_stacked[ dat_skill_rix[t] ];
-////					ar = &dat_skill_stacked[ dat_skill_rix[t] ];
-////					v = dat_known_stacked[ dat_skill_rix[t] ];
-////					var = &dat_known_stacked[ dat_skill_rix[t] ];
-////					n = dat_skill_rcount[t];
-////				}
-////				for(int l=0; l<n && ar[0]>-1; l++) { // all KC here
-////					sprintf(str,"%12.10f%s",var[l], (l==(n-1) && l==(n-1))?"\n":"\t");
-////					fout << str;
-////				}
-////			}
-//		}
-//		fout.close();
-//	}
-//	free(dat_predict);
-	
-	
-	if(f_predictions>0) // close predictions file if it was opened
+	if(fid != NULL) // close predictions file if it was opened
 		fclose(fid);
 }
 
@@ -1010,6 +1468,10 @@ void HMMProblem::fit() {
     }
     this->neg_log_lik = loglik_rmse[0];
     free(loglik_rmse);
+    // alpha, beta, c are not needed after the fit: the workspaces of all threads of the team go, so that a
+    // long-lived process (libbkt) does not keep the largest fit's (fits of concurrent folds free their own)
+    #pragma omp parallel if(!omp_in_parallel())
+    freeWorkspace(&fit_ws);
 }
 
 void HMMProblem::FitNullSkill(NUMBER* loglik_rmse, bool keep_SE) {
@@ -1156,6 +1618,53 @@ FitResult HMMProblem::GradientDescentBit(FitBit *fb) {
     return res;
 }
 
+// orders skills (or groups) for the skill scheduler by cost, largest first, and cuts the ones costlier
+// than a thread's share of all work into chunks of sequences, as many as their share of threads
+void HMMProblem::getFitSchedule(NCAT nX, NCAT *x_numx, struct data ***x_x_data, NCAT *order, NCAT *nchunk) {
+    NUMBER *cost = Calloc(NUMBER, (size_t)nX);
+    NUMBER total = 0;
+    NCAT x, y;
+    int nthreads = omp_get_max_threads();
+    for(x=0; x<nX; x++) {
+        for(y=0; y<x_numx[x]; y++)
+            if(x_x_data[x][y]->cnt==0) cost[x] += x_x_data[x][y]->n;
+        cost[x] *= this->p->maxiter; // rows x expected iterations, the latter are not known before the fit, maxiter bounds them
+        total += cost[x];
+        order[x] = x;
+    }
+    std::stable_sort(order, order + nX, CostlierFirst(cost));
+    for(x=0; x<nX; x++) {
+        nchunk[x] = 1;
+        if(nthreads>1 && cost[x]*nthreads>total)
+            nchunk[x] = (NCAT)ceil(cost[x]*nthreads/total) * FB_CHUNKS_PER_THREAD;
+    }
+    free(cost);
+}
+
+// sequence-level parallelism within a fit bit: nchunk>1 makes chunks tasks (under the skill scheduler,
+// or in a team of its own), -P 2 runs chunks in parallel for loops; gradients and Baum-Welch counts
+// of the chunks go to per-thread accumulators, or per-chunk ones for reproducible results (-R 1)
+void HMMProblem::chunkFitBit(FitBit *fb, NCAT nchunk) {
+    NCAT align = (fitKernel(fb)==FBK_GENERIC)?1:FB_LANES; // lanes of the fixed kernels stay whole
+    int nthreads = omp_in_parallel()?omp_get_num_threads():omp_get_max_threads(); // team that will run the chunks
+    if(this->p->reproducible==1) { // chunks by rows, one accumulator each, whatever the threads are
+        NDAT rows = 0;
+        for(NCAT x=0; x<fb->nact; x++)
+            rows += fb->x_data[ fb->x_order[x] ]->n;
+        fb->makeChunks((rows + FB_CHUNK_ROWS - 1) / FB_CHUNK_ROWS, align);
+        fb->initAccumulators(fb->nchunk);
+        fb->acc_by_chunk = 1;
+        fb->split = (NPAR)(nchunk>1 && nthreads>1);
+    } else if(nchunk>1 && nthreads>1) {
+        fb->split = 1;
+        fb->makeChunks(nchunk, align);
+        fb->initAccumulators(nthreads);
+    } else if(this->p->parallel==2) {
+        fb->makeChunks(FB_CHUNKS_PER_THREAD*nthreads, align);
+        if(nthreads>1) fb->initAccumulators(nthreads);
+    }
+}
+
 NUMBER HMMProblem::GradientDescent() {
 	NCAT x, nX;
     if(this->p->structure==STRUCTURE_SKILL)
@@ -1175,6 +1684,10 @@ NUMBER HMMProblem::GradientDescent() {
         FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
         // link accordingly
         fb->link( this->getPI(0), this->getA(0), this->getB(0), this->p->nSeq, this->p->k_data);// link skill 0 (we'll copy fit parameters to others
+        bindFitWorkspace(fb); // alpha, beta, c of the sequences go to this thread's workspace
+        NCAT* original_ks = Calloc(NCAT, (size_t)this->p->nSeq);
+        for(x=0; x<this->p->nSeq; x++) { original_ks[x] = this->p->all_data[x].k; this->p->all_data[x].k = 0; } // save original k's
+        chunkFitBit(fb, (this->p->parallel==1)?FB_CHUNKS_PER_THREAD*omp_get_max_threads():1); // one fit bit for all data, after k's are 0 (fitKernel)
         if(this->p->block_fitting[0]!=0) fb->pi = NULL;
         if(this->p->block_fitting[1]!=0) fb->A  = NULL;
         if(this->p->block_fitting[2]!=0) fb->B  = NULL;
@@ -1191,9 +1704,12 @@ NUMBER HMMProblem::GradientDescent() {
         }
         fb->init(FBS_PARm2); // do this for all in order to capture oscillation, e.g. if new param at t is close to param at t-2 (tolerance)
 
-        NCAT* original_ks = Calloc(NCAT, (size_t)this->p->nSeq);
-        for(x=0; x<this->p->nSeq; x++) { original_ks[x] = this->p->all_data[x].k; this->p->all_data[x].k = 0; } // save original k's
-        fr = GradientDescentBit(fb);
+        if(fb->split) { // chunks of sequences are tasks of a team
+            #pragma omp parallel
+            #pragma omp single
+            fr = GradientDescentBit(fb);
+        } else
+            fr = GradientDescentBit(fb);
         for(x=0; x<this->p->nSeq; x++) { this->p->all_data[x].k = original_ks[x]; } // restore original k's
         free(original_ks);
         if(!this->p->quiet)
@@ -1211,59 +1727,82 @@ NUMBER HMMProblem::GradientDescent() {
 	//
 	// Main fit
 	//
-//    int parallel_now = this->p->parallel==1; //PAR
-//    #pragma omp parallel if(parallel_now) //num_threads(2)//PAR
-//    {//PAR
-//    printf("thread %i|%i\n",omp_get_thread_num(),omp_get_num_threads());//undoPAR
-    if(this->p->single_skill!=2){
-//        #pragma omp for schedule(dynamic) reduction(+:loglik) //PAR
-        for(x=0; x<nX; x++) { // if not "force single skill" too
-            NCAT xndat;
-            struct data** x_data;
-            if(this->p->structure==STRUCTURE_SKILL) {
-                xndat = this->p->k_numg[x];
-                x_data = this->p->k_g_data[x];
-            } else if(this->p->structure==STRUCTURE_GROUP) {
-                xndat = this->p->g_numk[x];
-                x_data = this->p->g_k_data[x];
-            } else {
-                xndat = 0;
-                x_data = NULL;
-            }
-            FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
-            fb->link( this->getPI(x), this->getA(x), this->getB(x), xndat, x_data);
-            if(this->p->block_fitting[0]!=0) fb->pi = NULL;
-            if(this->p->block_fitting[1]!=0) fb->A  = NULL;
-            if(this->p->block_fitting[2]!=0) fb->B  = NULL;
-            
-            FitResult fr;
-            fb->init(FBS_PARm1);
-            fb->init(FBS_GRAD);
-            if(this->p->solver==METHOD_CGD) {
-                fb->init(FBS_DIR);
-                fb->init(FBS_DIRm1);
-                fb->init(FBS_GRADm1);
-            }
-            if(this->p->solver==METHOD_GBB) {
-                fb->init(FBS_GRADm1);
-            }
-            fb->init(FBS_PARm2); // do this for all in order to capture oscillation, e.g. if new param at t is close to param at t-2 (tolerance)
-            
-            fr = GradientDescentBit(fb);
-            delete fb;
-            
-            if( ( /*(!conv && iter<this->p->maxiter) ||*/ (fr.conv || fr.iter==this->p->maxiter) )) {
-                loglik += fr.pO*(fr.pO>0); // reduction'ed
-                if(!this->p->quiet)
-                    printf("skill %5d, seq %5d, dat %8d, iter#%3d p(O|param)= %15.7f >> %15.7f, conv=%d\n", x, xndat, fr.ndat, fr.iter,fr.pO0,fr.pO,fr.conv);
+    if(this->p->single_skill!=2){ // if not "force single skill" too
+        NUMBER *x_loglik = Calloc(NUMBER, (size_t)nX); // summed in the order of skills
+        if(this->p->parallel==1) {
+            NCAT *order = Calloc(NCAT, (size_t)nX);
+            NCAT *nchunk = Calloc(NCAT, (size_t)nX);
+            if(this->p->structure==STRUCTURE_SKILL)
+                getFitSchedule(nX, this->p->k_numg, this->p->k_g_data, order, nchunk);
+            else
+                getFitSchedule(nX, this->p->g_numk, this->p->g_k_data, order, nchunk);
+            #pragma omp parallel
+            #pragma omp single
+            for(NCAT ix=0; ix<nX; ix++) { // largest first, idle threads steal skills and sequences of split ones
+                NCAT y = order[ix];
+                #pragma omp task firstprivate(y)
+                x_loglik[y] = GradientDescentX(y, nchunk[y]);
             }
-        } // for all skills
+            free(order);
+            free(nchunk);
+        } else {
+            for(x=0; x<nX; x++)
+                x_loglik[x] = GradientDescentX(x, 1);
+        }
+        for(x=0; x<nX; x++)
+            loglik += x_loglik[x];
+        free(x_loglik);
     }// if not force single skill
-//    }//#omp //PAR
  
     return loglik;
 }
 
+NUMBER HMMProblem::GradientDescentX(NCAT x, NCAT nchunk) {
+    NCAT xndat;
+    struct data** x_data;
+    if(this->p->structure==STRUCTURE_SKILL) {
+        xndat = this->p->k_numg[x];
+        x_data = this->p->k_g_data[x];
+    } else if(this->p->structure==STRUCTURE_GROUP) {
+        xndat = this->p->g_numk[x];
+        x_data = this->p->g_k_data[x];
+    } else {
+        xndat = 0;
+        x_data = NULL;
+    }
+    FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
+    fb->link( this->getPI(x), this->getA(x), this->getB(x), xndat, x_data);
+    bindFitWorkspace(fb); // alpha, beta, c of the sequences go to this thread's workspace
+    chunkFitBit(fb, nchunk);
+    if(this->p->block_fitting[0]!=0) fb->pi = NULL;
+    if(this->p->block_fitting[1]!=0) fb->A  = NULL;
+    if(this->p->block_fitting[2]!=0) fb->B  = NULL;
+    
+    FitResult fr;
+    fb->init(FBS_PARm1);
+    fb->init(FBS_GRAD);
+    if(this->p->solver==METHOD_CGD) {
+        fb->init(FBS_DIR);
+        fb->init(FBS_DIRm1);
+        fb->init(FBS_GRADm1);
+    }
+    if(this->p->solver==METHOD_GBB) {
+        fb->init(FBS_GRADm1);
+    }
+    fb->init(FBS_PARm2); // do this for all in order to capture oscillation, e.g. if new param at t is close to param at t-2 (tolerance)
+    
+    fr = GradientDescentBit(fb);
+    delete fb;
+    
+    NUMBER loglik = 0.0;
+    if( ( /*(!conv && iter<this->p->maxiter) ||*/ (fr.conv || fr.iter==this->p->maxiter) )) {
+        loglik = fr.pO*(fr.pO>0);
+        if(!this->p->quiet)
+            printf("skill %5d, seq %5d, dat %8d, iter#%3d p(O|param)= %15.7f >> %15.7f, conv=%d\n", x, xndat, fr.ndat, fr.iter,fr.pO0,fr.pO,fr.conv);
+    }
+    return loglik;
+}
+
 NUMBER HMMProblem::BaumWelch() {
 	NCAT k;
     NUMBER loglik = 0;
@@ -1279,6 +1818,10 @@ NUMBER HMMProblem::BaumWelch() {
         NCAT x;
         FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
         fb->link( this->getPI(0), this->getA(0), this->getB(0), this->p->nSeq, this->p->k_data);// link skill 0 (we'll copy fit parameters to others
+        bindFitWorkspace(fb); // alpha, beta, c of the sequences go to this thread's workspace
+        NCAT* original_ks = Calloc(NCAT, (size_t)this->p->nSeq);
+        for(x=0; x<this->p->nSeq; x++) { original_ks[x] = this->p->all_data[x].k; this->p->all_data[x].k = 0; } // save original k's
+        chunkFitBit(fb, (this->p->parallel==1)?FB_CHUNKS_PER_THREAD*omp_get_max_threads():1); // one fit bit for all data, after k's are 0 (fitKernel)
         if(this->p->block_fitting[0]!=0) fb->pi = NULL;
         if(this->p->block_fitting[1]!=0) fb->A  = NULL;
         if(this->p->block_fitting[2]!=0) fb->B  = NULL;
@@ -1292,9 +1835,12 @@ NUMBER HMMProblem::BaumWelch() {
             fb->init(FBS_GRADm1);
         }
 
-        NCAT* original_ks = Calloc(NCAT, (size_t)this->p->nSeq);
-        for(x=0; x<this->p->nSeq; x++) { original_ks[x] = this->p->all_data[x].k; this->p->all_data[x].k = 0; } // save original k's
-        fr = BaumWelchBit(fb);
+        if(fb->split) { // chunks of sequences are tasks of a team
+            #pragma omp parallel
+            #pragma omp single
+            fr = BaumWelchBit(fb);
+        } else
+            fr = BaumWelchBit(fb);
         for(x=0; x<this->p->nSeq; x++) { this->p->all_data[x].k = original_ks[x]; } // restore original k's
         free(original_ks);
         if(!this->p->quiet)
@@ -1313,32 +1859,61 @@ NUMBER HMMProblem::BaumWelch() {
 	//
 	// Main fit
 	//
-    
-//    int parallel_now = this->p->parallel==1; //PAR
-//    #pragma omp parallel if(parallel_now) //num_threads(2) //PAR
-//    {//PAR
-//        #pragma omp for schedule(dynamic) reduction(+:loglik) //PAR
+    NUMBER *k_loglik = Calloc(NUMBER, (size_t)this->p->nK); // summed in the order of skills
+    if( (this->p->parallel==1) && this->p->structure==STRUCTURE_GROUP ) {
+        // sequences of a skill have rows of their groups, which fit bits of other skills update: skills go in order,
+        // sequences of a skill in parallel
+        NCAT nchunk = FB_CHUNKS_PER_THREAD*omp_get_max_threads();
         for(k=0; k<this->p->nK; k++) {
-            FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
-            fb->link(this->getPI(k), this->getA(k), this->getB(k), this->p->k_numg[k], this->p->k_g_data[k]);
-            if(this->p->block_fitting[0]!=0) fb->pi = NULL;
-            if(this->p->block_fitting[1]!=0) fb->A  = NULL;
-            if(this->p->block_fitting[2]!=0) fb->B  = NULL;
-            
-            fb->init(FBS_PARm1);
-            fb->init(FBS_PARm2);
-            
-            FitResult fr;
-            fr = BaumWelchBit(fb);
-            delete fb;
-            
-            if( ( /*(!conv && iter<this->p->maxiter) ||*/ (fr.conv || fr.iter==this->p->maxiter) )) {
-                loglik += fr.pO*(fr.pO>0); // reduction'ed
-                if(!this->p->quiet)
-                    printf("skill %4d, seq %4d, dat %8d, iter#%3d p(O|param)= %15.7f >> %15.7f, conv=%d\n", k,  this->p->k_numg[k], fr.ndat, fr.iter,fr.pO0,fr.pO,fr.conv);
-            }
-        } // for all skills
-//    }//PAR
+            #pragma omp parallel if(omp_get_max_threads()>1)
+            #pragma omp single
+            k_loglik[k] = BaumWelchX(k, nchunk);
+        }
+    } else if(this->p->parallel==1) {
+        NCAT *order = Calloc(NCAT, (size_t)this->p->nK);
+        NCAT *nchunk = Calloc(NCAT, (size_t)this->p->nK);
+        getFitSchedule(this->p->nK, this->p->k_numg, this->p->k_g_data, order, nchunk);
+        #pragma omp parallel
+        #pragma omp single
+        for(NCAT ix=0; ix<this->p->nK; ix++) { // largest first, idle threads steal skills and sequences of split ones
+            NCAT y = order[ix];
+            #pragma omp task firstprivate(y)
+            k_loglik[y] = BaumWelchX(y, nchunk[y]);
+        }
+        free(order);
+        free(nchunk);
+    } else {
+        for(k=0; k<this->p->nK; k++)
+            k_loglik[k] = BaumWelchX(k, 1);
+    }
+    for(k=0; k<this->p->nK; k++)
+        loglik += k_loglik[k];
+    free(k_loglik);
+    return loglik;
+}
+
+NUMBER HMMProblem::BaumWelchX(NCAT k, NCAT nchunk) {
+    FitBit *fb = new FitBit(this->p->nS, this->p->nO, this->p->nK, this->p->nG, this->p->tol, this->p->tol_mode);
+    fb->link(this->getPI(k), this->getA(k), this->getB(k), this->p->k_numg[k], this->p->k_g_data[k]);
+    bindFitWorkspace(fb); // alpha, beta, c of the sequences go to this thread's workspace
+    chunkFitBit(fb, nchunk);
+    if(this->p->block_fitting[0]!=0) fb->pi = NULL;
+    if(this->p->block_fitting[1]!=0) fb->A  = NULL;
+    if(this->p->block_fitting[2]!=0) fb->B  = NULL;
+    
+    fb->init(FBS_PARm1);
+    fb->init(FBS_PARm2);
+    
+    FitResult fr;
+    fr = BaumWelchBit(fb);
+    delete fb;
+    
+    NUMBER loglik = 0.0;
+    if( ( /*(!conv && iter<this->p->maxiter) ||*/ (fr.conv || fr.iter==this->p->maxiter) )) {
+        loglik = fr.pO*(fr.pO>0);
+        if(!this->p->quiet)
+            printf("skill %4d, seq %4d, dat %8d, iter#%3d p(O|param)= %15.7f >> %15.7f, conv=%d\n", k,  this->p->k_numg[k], fr.ndat, fr.iter,fr.pO0,fr.pO,fr.conv);
+    }
     return loglik;
 }
 
@@ -1355,7 +1930,7 @@ FitResult HMMProblem::BaumWelchBit(FitBit *fb) {
     fr.ndat = -1; // no accounting so far
     while( !fr.conv && fr.iter<=this->p->maxiter ) {
         if(fr.iter==1) {
-            fr.ndat = computeAlphaAndPOParam(xndat, x_data);
+            fr.ndat = computeAlphaAndPOParam(fb);
             fr.pO0 = HMMProblem::getSumLogPOPara(xndat, x_data);
             fr.pOmid = fr.pO0;
         }
@@ -1454,7 +2029,7 @@ NUMBER HMMProblem::doLinearStep(FitBit *fb) {
         }
         
 		// recompute alpha and p(O|param)
-		computeAlphaAndPOParam(xndat, x_data);
+		computeAlphaAndPOParam(fb);
 		// compute f(x_{k+1})
 		f_xkplus1 = HMMProblem::getSumLogPOPara(xndat, x_data);
 		// compute Armijo compliance
@@ -1595,7 +2170,7 @@ NUMBER HMMProblem::doLagrangeStep(FitBit *fb) {
         }
     }
     // compute LL
-    computeAlphaAndPOParam(fb->xndat, fb->x_data);
+    computeAlphaAndPOParam(fb);
     ll = HMMProblem::getSumLogPOPara(fb->xndat, fb->x_data);
 
 	free(b_PI);
@@ -1758,7 +2333,7 @@ NUMBER HMMProblem::doConjugateLinearStep(FitBit *fb) {
 			}
 		}
 		// recompute alpha and p(O|param)
-		computeAlphaAndPOParam(fb->xndat, fb->x_data);
+		computeAlphaAndPOParam(fb);
 		// compute f(x_{k+1})
 		f_xkplus1 = HMMProblem::getSumLogPOPara(fb->xndat, fb->x_data);
 		// compute Armijo compliance
@@ -1903,75 +2478,40 @@ NUMBER HMMProblem::doBarzilaiBorweinStep(FitBit *fb) {
 	free2D<NUMBER>(s_k_m1_A, nS);
 
     // recompute alpha and p(O|param)
-    computeAlphaAndPOParam(fb->xndat, fb->x_data);
+    computeAlphaAndPOParam(fb);
     return HMMProblem::getSumLogPOPara(fb->xndat, fb->x_data);
 }
 
 NUMBER HMMProblem::doBaumWelchStep(FitBit *fb) {
-	NCAT x;
     NPAR nS = this->p->nS, nO = this->p->nO;
-	NPAR i,j,m, o;
-	NDAT t;
+	NPAR i,j,m;
     NUMBER ll;
     
-    NCAT xndat = fb->xndat;
-    struct data **x_data = fb->x_data;
-    computeAlphaAndPOParam(xndat, x_data);
-	computeBeta(xndat, x_data);
-	computeXiGamma(xndat, x_data);
+    computeAlphaAndPOParam(fb);
 	
     NUMBER * b_PI = NULL;
 	NUMBER ** b_A_num = NULL;
-	NUMBER ** b_A_den = NULL;
 	NUMBER ** b_B_num = NULL;
-	NUMBER ** b_B_den = NULL;
+	NUMBER * b_den = init1D<NUMBER>((NDAT)nS); // expected number of times in a state, same for A and B
     if(fb->pi != NULL)
         b_PI = init1D<NUMBER>((NDAT)nS);
-    if(fb->A != NULL) {
+    if(fb->A != NULL)
         b_A_num = init2D<NUMBER>((NDAT)nS, (NDAT)nS);
-        b_A_den = init2D<NUMBER>((NDAT)nS, (NDAT)nS);
-    }
-    if(fb->B != NULL) {
+    if(fb->B != NULL)
         b_B_num = init2D<NUMBER>((NDAT)nS, (NDAT)nO);
-        b_B_den = init2D<NUMBER>((NDAT)nS, (NDAT)nO);
-    }
-
-    // compute sums PI
 
-	for(x=0; x<xndat; x++) {
-        if( x_data[x]->cnt!=0 ) continue;
-        
-        if(fb->pi != NULL)
-            for(i=0; i<nS; i++)
-                b_PI[i] += x_data[x]->gamma[0][i] / xndat;
-		
-		for(t=0;t<(x_data[x]->n-1);t++) {
-            //			o = x_data[x]->obs[t];
-            o = this->p->dat_obs[ x_data[x]->ix[t] ];//->get( x_data[x]->ix[t] );
-			for(i=0; i<nS; i++) {
-                if(fb->A != NULL)
-                    for(j=0; j<nS; j++){
-                        b_A_num[i][j] += x_data[x]->xi[t][i][j];
-                        b_A_den[i][j] += x_data[x]->gamma[t][i];
-                    }
-                if(fb->B != NULL)
-                    for(m=0; m<nO; m++) {
-                        b_B_num[i][m] += (m==o) * x_data[x]->gamma[t][i];
-                        b_B_den[i][m] += x_data[x]->gamma[t][i];
-                    }
-			}
-		}
-	} // for all groups within a skill
+    // compute sums PI, A, B while going backward
+    accumulateBaumWelch(fb, b_PI, b_A_num, b_B_num, b_den);
 	// set params
 	for(i=0; i<nS; i++) {
         if(fb->pi != NULL)
             fb->pi[i] = b_PI[i];
         if(fb->A != NULL)
             for(j=0; j<nS; j++)
-                fb->A[i][j] = b_A_num[i][j] / safe0num(b_A_den[i][j]);
+                fb->A[i][j] = b_A_num[i][j] / safe0num(b_den[i]);
         if(fb->B != NULL)
             for(m=0; m<nO; m++)
-                fb->B[i][m] = b_B_num[i][m] / safe0num(b_B_den[i][m]);
+                fb->B[i][m] = b_B_num[i][m] / safe0num(b_den[i]);
 	}
     // scale
     if( !this->hasNon01Constraints() ) {
@@ -1994,15 +2534,14 @@ NUMBER HMMProblem::doBaumWelchStep(FitBit *fb) {
         }
     }
     // compute LL
-    computeAlphaAndPOParam(fb->xndat, fb->x_data);
+    computeAlphaAndPOParam(fb);
     ll = HMMProblem::getSumLogPOPara(fb->xndat, fb->x_data);
     // free mem
     //    RecycleFitData(xndat, x_data, this->p);
 	if(b_PI    != NULL) free(b_PI);
 	if(b_A_num != NULL) free2D<NUMBER>(b_A_num, nS);
-	if(b_A_den != NULL) free2D<NUMBER>(b_A_den, nS);
 	if(b_B_num != NULL) free2D<NUMBER>(b_B_num, nS);
-	if(b_B_den != NULL) free2D<NUMBER>(b_B_den, nS);
+	free(b_den);
     return ll;
 }
 
@@ -2012,6 +2551,7 @@ void HMMProblem::readNullObsRatio(FILE *fid, struct param* param, NDAT *line_no)
 	// read null skill ratios
 	//
     fscanf(fid, "Null skill ratios\t");
+    if(this->null_obs_ratio != NULL) free(this->null_obs_ratio);
     this->null_obs_ratio =Calloc(NUMBER, (size_t)this->p->nO);
     this->null_skill_obs      = 0;
     this->null_skill_obs_prob = 0;
@@ -2030,6 +2570,15 @@ void HMMProblem::readNullObsRatio(FILE *fid, struct param* param, NDAT *line_no)
 }
 
 void HMMProblem::readModel(const char *filename, bool overwrite) {
+    if( isModelBin(filename) ) {
+        struct param initparam;
+        set_param_defaults(&initparam);
+        struct bin_model *bm = openModelBin(filename, overwrite?this->p:&initparam);
+        readModelBin(bm, overwrite);
+        closeModelBin(bm);
+        destroy_input_data(&initparam);
+        return;
+    }
 	FILE *fid = fopen(filename,"r");
 	if(fid == NULL)
 	{
@@ -2052,17 +2601,16 @@ void HMMProblem::readModel(const char *filename, bool overwrite) {
     //
     // read model
     //
-    readModelBody(fid, &initparam, &line_no, overwrite);
+    readModelBody(fid, overwrite?this->p:&initparam, &line_no, overwrite);
 		
 	fclose(fid);
 	free(line);
+    destroy_input_data(&initparam);
 }
 
 void HMMProblem::readModelBody(FILE *fid, struct param* param, NDAT *line_no,  bool overwrite) {
 	NPAR i,j,m;
 	NCAT k = 0, idxk = 0;
-    std::map<std::string,NCAT>::iterator it;
-	string s;
     char col[2048];
     //
     readNullObsRatio(fid, param, line_no);
@@ -2070,34 +2618,32 @@ void HMMProblem::readModelBody(FILE *fid, struct param* param, NDAT *line_no,  b
     // init param
     //
     if(overwrite) {
-        this->p->map_group_fwd = new map<string,NCAT>();
-        this->p->map_group_bwd = new map<NCAT,string>();
-        this->p->map_skill_fwd = new map<string,NCAT>();
-        this->p->map_skill_bwd = new map<NCAT,string>();
+        if(this->p->voc_group != NULL) freeVocab(this->p->voc_group);
+        if(this->p->voc_skill != NULL) freeVocab(this->p->voc_skill);
+        this->p->voc_group = newVocab();
+        this->p->voc_skill = newVocab();
     }
 	//
-	// read skills
+	// read skills (or groups)
 	//
-	for(k=0; k<param->nK; k++) {
+    struct vocab *labels = (this->p->structure==STRUCTURE_GROUP)?this->p->voc_group:this->p->voc_skill;
+    NCAT nX = (param->structure==STRUCTURE_GROUP)?param->nG:param->nK;
+	for(k=0; k<nX; k++) {
 		// read skill label
         fscanf(fid,"%*s\t%[^\n]\n",col);
-        s = string( col );
         (*line_no)++;
         if(overwrite) {
-            this->p->map_skill_fwd->insert(pair<string,NCAT>(s, (NCAT)this->p->map_skill_fwd->size()));
-            this->p->map_skill_bwd->insert(pair<NCAT,string>((NCAT)this->p->map_skill_bwd->size(), s));
+            addVocab(labels, col, strlen(col));
             idxk = k;
         } else {
-            it = this->p->map_skill_fwd->find(s);
-            if( it==this->p->map_skill_fwd->end() ) { // not found, skip 3 lines and continue
+            idxk = findVocab(labels, col, strlen(col));
+            if( idxk < 0 ) { // not found, skip 3 lines and continue
                 fscanf(fid, "%*[^\n]\n");
                 fscanf(fid, "%*[^\n]\n");
                 fscanf(fid, "%*[^\n]\n");
                 (*line_no)+=3;
                 continue; // skip this iteration
             }
-            else
-                idxk =it->second;
         }
         // read PI
         fscanf(fid,"PI\t");
@@ -2138,3 +2684,174 @@ void HMMProblem::readModelBody(FILE *fid, struct param* param, NDAT *line_no,  b
         (*line_no)++;
 	} // for all k
 }
+
+HMMProblem* HMMProblem::loadModel(const char *filename, struct param* param) {
+    // solver info: sizes of the model
+    struct param param_model;
+    set_param_defaults(&param_model);
+    if( isModelBin(filename) ) {
+        struct bin_model *bm = openModelBin(filename, &param_model);
+        closeModelBin(bm);
+    } else {
+        FILE *fid = fopen(filename,"r");
+        if(fid == NULL) {
+            fprintf(stderr,"Can't read model file %s\n",filename);
+            exit(1);
+        }
+        NDAT line_no = 0;
+        readSolverInfo(fid, &param_model, &line_no);
+        fclose(fid);
+    }
+    param->structure = param_model.structure;
+    param->nK = param_model.nK;
+    param->nG = param_model.nG;
+    param->nS = param_model.nS;
+    param->nO = param_model.nO;
+    param->nZ = param_model.nZ;
+    destroy_input_data(&param_model);
+    if(param->voc_group == NULL) param->voc_group = newVocab();
+    if(param->voc_skill == NULL) param->voc_skill = newVocab();
+    if(param->voc_step == NULL) param->voc_step = newVocab();
+    // starting parameters and their boundaries for any nS, nO, they are replaced by those of the model
+    NPAR nS = param->nS, nO = param->nO;
+    free(param->init_params);
+    free(param->param_lo);
+    free(param->param_hi);
+    param->init_params = Calloc(NUMBER, (size_t)( (nS-1) + nS*(nS-1) + nS*(nO-1) ) );
+    param->param_lo = Calloc(NUMBER, (size_t)( nS*(1+nS+nO) ) );
+    param->param_hi = Calloc(NUMBER, (size_t)( nS*(1+nS+nO) ) );
+    for(int j=0; j<( nS*(1+nS+nO) ); j++)
+        param->param_hi[j] = (NUMBER)1.0;
+    param->do_not_check_constraints = 1;
+    
+    HMMProblem *hmm = new HMMProblem(param);
+    hmm->readModel(filename, true);
+    return hmm;
+}
+
+bool HMMProblem::isModelBin(const char *filename) {
+	FILE *fid = fopen(filename,"rb");
+	if(fid == NULL)
+        return false;
+    char magic[4];
+    bool bin = fread(magic, 1, 4, fid)==4 && memcmp(magic, BIN_MODEL_MAGIC, 4)==0;
+    fclose(fid);
+    return bin;
+}
+
+// pointer to a section of the mapped file, if its size is as expected
+static void* modelSection(char *base, const struct bin_model_header *h, int s, size_t count, size_t size, bool *ok) {
+    if( h->section[s][1] != (unsigned long long)count*size ) {
+        *ok = false;
+        return NULL;
+    }
+    return base + h->section[s][0];
+}
+
+struct bin_model* HMMProblem::openModelBin(const char *filename, struct param* param) {
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr,"Can't read model file %s\n",filename);
+		exit(1);
+	}
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = (size_t)st.st_size;
+    char *base = (size >= sizeof(struct bin_model_header))?(char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0):(char*)MAP_FAILED;
+    close(fd);
+    if(base == MAP_FAILED) {
+		fprintf(stderr,"Can't read model file %s\n",filename);
+		exit(1);
+    }
+    madvise(base, size, MADV_RANDOM); // rows are read as their labels are looked up
+    struct bin_model *bm = Calloc(struct bin_model, 1);
+    bm->base = base;
+    bm->size = size;
+    memcpy(&bm->h, base, sizeof(struct bin_model_header));
+    struct bin_model_header h = bm->h;
+    h.checksum = 0;
+    bool ok = memcmp(h.magic, BIN_MODEL_MAGIC, 4)==0 && hashString((const char*)&h, sizeof(struct bin_model_header)) == bm->h.checksum;
+    for(int s=0; s<BMS_NUM && ok; s++)
+        ok = h.section[s][0]%BIN_MODEL_ALIGN==0 && h.section[s][0] + h.section[s][1] <= (unsigned long long)size;
+    ok = ok && h.nS > 0 && h.nO > 0 && h.nX >= 0;
+    if(!ok) {
+		fprintf(stderr,"Header of model file %s is damaged\n",filename);
+		exit(1);
+    }
+    if(h.version > bin_model_file_version || h.size_t_size != (char)sizeof(size_t) || h.number_size != (char)sizeof(NUMBER)) {
+		fprintf(stderr,"Model file %s was written by a different version or on a different platform\n",filename);
+		exit(1);
+    }
+    size_t row = (size_t)(h.nS + h.nS*h.nS + h.nS*h.nO);
+    bm->null_obs_ratio = (NUMBER*)modelSection(base, &h, BMS_NULL_RATIO, (size_t)h.nO, sizeof(NUMBER), &ok);
+    bm->params = (NUMBER*)modelSection(base, &h, BMS_PARAMS, row*(size_t)h.nX, sizeof(NUMBER), &ok);
+    char *arena = (char*)modelSection(base, &h, BMS_VOC_ARENA, (size_t)h.section[BMS_VOC_ARENA][1], 1, &ok);
+    size_t *offset = (size_t*)modelSection(base, &h, BMS_VOC_OFFSET, (size_t)h.nX+1, sizeof(size_t), &ok);
+    unsigned int *hash = (unsigned int*)modelSection(base, &h, BMS_VOC_HASH, (size_t)h.nX, sizeof(unsigned int), &ok);
+    NCAT *table = (NCAT*)modelSection(base, &h, BMS_VOC_TABLE, (size_t)h.voc_mask+1, sizeof(NCAT), &ok);
+    if(!ok) {
+		fprintf(stderr,"Sections of model file %s do not match its header\n",filename);
+		exit(1);
+    }
+    bm->labels = mapVocab(h.nX, arena, (size_t)h.section[BMS_VOC_ARENA][1], offset, hash, table, h.voc_mask);
+    // solver info, as readSolverInfo
+    param->structure = h.structure;
+    param->solver = h.solver;
+    param->solver_setting = h.solver_setting;
+    param->nK = h.nK;
+    param->nG = h.nG;
+    param->nS = h.nS;
+    param->nO = h.nO;
+    param->nZ = h.nZ;
+    return bm;
+}
+
+void HMMProblem::closeModelBin(struct bin_model *bm) {
+    freeVocab(bm->labels);
+    munmap(bm->base, bm->size);
+    free(bm);
+}
+
+void HMMProblem::readModelBin(struct bin_model *bm, bool overwrite) {
+    NPAR nS = this->p->nS, nO = MIN(this->p->nO, bm->h.nO), bnS = bm->h.nS, bnO = bm->h.nO;
+    if(bnS != nS) {
+		fprintf(stderr,"Model has %d states, %d expected\n",bnS,nS);
+		exit(1);
+    }
+    size_t row = (size_t)(bnS + bnS*bnS + bnS*bnO);
+    this->null_skill_obs = 0;
+    this->null_skill_obs_prob = 0;
+	for(NPAR m=0; m<nO; m++) {
+        this->null_obs_ratio[m] = bm->null_obs_ratio[m];
+        if( this->null_obs_ratio[m] > this->null_skill_obs_prob ) {
+            this->null_skill_obs_prob = this->null_obs_ratio[m];
+            this->null_skill_obs = m;
+        }
+	}
+    struct vocab **labels = (this->p->structure==STRUCTURE_GROUP)?&this->p->voc_group:&this->p->voc_skill;
+    NCAT nX = (*labels)->n;
+    if(overwrite) { // labels of the model become those of this->p
+        if(this->p->voc_group != NULL) freeVocab(this->p->voc_group);
+        if(this->p->voc_skill != NULL) freeVocab(this->p->voc_skill);
+        this->p->voc_group = newVocab();
+        this->p->voc_skill = newVocab();
+        nX = MIN(bm->h.nX, this->sizes[0]);
+        for(NCAT x=0; x<nX; x++)
+            addVocab(*labels, vocabString(bm->labels, x), vocabLength(bm->labels, x));
+    }
+    // labels are looked up in the model, pages of the rows that are not needed are not read
+    #pragma omp parallel for schedule(dynamic, 1024) if(this->p->parallel!=0 && !overwrite)
+    for(NCAT x=0; x<nX; x++) {
+        NCAT y = overwrite?x:findVocab(bm->labels, vocabString(*labels, x), vocabLength(*labels, x));
+        if(y < 0) continue; // not in the model
+        const NUMBER *r = &bm->params[row*(size_t)y];
+        for(NPAR i=0; i<nS; i++)
+            this->pi[x][i] = r[i];
+        for(NPAR i=0; i<nS; i++)
+            for(NPAR j=0; j<nS; j++)
+                this->A[x][i][j] = r[bnS + i*bnS + j];
+        for(NPAR i=0; i<nS; i++)
+            for(NPAR m=0; m<nO; m++)
+                this->B[x][i][m] = r[bnS + bnS*bnS + i*bnO + m];
+    }
+}
@@ -35,6 +35,70 @@
 #ifndef _HMMPROBLEM_H
 #define _HMMPROBLEM_H
 
+#define FB_LANES 8 // number of sequences stepped together by the fixed nS, nO alpha and beta kernels
+#define FB_CHUNKS_PER_THREAD 4 // chunks of sequences per thread for sequence-level parallelism (see FitBit::makeChunks)
+#define FB_CHUNK_ROWS 4096 // rows per chunk of sequences for reproducible results (-R 1), whatever the number of threads
+
+#define bin_model_file_version 1
+#define BIN_MODEL_MAGIC "BKTM" // first bytes of a binary model file, text model files start with "SolverId"
+#define BIN_MODEL_ALIGN 64 // alignment of sections in the binary model file
+
+// sections of the binary model file
+enum BIN_MODEL_SECTION {
+    BMS_NULL_RATIO,                                 // null_obs_ratio, nO
+    BMS_PARAMS,                                     // PI, A, B of a skill or group back to back (nS + nS*nS + nS*nO), nX of them
+    BMS_VOC_ARENA, BMS_VOC_OFFSET, BMS_VOC_HASH, BMS_VOC_TABLE, // labels of the skills or groups with their hash table
+    BMS_NUM
+};
+
+// header of the binary model file, the file is mapped into memory and only the rows of labels looked up are read
+struct bin_model_header {
+    char magic[4];         // BIN_MODEL_MAGIC
+    char version;
+    char size_t_size;      // sizeof(size_t) of the writer, label offsets are size_t
+    char number_size;      // sizeof(NUMBER) of the writer
+    NPAR structure, solver, solver_setting, nS, nO, nZ;
+    NCAT nK, nG;
+    NCAT nX;               // rows of parameters: nK if by skill, nG if by group
+    unsigned int voc_mask; // hash table mask of the labels
+    unsigned int checksum; // FNV-1a of the header with this set to 0
+    unsigned long long section[BMS_NUM][2]; // offset from the start of the file and size, in bytes
+};
+
+// binary model file mapped into memory
+struct bin_model {
+    char *base;
+    size_t size;
+    struct bin_model_header h;
+    NUMBER *null_obs_ratio;
+    NUMBER *params;
+    struct vocab *labels;  // over the mapped hash table
+};
+
+class HMMProblem;
+
+// rows to predict, shared by the threads predicting separate students
+struct predict_data {
+    NPAR *dat_obs;
+    NCAT *dat_group;
+    NCAT *dat_skill;
+    NCAT *dat_skill_stacked;
+    NCAT *dat_skill_rcount;
+    NDAT *dat_skill_rix;
+    HMMProblem **hmms;
+    NPAR nhmms;
+    NPAR *hmm_idx;
+    struct state_store *states; // running p(L) of student-skill pairs
+    FILE *fid; // predictions are written out as they are made, if not NULL, otherwise
+    NUMBER *dat_predict; // nO per row
+    NUMBER *dat_state; // p(L) of the row's skill(s), by row (or stacked row if multiskill)
+};
+
+// running sums of the prediction metrics
+struct predict_metrics {
+    NUMBER ll, ll_no_null, rmse, rmse_no_null, accuracy, accuracy_no_null;
+};
+
 class HMMProblem {
 public:
 	HMMProblem();
@@ -56,6 +120,8 @@ public:
     virtual NUMBER getPI(struct data* dt, NPAR i);
     virtual NUMBER getA (struct data* dt, NPAR i, NPAR j);
     virtual NUMBER getB (struct data* dt, NPAR i, NPAR m);
+    // skill or group rows of parameters for a sequence, used by the kernels instead of the getters above
+    void getParamRows(struct data* dt, NUMBER* &a_PI, NUMBER** &a_A, NUMBER** &a_B);
     // getters for computing gradients of alpha, beta, gamma
     virtual void setGradPI(FitBit *fb);
     virtual void setGradA (FitBit *fb);
@@ -69,10 +135,18 @@ public:
     // fitting (the only public method)
     virtual void fit(); // return -LL for the model
     // predicting
-	virtual void producePCorrect(NUMBER*** group_skill_map, NUMBER* local_pred, NCAT* ks, NCAT nks, struct data* dt);
-    static void predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, NCAT *dat_skill_stacked, NCAT *dat_skill_rcount, NDAT *dat_skill_rix, HMMProblem **hmms, NPAR nhmms, NPAR *hmm_idx);
+	virtual void producePCorrect(NUMBER** pL, NUMBER* local_pred, NCAT* ks, NCAT nks, struct data* dt); // pL[l] - p(L) of skill ks[l]
+    // predictions are written to filename, or if it is NULL, kept in dat_predict (nO per row) and dat_state (p(L) of the skills, by row or stacked row);
+    // p(L) of student-skill pairs start from states if it is not NULL (pairs that are set there), and are left in it
+    static void predict(NUMBER* metrics, const char *filename, NPAR* dat_obs, NCAT *dat_group, NCAT *dat_skill, NCAT *dat_skill_stacked, NCAT *dat_skill_rcount, NDAT *dat_skill_rix, HMMProblem **hmms, NPAR nhmms, NPAR *hmm_idx, NUMBER *dat_predict, NUMBER *dat_state, struct state_store *states);
+    static void predictRow(struct predict_data *pd, NDAT t, struct data *dt, NUMBER *local_pred, NUMBER *pLe, NUMBER **pL, struct predict_metrics *pm); // predict row t and update p(L) of its student
     void readModel(const char *filename, bool overwrite);
     virtual void readModelBody(FILE *fid, struct param* param, NDAT *line_no, bool overwrite);
+    static bool isModelBin(const char *filename); // whether the model file is binary
+    static struct bin_model* openModelBin(const char *filename, struct param* param); // map a binary model file, read its solver info into param
+    static void closeModelBin(struct bin_model *bm);
+    void readModelBin(struct bin_model *bm, bool overwrite); // rows of the labels in this->p, or all rows and their labels if overwrite
+    static HMMProblem* loadModel(const char *filename, struct param* param); // the whole model and its labels, sizes from the file, without data
 protected:
 	//
 	// Givens
@@ -94,17 +168,39 @@ protected:
 	NUMBER** ubB; // upper boundary observation matrix
 	bool non01constraints; // whether there are lower or upper boundaries different from 0,1 respectively
 	struct param *p; // data and params
+    NPAR dynamic_params; // 1 - a subclass computes parameters in getPI/getA/getB, kernels have to call them (slower)
 	//
 	// Derived
 	//
 	virtual void init(struct param *param); // non-fit specific initialization
 	virtual void destroy(); // non-fit specific descruction
+	void bindFitWorkspace(FitBit *fb); // give alpha, beta, c of fb's sequences memory, before fitting fb
 	void initAlpha(NCAT xndat, struct data** x_data); // generic
-	void initXiGamma(NCAT xndat, struct data** x_data); // generic
 	void initBeta(NCAT xndat, struct data** x_data); // generic
-	NDAT computeAlphaAndPOParam(NCAT xndat, struct data** x_data);
-	void computeBeta(NCAT xndat, struct data** x_data);
-	void computeXiGamma(NCAT xndat, struct data** x_data);
+    // generic kernels over a per-sequence parameter view: ParamRows, or ParamGetters if dynamic_params
+    template<class V> NDAT computeAlphaAndPOParamView(FitBit *fb);
+    template<class V> void computeBetaView(FitBit *fb);
+    template<class V> NDAT computeAlphaAndPOParamSeq(struct data* dt); // one sequence
+    template<class V> void computeBetaSeq(struct data* dt); // one sequence
+    // sums over sequences: one sequence is added to acc, see accumulateChunks
+    typedef NDAT (HMMProblem::*SeqAccumulate)(FitBit *fb, struct data* dt, struct accumulator *acc);
+    NDAT accumulateChunks(FitBit *fb, SeqAccumulate f, struct accumulator *target); // serially, or chunks in parallel with fb->acc
+    template<class V> NDAT accumulateBaumWelchSeq(FitBit *fb, struct data* dt, struct accumulator *acc);
+    template<class V> NDAT setGradPISeq(FitBit *fb, struct data* dt, struct accumulator *acc);
+    template<class V> NDAT setGradASeq(FitBit *fb, struct data* dt, struct accumulator *acc);
+    template<class V> NDAT setGradBSeq(FitBit *fb, struct data* dt, struct accumulator *acc);
+	NPAR fitKernel(FitBit *fb); // fb->kernel if its sequences share a row of parameters, otherwise FBK_GENERIC
+	NDAT computeAlphaAndPOParam(FitBit *fb); // dispatch to fitKernel(fb)
+	void computeBeta(FitBit *fb); // dispatch to fitKernel(fb)
+	// backward pass that adds xi and gamma to Baum-Welch counts as beta is computed, nothing is stored per time slice
+	void accumulateBaumWelch(FitBit *fb, NUMBER *b_PI, NUMBER **b_A_num, NUMBER **b_B_num, NUMBER *b_den);
+    // kernels specialized for fixed nS, nO, parameters are kept in local arrays;
+    // alpha and beta step FB_LANES sequences of similar length at once (see fb->x_order)
+    template<int nS, int nO> void getFixedParams(struct data* dt, NUMBER *a_PI, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]);
+    template<int nS, int nO> NDAT computeAlphaAndPOParamFixed(FitBit *fb);
+    template<int nS, int nO> void computeBetaFixed(FitBit *fb);
+    template<int nS, int nO> NDAT computeAlphaAndPOParamLanes(FitBit *fb, NCAT x0, NCAT x1, NUMBER *a_PI, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]); // FB_LANES sequences from x_order[x0], before x_order[x1]
+    template<int nS, int nO> void computeBetaLanes(FitBit *fb, NCAT x0, NCAT x1, NUMBER (*a_A)[nS], NUMBER (*a_B)[nO]); // FB_LANES sequences from x_order[x0], before x_order[x1]
     void FitNullSkill(NUMBER* loglik_rmse, bool keep_SE); // get loglik and RMSE
     // helpers
     void init3Params(NUMBER* &pi, NUMBER** &A, NUMBER** &B, NPAR nS, NPAR nO);
@@ -123,12 +219,42 @@ protected:
     NUMBER doBarzilaiBorweinStep(FitBit *fb);
     virtual NUMBER GradientDescent(); // return -LL for the model
     NUMBER BaumWelch(); // return -LL for the model
+    NUMBER GradientDescentX(NCAT x, NCAT nchunk); // fit skill or group x, return its -LL if converged
+    NUMBER BaumWelchX(NCAT k, NCAT nchunk); // fit skill k, return its -LL if converged
+    void getFitSchedule(NCAT nX, NCAT *x_numx, struct data ***x_x_data, NCAT *order, NCAT *nchunk); // for -P 1
+    void chunkFitBit(FitBit *fb, NCAT nchunk); // after bindFitWorkspace
     void readNullObsRatio(FILE *fid, struct param* param, NDAT *line_no);
 	bool checkPIABConstraints(NUMBER* a_PI, NUMBER** a_A, NUMBER** a_B); // all constraints, inc row sums
 private:
     // write model
 	void toFileSkill(const char *filename);
 	void toFileGroup(const char *filename);
+	void toFileBin(const char *filename);
+};
+
+// parameters of one sequence, skill or group rows are resolved once
+class ParamRows {
+public:
+    ParamRows(HMMProblem *hmm, struct data* dt) { hmm->getParamRows(dt, PI, A, B); }
+    inline NUMBER pi(NPAR i) const { return PI[i]; }
+    inline NUMBER a(NPAR i, NPAR j) const { return A[i][j]; }
+    inline NUMBER b(NPAR i, NPAR m) const { return (m<0)?1:B[i][m]; } // unknown observation does not change alpha or beta
+private:
+    NUMBER *PI;
+    NUMBER **A;
+    NUMBER **B;
+};
+
+// parameters of one sequence via the virtual getters, for subclasses with dynamic_params
+class ParamGetters {
+public:
+    ParamGetters(HMMProblem *a_hmm, struct data* a_dt) : hmm(a_hmm), dt(a_dt) {}
+    inline NUMBER pi(NPAR i) const { return hmm->getPI(dt,i); }
+    inline NUMBER a(NPAR i, NPAR j) const { return hmm->getA(dt,i,j); }
+    inline NUMBER b(NPAR i, NPAR m) const { return hmm->getB(dt,i,m); }
+private:
+    HMMProblem *hmm;
+    struct data *dt;
 };
 
 #endif
\ No newline at end of file
@@ -30,7 +30,16 @@
 #include "InputUtil.h"
 #include "utils.h"
 #include <stdio.h>
-#include <map>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <zlib.h>
 #include <list>
 
 #include <fstream>
@@ -39,288 +48,591 @@
 #include <iostream>
 
 
-static int max_line_length;
-static char * line;
-
-static char* readline(FILE *fid) {
-	int length = 0;
-	
-	if(fgets(line,max_line_length,fid) == NULL)
-		return NULL;
-	
-	while(strrchr(line,'\n') == NULL && strrchr(line,'\r') == NULL) // do take both line endings
-	{
-		max_line_length *= 2;
-		line = (char *) realloc(line, (size_t)max_line_length);
-		length = (int) strlen(line);
-		if(fgets(line+length,max_line_length-length,fid) == NULL)
-			break;
-	}
-	return line;
-}
-
-void InputUtil::writeString(FILE *f, string str) {
-    // Create char pointer from string.
-    char* text = const_cast<char*>(str.c_str());
-    // Find the length of the string.
-    NDAT size = (NDAT)str.size();
-    // Write the string's size to the file.
-    fwrite(&size, sizeof(NDAT), 1, f);
-    // Followed by the string itself.
-    fwrite(text, 1, (size_t)size, f);
-}
-
-string InputUtil::readString(FILE *f) {
-    // Create new string object to store the retrieved text and to return to the calling function.
-    string str;
-    // UInt for storing the string's size.
-    NDAT size;
-    // Read the size of the string from the file and store it in size.
-    fread(&size, sizeof(NDAT), 1, f);
-    // Create a char pointer for temporary storage.
-    char* text = new char[size];
-    // Read [size] number of characters from the string and store them in text.
-    fread(text, 1, (size_t)size, f);
-    // Store the contents of text in str.
-    str = text;
-    // Resize str to match the size else we get extra cruft (line endings methinks).
-    str.resize((size_t)size);
-    // Finally, return the string to the calling function.
-    delete[] text;
-    return str;
+// strings of a vocabulary in the order of ids, each as its length (NDAT) followed by its bytes
+void InputUtil::writeVocab(FILE *f, struct vocab *v) {
+    for(NCAT i=0; i<v->n; i++) {
+        NDAT size = (NDAT)vocabLength(v, i);
+        fwrite(&size, sizeof(NDAT), 1, f);
+        fwrite(vocabString(v, i), 1, (size_t)size, f);
+    }
 }
 
-bool InputUtil::readTxt(const char *fn, struct param * param) {
-	FILE *fid = fopen(fn,"r");
-    if( fid == NULL) {
-        fprintf(stderr,"Could not read input file (%s).\n",fn);
-        return false;
+bool InputUtil::readVocab(FILE *f, NCAT n, struct vocab *v) {
+    NDAT size, cap = 256;
+    char *text = Malloc(char, (size_t)cap);
+    for(NCAT i=0; i<n; i++) {
+        if( fread(&size, sizeof(NDAT), 1, f) != 1 || size < 0 ) {
+            free(text);
+            return false;
+        }
+        if( size > cap ) {
+            cap = size;
+            text = (char*)realloc(text, (size_t)cap);
+        }
+        if( fread(text, 1, (size_t)size, f) != (size_t)size ) {
+            free(text);
+            return false;
+        }
+        addVocab(v, text, (size_t)size);
     }
-    
-	int number_columns = 0;
-	max_line_length = 1024;
-	char *col;
-    
-	// count lines and check for number of columns
-	line = (char *)malloc((size_t)max_line_length);// Malloc(char,max_line_length);
-	
-	// grab memory and read all data
-	StripedArray<NPAR> *striped_dat_obs = new StripedArray<NPAR>();
-	StripedArray<NCAT> *striped_dat_group = new StripedArray<NCAT>();
-    StripedArray<NCAT> *striped_dat_skill = NULL;
-    StripedArray<NCAT> *striped_dat_skill_stacked = NULL;
-    StripedArray<NCAT> *striped_dat_skill_rcount  = NULL;
-    StripedArray<NCAT> *striped_dat_skill_rix     = NULL;
-    NDAT current_stacked = 0;
-    if(param->multiskill==0)
-        striped_dat_skill = new StripedArray<NCAT>();
-    else {
-        striped_dat_skill_stacked = new StripedArray<NCAT>();
-        striped_dat_skill_rcount  = new StripedArray<NCAT>();
-        striped_dat_skill_rix     = new StripedArray<NCAT>();
-    }
-	StripedArray<NCAT> * striped_dat_item = new StripedArray<NCAT>();
-
-    param->map_group_fwd = new map<string,NCAT>();
-    param->map_group_bwd = new map<NCAT,string>();
-    param->map_skill_fwd = new map<string,NCAT>();
-    param->map_skill_bwd = new map<NCAT,string>();
-    param->map_step_fwd = new map<string,NCAT>();
-    param->map_step_bwd = new map<NCAT,string>();
-	string s_group, s_step, s_skill;
-	map<string,NCAT>::iterator it;
-	map<string,NCAT>::iterator it2;
-	bool wrong_no_columns = false;
+    free(text);
+    return true;
+}
+
+//
+// parallel text reader: the file is mapped into memory and split into chunks of whole lines, threads parse chunks
+// into the row arrays with chunk-local dictionaries (pointers into the text), which are then merged into the
+// vocabularies in the order of chunks, so ids are the same as if the file was read line by line
+//
+
+// strings of a chunk to local ids, in order of first occurrence, open addressing
+struct txt_dict {
+    NCAT n, cap;
+    const char **str;
+    int *len;
+    NCAT *table; // local id + 1, 0 - empty
+    NCAT mask;
+};
+
+static void txtDictInit(struct txt_dict *d) {
+    d->n = 0;
+    d->cap = 256;
+    d->str = Malloc(const char*, (size_t)d->cap);
+    d->len = Malloc(int, (size_t)d->cap);
+    d->mask = 2*d->cap - 1;
+    d->table = Calloc(NCAT, (size_t)d->mask + 1);
+}
+
+static void txtDictFree(struct txt_dict *d) {
+    free(d->str);
+    free(d->len);
+    free(d->table);
+}
+
+static inline NCAT txtDictHash(const char *s, int len, NCAT mask) {
+    return (NCAT)(hashString(s, (size_t)len) & (unsigned int)mask);
+}
+
+static NCAT txtDictId(struct txt_dict *d, const char *s, int len) {
+    NCAT h = txtDictHash(s, len, d->mask), ix;
+    while( (ix = d->table[h]) != 0 ) {
+        if( d->len[ix-1]==len && memcmp(d->str[ix-1], s, (size_t)len)==0 )
+            return ix-1;
+        h = (h + 1) & d->mask;
+    }
+    if( d->n == d->cap ) { // grow and rehash
+        d->cap *= 2;
+        d->str = (const char**)realloc(d->str, sizeof(const char*)*(size_t)d->cap);
+        d->len = (int*)realloc(d->len, sizeof(int)*(size_t)d->cap);
+        free(d->table);
+        d->mask = 2*d->cap - 1;
+        d->table = Calloc(NCAT, (size_t)d->mask + 1);
+        for(ix=0; ix<d->n; ix++) {
+            h = txtDictHash(d->str[ix], d->len[ix], d->mask);
+            while( d->table[h] != 0 )
+                h = (h + 1) & d->mask;
+            d->table[h] = ix + 1;
+        }
+        h = txtDictHash(s, len, d->mask);
+        while( d->table[h] != 0 )
+            h = (h + 1) & d->mask;
+    }
+    ix = d->n++;
+    d->str[ix] = s;
+    d->len[ix] = len;
+    d->table[h] = ix + 1;
+    return ix;
+}
+
+// lines of the text parsed by one thread
+struct txt_chunk {
+    const char *begin, *end;
+    NDAT row0, nrow;   // first row and number of rows (lines)
+    NDAT nstacked;     // stacked skills (multiskill), or null skill rows (single skill), as Nstacked counts them
+    NDAT stacked0;     // first stacked skill
+    NDAT n_null;
+    StripedArray<NCAT> *stacked; // local ids of stacked skills (multiskill), merged in order of chunks
+    int max_obs;
+    struct txt_dict group, item, skill;
+    int error;         // 0 - none, 1 - wrong number of columns, 2 - too many observations
+    NDAT error_row;    // local row of the error
+    int error_columns;
+};
+
+// next token, delimited like strtok does with "\t\n\r" (or other delimiters), NULL if none
+static inline const char* txtToken(const char *p, const char *e, const char **tend, char d1, char d2, char d3) {
+    while(p<e && (*p==d1 || *p==d2 || *p==d3)) p++;
+    if(p==e) return NULL;
+    const char *t = p;
+    while(p<e && *p!=d1 && *p!=d2 && *p!=d3) p++;
+    *tend = p;
+    return t;
+}
+
+static inline int txtAtoi(const char *p, const char *e) { // as atoi
+    while(p<e && isspace((unsigned char)*p)) p++;
+    int sign = 1;
+    if(p<e && (*p=='-' || *p=='+')) {
+        if(*p=='-') sign = -1;
+        p++;
+    }
+    long long v = 0;
+    while(p<e && *p>='0' && *p<='9' && v<=INT_MAX) {
+        v = v*10 + (*p - '0');
+        p++;
+    }
+    return (int)(sign*v);
+}
+
+static void txtParseChunk(struct txt_chunk *ch, struct param *param) {
+    const char *p = ch->begin, *e = ch->end, *le, *t, *te;
+    NDAT r = ch->row0;
+    NDAT stacked = 0; // local stacked index
+    for(NDAT l=0; l<ch->nrow; l++, r++) {
+        le = (const char*)memchr(p, '\n', (size_t)(e-p));
+        if(le == NULL) le = e;
+        ch->error_columns = 0;
+        // Observation
+        if( (t = txtToken(p, le, &te, '\t', '\n', '\r')) == NULL ) { ch->error = 1; ch->error_row = l; return; }
+        ch->error_columns++;
+        NPAR obs = (NPAR)(txtAtoi(t, te)-1);
+        if(obs==NPAR_MAX) { ch->error = 2; ch->error_row = l; return; }
+        param->dat_obs[r] = obs;
+        if( obs > ch->max_obs ) ch->max_obs = obs;
+        // Group
+        if( (t = txtToken(te, le, &te, '\t', '\n', '\r')) == NULL ) { ch->error = 1; ch->error_row = l; return; }
+        ch->error_columns++;
+        param->dat_group[r] = txtDictId(&ch->group, t, (int)(te-t));
+        // Step
+        if( (t = txtToken(te, le, &te, '\t', '\n', '\r')) == NULL ) { ch->error = 1; ch->error_row = l; return; }
+        ch->error_columns++;
+        param->dat_item[r] = txtDictId(&ch->item, t, (int)(te-t));
+        // Skill
+        if( (t = txtToken(te, le, &te, '\t', '\n', '\r')) == NULL ) { ch->error = 1; ch->error_row = l; return; }
+        ch->error_columns++;
+        if( te-t==1 && (t[0]=='.' || t[0]==' ') ) { // null skill
+            ch->n_null++;
+            ch->nstacked++;
+            if(param->multiskill == 0)
+                param->dat_skill[r] = -1;
+            else {
+                param->dat_skill_rcount[r] = 1;
+                param->dat_skill_rix[r] = stacked++; // local for now
+                ch->stacked->add(-1);
+            }
+        } else if(param->multiskill != 0) {
+            const char *s = t, *se = te, *k, *ke;
+            NCAT skill_count = 0;
+            param->dat_skill_rix[r] = stacked; // local for now
+            while( (k = txtToken(s, se, &ke, '~', '\n', '\r')) != NULL ) {
+                ch->stacked->add( txtDictId(&ch->skill, k, (int)(ke-k)) );
+                stacked++;
+                skill_count++;
+                s = ke;
+            }
+            ch->nstacked += skill_count;
+            param->dat_skill_rcount[r] = skill_count;
+        } else {
+            param->dat_skill[r] = txtDictId(&ch->skill, t, (int)(te-t));
+        }
+        p = (le<e)?le+1:e;
+    }
+}
+
+// merge local strings into a vocabulary, in order, local ids become global
+static bool txtDictMerge(struct txt_dict *d, struct vocab *v, NCAT *remap, const char *what) {
+    for(NCAT i=0; i<d->n; i++) {
+        remap[i] = addVocab(v, d->str[i], (size_t)d->len[i]);
+        if( remap[i] < 0 ) {
+            fprintf(stderr,"Number of unique %s exceeds allowed maximum of %d.\n", what, NCAT_MAX);
+            return false;
+        }
+    }
+    return true;
+}
+
+// rows parsed so far when text comes in blocks, row arrays grow as needed
+struct txt_read {
+    NDAT cap;          // rows allocated
+    NDAT stacked;      // stacked skills so far (multiskill)
+    NDAT cap_stacked;  // stacked skills allocated
+};
+
+template <typename T>
+static inline void txtGrow(T **a, NDAT cap) {
+    *a = (T*)realloc(*a, sizeof(T)*(size_t)MAX(cap,1));
+}
+
+static void txtReadBegin(struct param * param, struct txt_read *rd) {
+    param->voc_group = newVocab();
+    param->voc_skill = newVocab();
+    param->voc_step = newVocab();
     param->N = 0;
     param->Nstacked = 0;
-    NDAT Nstacked_alt = 0;
     param->N_null = 0;
-	while( readline(fid)!=NULL && !wrong_no_columns) {
-        //    while( NULL!=fgets(line,max_line_length,fid) && !wrong_no_columns) {
-		number_columns = 0;
-		// Observation
-		col = strtok(line,"\t\n\r");
-		if(col == NULL) {
-			wrong_no_columns = true;
-			break;
-		}
-		number_columns++;
-		NPAR obs = (NPAR)(atoi( col )-1);
-		if(obs==NPAR_MAX) {
+    rd->cap = 0;
+    rd->stacked = 0;
+    rd->cap_stacked = 0;
+}
+
+static void txtReadEnd(struct param * param) {
+	param->nG = param->voc_group->n;
+	param->nK = param->voc_skill->n;
+	param->nI = param->voc_step->n;
+}
+
+// parse whole lines in buf, rows are appended to the row arrays in param and strings to its vocabularies
+static bool txtReadBlock(const char *buf, size_t size, struct param * param, struct txt_read *rd) {
+    // chunks of whole lines, about 1MB or more each
+    int nchunk = (param->parallel!=0)?TXT_CHUNKS_PER_THREAD*omp_get_max_threads():1;
+    if( (size_t)nchunk > size/(1<<20)+1 ) nchunk = (int)(size/(1<<20)+1);
+    struct txt_chunk *chunks = Calloc(struct txt_chunk, (size_t)nchunk);
+    const char *p = buf, *e = buf + size;
+    for(int c=0; c<nchunk; c++) {
+        chunks[c].begin = p;
+        const char *q = (c==nchunk-1)?e:buf + size/(size_t)nchunk*(size_t)(c+1);
+        if(q < p) q = p;
+        if(q < e && q > buf && q[-1] != '\n') { // to the start of the next line
+            q = (const char*)memchr(q, '\n', (size_t)(e-q));
+            q = (q==NULL)?e:q+1;
+        }
+        chunks[c].end = q;
+        p = q;
+    }
+    // count lines, a last line need not end with a new line
+    bool par = nchunk>1;
+    #pragma omp parallel for if(par) schedule(dynamic)
+    for(int c=0; c<nchunk; c++) {
+        NDAT n = 0;
+        for(const char *q = chunks[c].begin; q < chunks[c].end; ) {
+            const char *nl = (const char*)memchr(q, '\n', (size_t)(chunks[c].end-q));
+            n++;
+            q = (nl==NULL)?chunks[c].end:nl+1;
+        }
+        chunks[c].nrow = n;
+    }
+    NDAT N = param->N;
+    for(int c=0; c<nchunk; c++) {
+        chunks[c].row0 = N;
+        N += chunks[c].nrow;
+    }
+    if( rd->cap==0 || N > rd->cap ) { // exactly the rows of the first block, geometrically afterwards
+        rd->cap = (rd->cap==0)?N:MAX(N, 2*rd->cap);
+        txtGrow(&param->dat_obs, rd->cap);
+        txtGrow(&param->dat_group, rd->cap);
+        txtGrow(&param->dat_item, rd->cap);
+        if(param->multiskill==0)
+            txtGrow(&param->dat_skill, rd->cap);
+        else {
+            txtGrow(&param->dat_skill_rcount, rd->cap);
+            txtGrow(&param->dat_skill_rix, rd->cap);
+        }
+    }
+    
+    // parse
+    #pragma omp parallel for if(par) schedule(dynamic)
+    for(int c=0; c<nchunk; c++) {
+        struct txt_chunk *ch = &chunks[c];
+        txtDictInit(&ch->group);
+        txtDictInit(&ch->item);
+        txtDictInit(&ch->skill);
+        ch->max_obs = -1;
+        if(param->multiskill != 0)
+            ch->stacked = new StripedArray<NCAT>();
+        txtParseChunk(ch, param);
+    }
+    
+    // first error in the order of lines
+    bool ok = true;
+    for(int c=0; c<nchunk && ok; c++) {
+        if(chunks[c].error==1) {
+            fprintf(stderr,"Wrong number of columns in line %u. Expected %d, found %d\n",chunks[c].row0+chunks[c].error_row+1,COLUMNS, chunks[c].error_columns);
+            ok = false;
+        } else if(chunks[c].error==2) {
 			fprintf(stderr,"Number of observtions exceeds allowed maximum of %d.\n",NPAR_MAX);
-			return false;
-		}
-		striped_dat_obs->add(obs); // dat_obs[t] = (NPAR)obs;
-		if( (obs >= 0) && ((param->nO-1) < obs) )
-			param->nO = (NPAR)(obs + 1); // obs[t] + 1;
-
-		// Group
-		col = strtok(NULL,"\t\n\r");
-		if(col == NULL) {
-			wrong_no_columns = true;
-			break;
-		}
-		number_columns++;
-		s_group = string( col );
-		it = param->map_group_fwd->find(s_group);
-		if( it==param->map_group_fwd->end() ) { // not found
-			if(param->map_group_fwd->size()==NCAT_MAX) {
-				fprintf(stderr,"Number of unique groups exceeds allowed maximum of %d.\n",NCAT_MAX);
-				return false;
-			}
-			NCAT newg = (NCAT)param->map_group_fwd->size();
-			striped_dat_group->add(newg); //[t] = param->map_group_fwd.size();
-			param->map_group_fwd->insert(pair<string,NCAT>(s_group, newg));
-			param->map_group_bwd->insert(pair<NCAT,string>(newg, s_group));
-		}
-		else
-			striped_dat_group->add(it->second); // [t] = it->second;
-		
-		
-		// Step
-		col = strtok(NULL,"\t\n\r");
-		if(col == NULL) {
-			wrong_no_columns = true;
-			break;
-		}
-		number_columns++;
-		s_step = string( col );
-		it2 = param->map_step_fwd->find(s_step);
-		if( it2==param->map_step_fwd->end() ) { // not found
-			if(param->map_step_fwd->size()==NCAT_MAX) {
-				fprintf(stderr,"Number of unique steps exceeds allowed maximum of %d.\n",NCAT_MAX);
-				return false;
-			}
-            NCAT news = (NCAT)param->map_step_fwd->size();
-			striped_dat_item->add(news); //[t] = param->map_group_fwd.size();
-			param->map_step_fwd->insert(pair<string,NCAT>(s_step, news));
-			param->map_step_bwd->insert(pair<NCAT,string>(news, s_step));
-		}
-		else
-            striped_dat_item->add(it2->second);
-		
-        
-		// Skill
-		col = strtok(NULL,"\t\n\r");
-		if(col == NULL) {
-			wrong_no_columns = true;
-			break;
-		}
-		number_columns++;
-		s_skill = string( col );
-        // process skills later
-        
-        // back to skill processing
-		if( (s_skill.empty() || ( s_skill.size()==1 && (s_skill[0]=='.' || s_skill[0]==' ') ) ) ) { // null skill
-            param->N_null++;
-            param->Nstacked++;	// increase stackd count too
-            if(param->multiskill == 0) {
-                striped_dat_skill->add(-1); // [t] = -1;
-            }
-            else {
-                NCAT* a_skills = Malloc(NCAT, 2);
-                a_skills[0] = 1; // count
-                a_skills[1] = -1; // value
-                // add whole multi-skill row
-                striped_dat_skill_rcount->add(1);
-                striped_dat_skill_rix->add(current_stacked++); // first add pointer, then increase
-                striped_dat_skill_stacked->add(-1);
+            ok = false;
+        }
+    }
+    
+    // merge vocabularies, in order of chunks
+    NCAT **remap = Calloc(NCAT*, (size_t)nchunk*3);
+    NDAT stacked = rd->stacked;
+    for(int c=0; c<nchunk && ok; c++) {
+        struct txt_chunk *ch = &chunks[c];
+        remap[3*c]   = Malloc(NCAT, (size_t)ch->group.n);
+        remap[3*c+1] = Malloc(NCAT, (size_t)ch->item.n);
+        remap[3*c+2] = Malloc(NCAT, (size_t)ch->skill.n);
+        ok = txtDictMerge(&ch->group, param->voc_group, remap[3*c],   "groups") &&
+             txtDictMerge(&ch->item,  param->voc_step,  remap[3*c+1], "steps") &&
+             txtDictMerge(&ch->skill, param->voc_skill, remap[3*c+2], "skills");
+        ch->stacked0 = stacked;
+        if(param->multiskill != 0) stacked += ch->nstacked;
+        param->Nstacked += ch->nstacked;
+        param->N_null += ch->n_null;
+        if( ch->max_obs >= 0 && (param->nO-1) < ch->max_obs )
+            param->nO = (NPAR)(ch->max_obs + 1);
+    }
+    if(ok && param->multiskill != 0 && (rd->cap_stacked==0 || stacked > rd->cap_stacked)) {
+        rd->cap_stacked = (rd->cap_stacked==0)?stacked:MAX(stacked, 2*rd->cap_stacked);
+        txtGrow(&param->dat_skill_stacked, rd->cap_stacked);
+    }
+    
+    // local ids to global, stacked skills of chunks one after another
+    if(ok) {
+        #pragma omp parallel for if(par) schedule(dynamic)
+        for(int c=0; c<nchunk; c++) {
+            struct txt_chunk *ch = &chunks[c];
+            NCAT *rg = remap[3*c], *ri = remap[3*c+1], *rk = remap[3*c+2];
+            for(NDAT r=ch->row0; r<ch->row0+ch->nrow; r++) {
+                param->dat_group[r] = rg[ param->dat_group[r] ];
+                param->dat_item[r] = ri[ param->dat_item[r] ];
+                if(param->multiskill == 0) {
+                    if(param->dat_skill[r] >= 0) param->dat_skill[r] = rk[ param->dat_skill[r] ];
+                } else
+                    param->dat_skill_rix[r] += ch->stacked0;
             }
-		} // empty skill
-		else { // non-empty skill
-            // multiskill
             if(param->multiskill != 0) {
-                list<NCAT> a_skills;//
-                char* a_kc;
-                col = &s_skill[0];//. c_str();
-                a_kc  = strtok(col, "~\n\r");
-                string s_kc;
-                // stacked
-                NDAT skill_count = 0;
-                striped_dat_skill_rix->add(current_stacked); // add stacked pointer once (but increase it with every next skill
-                while(a_kc != NULL) {
-                    s_kc = string(a_kc);
-                    // stacked
-                    skill_count++;
-                    current_stacked++;
-                    param->Nstacked++;	// increase line count
-                    // adding vvvv
-                    it = param->map_skill_fwd->find(s_kc);
-                    if( it==param->map_skill_fwd->end() ) { // not found
-                        if(param->map_skill_fwd->size()==NCAT_MAX) {
-                            fprintf(stderr,"Number of unique skills exceeds allowed maximum of %d.\n",NCAT_MAX);
-                            return false;
-                        }
-                        a_skills.insert(a_skills.end(), (NCAT)param->map_skill_fwd->size()); //dat_skill->add(param->map_skill_fwd->size());
-                        param->map_skill_fwd->insert(pair<string,NCAT>(s_kc, (NCAT)param->map_skill_fwd->size()));
-                        param->map_skill_bwd->insert(pair<NCAT,string>((NCAT)param->map_skill_bwd->size(),s_kc));
-                        // add stacked skill
-                        striped_dat_skill_stacked->add((NCAT)param->map_skill_fwd->size()-1); // -1 because after adding
-                    }
-                    else {
-                        a_skills.insert(a_skills.end(), it->second); //dat_skill->add(it->second); //[t] = it->second;
-                        // add stacked skill
-                        striped_dat_skill_stacked->add(it->second);
-                    }
-                    // adding ^^^^
-                    a_kc  = strtok(NULL,"~\n\r");
-                }
-                // add stacked count
-                striped_dat_skill_rcount->add(skill_count);
-                Nstacked_alt+=skill_count;
-                // multi skill
-            } else {
-                // single skill
-                it = param->map_skill_fwd->find(s_skill);
-                if( it==param->map_skill_fwd->end() ) { // not found
-                    if(param->map_skill_fwd->size()==NCAT_MAX) {
-                        fprintf(stderr,"Number of unique skills exceeds allowed maximum of %d.\n",NCAT_MAX);
-                        return false;
-                    }
-                    striped_dat_skill->add((NCAT)param->map_skill_fwd->size()); //[t] = param->map_skill_fwd.size();
-                    param->map_skill_fwd->insert(pair<string,NCAT>(s_skill, (NCAT)param->map_skill_fwd->size()));
-                    param->map_skill_bwd->insert(pair<NCAT,string>((NCAT)param->map_skill_bwd->size(),s_skill));
+                ch->stacked->toArray(&param->dat_skill_stacked[ch->stacked0]);
+                for(NCAT *sk = &param->dat_skill_stacked[ch->stacked0]; sk < &param->dat_skill_stacked[ch->stacked0 + ch->nstacked]; sk++)
+                    *sk = (*sk<0)?-1:rk[ *sk ];
+            }
+        }
+        param->N = N;
+        rd->stacked = stacked;
+    }
+    for(int c=0; c<nchunk; c++) {
+        txtDictFree(&chunks[c].group);
+        txtDictFree(&chunks[c].item);
+        txtDictFree(&chunks[c].skill);
+        if(chunks[c].stacked != NULL) delete chunks[c].stacked;
+        for(int i=0; i<3; i++)
+            if(remap[3*c+i] != NULL) free(remap[3*c+i]);
+    }
+    free(remap);
+    free(chunks);
+    return ok;
+}
+
+//
+// compressed text (gzip, or zstd through the zstd tool) is not decompressed to disk: a thread decompresses it
+// into a ring of buffers of whole lines, while the text of earlier buffers is parsed, as txtReadBlock does it
+//
+
+struct txt_ring {
+    gzFile in;         // gzip, or plain text (e.g. from a pipe), zlib tells them apart
+    char *buf[TXT_RING_BUFFERS];
+    size_t cap[TXT_RING_BUFFERS], size[TXT_RING_BUFFERS]; // allocated, whole lines
+    size_t tail;       // bytes of an incomplete line after the last filled buffer, copied to the start of the next one
+    int filled, parsed;// buffers, filled and given to the parser, parsed and free again
+    int done;          // 1 - end of input, 2 - decompression error
+    int quit;          // parser does not need more
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void* txtRingFill(void *arg) {
+    struct txt_ring *ring = (struct txt_ring *)arg;
+    int done = 0;
+    for(int b=0; done==0; b++) {
+        int s = b % TXT_RING_BUFFERS;
+        pthread_mutex_lock(&ring->lock);
+        while( b - ring->parsed >= TXT_RING_BUFFERS && !ring->quit )
+            pthread_cond_wait(&ring->cond, &ring->lock);
+        int quit = ring->quit;
+        pthread_mutex_unlock(&ring->lock);
+        if(quit)
+            break;
+        if(ring->buf[s] == NULL) {
+            ring->cap[s] = TXT_RING_BLOCK;
+            ring->buf[s] = Malloc(char, ring->cap[s]);
+        }
+        size_t used = 0;
+        if(ring->tail > 0) { // incomplete line of the previous buffer, not parsed there, parser does not write
+            int prev = (s + TXT_RING_BUFFERS - 1) % TXT_RING_BUFFERS;
+            if(ring->tail > ring->cap[s]) {
+                ring->cap[s] = ring->tail*2;
+                ring->buf[s] = (char*)realloc(ring->buf[s], ring->cap[s]);
+            }
+            memcpy(ring->buf[s], ring->buf[prev] + ring->size[prev], ring->tail);
+            used = ring->tail;
+        }
+        const char *nl = NULL;
+        while(done==0) {
+            while( used < ring->cap[s] ) {
+                unsigned int want = (unsigned int)MIN(ring->cap[s] - used, (size_t)1<<30);
+                int n = gzread(ring->in, ring->buf[s] + used, want);
+                if(n < 0) { done = 2; break; }
+                if(n == 0) { // end, or a truncated stream
+                    int err;
+                    gzerror(ring->in, &err);
+                    done = (err==Z_OK)?1:2;
+                    break;
                 }
-                else
-                    striped_dat_skill->add(it->second); //[t] = it->second;
-            } // single skill
-		} // non empty skill
-        
-		// count lines
-		param->N++;	// increase line count
-	}// reading loop
-	if(wrong_no_columns) {
-		fprintf(stderr,"Wrong number of columns in line %u. Expected %d, found %d\n",param->N+1,COLUMNS, number_columns);
-		free(line);
-		fclose(fid);
+                used += (size_t)n;
+            }
+            if(done!=0) break;
+            nl = (const char*)memrchr(ring->buf[s], '\n', used);
+            if(nl != NULL) break;
+            ring->cap[s] *= 2; // a line longer than the buffer
+            ring->buf[s] = (char*)realloc(ring->buf[s], ring->cap[s]);
+        }
+        if(done==0) {
+            ring->size[s] = (size_t)(nl - ring->buf[s]) + 1;
+            ring->tail = used - ring->size[s];
+        } else {
+            ring->size[s] = used;
+            ring->tail = 0;
+        }
+        pthread_mutex_lock(&ring->lock);
+        ring->filled = b + 1;
+        ring->done = done;
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+    return NULL;
+}
+
+// decompress and parse at the same time, fd is the compressed (or plain) text
+static bool txtReadStream(int fd, const char *fn, struct param * param) {
+    struct txt_ring ring;
+    memset(&ring, 0, sizeof(struct txt_ring));
+    ring.in = gzdopen(fd, "rb");
+    if(ring.in == NULL) {
+        fprintf(stderr,"Could not read input file (%s).\n",fn);
+        close(fd);
         return false;
-	}
-	param->nG = (NCAT)param->map_group_fwd->size();
-	param->nK = (NCAT)param->map_skill_fwd->size();
-	param->nI = (NCAT)param->map_step_fwd->size();
-    
-    // copy striped to lined
-    param->dat_obs = striped_dat_obs->toArray();
-  
-    delete striped_dat_obs;
-    param->dat_group = striped_dat_group->toArray();
-    delete striped_dat_group;
-    if(param->multiskill==0) {
-        param->dat_skill = striped_dat_skill->toArray();
-        delete striped_dat_skill;
-    } else {
-        param->dat_skill_stacked = striped_dat_skill_stacked->toArray();
-        param->dat_skill_rcount  = striped_dat_skill_rcount->toArray();
-        param->dat_skill_rix     = striped_dat_skill_rix->toArray();
-        delete striped_dat_skill_stacked;
-        delete striped_dat_skill_rcount;
-        delete striped_dat_skill_rix;
-    }
-    param->dat_item = striped_dat_item->toArray();
-    delete striped_dat_item;
-
-	fclose(fid);
-	free(line);
+    }
+    gzbuffer(ring.in, 1<<20);
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.cond, NULL);
+    pthread_t filler;
+    pthread_create(&filler, NULL, txtRingFill, &ring);
+    
+    struct txt_read rd;
+    txtReadBegin(param, &rd);
+    bool ok = true;
+    for(int b=0; ok; b++) {
+        pthread_mutex_lock(&ring.lock);
+        while( ring.filled <= b && ring.done == 0 )
+            pthread_cond_wait(&ring.cond, &ring.lock);
+        bool have = ring.filled > b;
+        int done = ring.done;
+        if( have && done == 2 && ring.filled == b + 1 ) // last buffer ends with the error, not parsed
+            have = false;
+        pthread_mutex_unlock(&ring.lock);
+        if(!have) {
+            if(done == 2) {
+                fprintf(stderr,"Could not decompress input file (%s).\n",fn);
+                ok = false;
+            }
+            break;
+        }
+        int s = b % TXT_RING_BUFFERS;
+        ok = txtReadBlock(ring.buf[s], ring.size[s], param, &rd);
+        pthread_mutex_lock(&ring.lock);
+        ring.parsed = b + 1;
+        if(!ok) ring.quit = 1;
+        pthread_cond_broadcast(&ring.cond);
+        pthread_mutex_unlock(&ring.lock);
+    }
+    pthread_join(filler, NULL);
+    if(ok && ring.done == 2) { // error after the last full buffer
+        fprintf(stderr,"Could not decompress input file (%s).\n",fn);
+        ok = false;
+    }
+    if(ok && rd.cap == 0) // no text, arrays as for an empty file
+        ok = txtReadBlock("", 0, param, &rd);
+    gzclose(ring.in); // closes fd
+    for(int s=0; s<TXT_RING_BUFFERS; s++)
+        if(ring.buf[s] != NULL) free(ring.buf[s]);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.cond);
+    if(ok)
+        txtReadEnd(param);
+    return ok;
+}
+
+// decompressed zstd text on a pipe from the zstd tool, -1 if it could not be started
+static int txtZstdPipe(const char *fn, pid_t *pid) {
+    int fds[2];
+    if( pipe(fds) != 0 )
+        return -1;
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&fa, fds[0]);
+    posix_spawn_file_actions_addclose(&fa, fds[1]);
+    char *argv[] = {(char*)"zstd", (char*)"-dcq", (char*)"--", (char*)fn, NULL};
+    int err = posix_spawnp(pid, "zstd", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(fds[1]);
+    if(err != 0) {
+        close(fds[0]);
+        return -1;
+    }
+    return fds[0];
+}
+
+bool InputUtil::readTxt(const char *fn, struct param * param) {
+	int fd = open(fn, O_RDONLY);
+    if( fd < 0 ) {
+        fprintf(stderr,"Could not read input file (%s).\n",fn);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = (size_t)st.st_size;
+    // compressed, or not a file (a pipe), is streamed
+    unsigned char magic[4] = {0,0,0,0};
+    if( !S_ISREG(st.st_mode) )
+        return txtReadStream(fd, fn, param);
+    if( size >= 2 && pread(fd, magic, 4, 0) >= 2 && magic[0]==0x1f && magic[1]==0x8b ) // gzip
+        return txtReadStream(fd, fn, param);
+    if( size >= 4 && magic[0]==0x28 && magic[1]==0xb5 && magic[2]==0x2f && magic[3]==0xfd ) { // zstd
+        close(fd);
+        pid_t pid;
+        int pfd = txtZstdPipe(fn, &pid);
+        if(pfd < 0) {
+            fprintf(stderr,"Could not run zstd to decompress input file (%s).\n",fn);
+            return false;
+        }
+        bool ok = txtReadStream(pfd, fn, param);
+        int status = 0;
+        if( ok ) {
+            waitpid(pid, &status, 0);
+            if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+                fprintf(stderr,"Could not decompress input file (%s).\n",fn);
+                ok = false;
+            }
+        } else { // zstd may be blocked writing to the closed pipe
+            kill(pid, SIGTERM);
+            waitpid(pid, &status, 0);
+        }
+        return ok;
+    }
+    const char *buf = NULL;
+    if(size > 0) {
+        buf = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(buf == MAP_FAILED) {
+            fprintf(stderr,"Could not map input file (%s) into memory.\n",fn);
+            close(fd);
+            return false;
+        }
+        madvise((void*)buf, size, MADV_SEQUENTIAL);
+    }
+    bool ok = readTxtBuffer(buf, size, param);
+    if(size > 0)
+        munmap((void*)buf, size);
+    close(fd);
+    return ok;
+}
+
+bool InputUtil::readTxtBuffer(const char *buf, size_t size, struct param * param) {
+    struct txt_read rd;
+    txtReadBegin(param, &rd);
+    if( !txtReadBlock(buf, size, param, &rd) )
+        return false;
+    txtReadEnd(param);
     return true;
 }
 
@@ -329,6 +641,10 @@ bool InputUtil::readBin(const char *fn, struct param * param) {
     NDAT i;
     NDAT nread;
     FILE *fid = fopen(fn,"rb");
+    if(fid == NULL) {
+        fprintf(stderr,"Could not read input file (%s).\n",fn);
+        return false;
+    }
     
     // version
     nread = (NDAT)fread (&v, sizeof(char), (size_t)1, fid);
@@ -340,6 +656,10 @@ bool InputUtil::readBin(const char *fn, struct param * param) {
         fprintf(stderr,"Wrong version of the data file. Expected %d, actual %d\n",(int)bin_input_file_verstion, (int)v);
         return false;
     }
+    if( v == 4 ) { // mapped, not read
+        fclose(fid);
+        return readBinMapped(fn, param);
+    }
     
     // N
     nread = (NDAT)fread (&i, sizeof(NDAT), (size_t)1, fid);
@@ -418,72 +738,41 @@ bool InputUtil::readBin(const char *fn, struct param * param) {
     param->multiskill = (NPAR)c;
     
     
-    // dat_obs
-    StripedArray<NPAR> *striped_dat_obs = new StripedArray<NPAR>(fid, param->N);
-    param->dat_obs = striped_dat_obs->toArray();
-    delete striped_dat_obs;
-
-        // dat_group
-        StripedArray<NCAT> *striped_dat_group = new StripedArray<NCAT>(fid, param->N);
-        param->dat_group = striped_dat_group->toArray();
-        delete striped_dat_group;
-//    }
-    
-    // dat_item
-    StripedArray<NCAT> *striped_dat_item = new StripedArray<NCAT>(fid, param->N);
-    param->dat_item = striped_dat_item->toArray();
-    delete striped_dat_item;
-    
-    // dat_skill
+    // columns, read straight into their arrays
+    param->dat_obs = StripedArray<NPAR>::binFileToArray(fid, param->N);
+    param->dat_group = StripedArray<NCAT>::binFileToArray(fid, param->N);
+    param->dat_item = StripedArray<NCAT>::binFileToArray(fid, param->N);
+    bool ok = param->dat_obs != NULL && param->dat_group != NULL && param->dat_item != NULL;
     if(param->multiskill == 0) {
-        StripedArray<NCAT> *striped_dat_skill = new StripedArray<NCAT>(fid, param->N);
-        param->dat_skill = striped_dat_skill->toArray();
-        delete striped_dat_skill;
+        param->dat_skill = StripedArray<NCAT>::binFileToArray(fid, param->N);
+        ok = ok && param->dat_skill != NULL;
     } else {
-        StripedArray<NCAT> *striped_dat_skill_stacked = new StripedArray<NCAT>(fid, param->Nstacked);
-        param->dat_skill_stacked = striped_dat_skill_stacked->toArray();
-        StripedArray<NCAT> *striped_dat_skill_rcount = new StripedArray<NCAT>(fid, param->N);
-        param->dat_skill_rcount = striped_dat_skill_rcount->toArray();
-        StripedArray<NCAT> *striped_dat_skill_rix = new StripedArray<NCAT>(fid, param->N);
-        param->dat_skill_rix = striped_dat_skill_rix->toArray();
-        delete striped_dat_skill_stacked;
-        delete striped_dat_skill_rcount;
-        delete striped_dat_skill_rix;
+        param->dat_skill_stacked = StripedArray<NCAT>::binFileToArray(fid, param->Nstacked);
+        param->dat_skill_rcount = StripedArray<NCAT>::binFileToArray(fid, param->N);
+        param->dat_skill_rix = StripedArray<NDAT>::binFileToArray(fid, param->N);
+        ok = ok && param->dat_skill_stacked != NULL && param->dat_skill_rcount != NULL && param->dat_skill_rix != NULL;
     }
     // dat_slices, only of nZ > 1
     if(param->nZ > 1) {
         NDAT szZ = (param->multiskill == 0)?param->N:param->Nstacked;
-        StripedArray<NPAR> *striped_dat_slice = new StripedArray<NPAR>(fid, szZ);
-        param->dat_slice = striped_dat_slice->toArray();
-        delete striped_dat_slice;
-    }
-        
-    string str;
-    param->map_group_fwd = new map<string,NCAT>();
-    param->map_group_bwd = new map<NCAT,string>();
-    param->map_skill_fwd = new map<string,NCAT>();
-    param->map_skill_bwd = new map<NCAT,string>();
-    param->map_step_fwd = new map<string,NCAT>();
-    param->map_step_bwd = new map<NCAT,string>();
-    // voc_group
-    for(NCAT g=0; g<param->nG; g++) {
-        str = readString(fid);
-        param->map_group_fwd->insert(pair<string,NCAT>(str, g));
-        param->map_group_bwd->insert(pair<NCAT,string>(g, str));
+        param->dat_slice = StripedArray<NPAR>::binFileToArray(fid, szZ);
+        ok = ok && param->dat_slice != NULL;
     }
-    
-    // voc_skill
-    for(NCAT k=0; k<param->nK; k++) {
-        str = readString(fid);
-        param->map_skill_fwd->insert(pair<string,NCAT>(str, k));
-        param->map_skill_bwd->insert(pair<NCAT,string>(k, str));
+    if(!ok) {
+        fprintf(stderr,"Error reading data from %s\n",fn);
+        fclose(fid);
+        return false;
     }
     
-    // voc_item
-    for(NCAT i=0; i<param->nI; i++) {
-        str = readString(fid);
-        param->map_step_fwd->insert(pair<string,NCAT>(str, i));
-        param->map_step_bwd->insert(pair<NCAT,string>(i, str));
+    // voc_group, voc_skill, voc_item
+    param->voc_group = newVocab();
+    param->voc_skill = newVocab();
+    param->voc_step = newVocab();
+    if( !readVocab(fid, param->nG, param->voc_group) || !readVocab(fid, param->nK, param->voc_skill) ||
+        !readVocab(fid, param->nI, param->voc_step) ) {
+        fprintf(stderr,"Error reading vocabularies from %s\n",fn);
+        fclose(fid);
+        return false;
     }
     
     fclose(fid);
@@ -510,15 +799,28 @@ bool InputUtil::readBin(const char *fn, struct param * param) {
  *  - voc_group : string * nG : ordered by 1:nG
  *  - voc_skill : string * nK : ordered by 1:nK
  *  - voc_item  : string * nI : ordered by 1:nI
+ *
+ * Version 4 is laid out to be mapped into memory and used in place:
+ *  - header : struct bin_header, with offsets and sizes of the sections and a checksum of itself
+ *  - sections : enum BIN_SECTION, each starts at a multiple of BIN_ALIGN bytes, arrays of NPAR, NCAT, NDAT
+ *      (and size_t, unsigned int for vocabularies) as they are in memory; besides the row arrays of version 3 it
+ *      has the sequences of skill-group pairs and of null skill rows (structure_data) in CSR form, observations
+ *      of the sequences in the order they are fit in by skill, and the vocabularies with their hash tables
  */
 
-bool InputUtil::toBin(struct param * param, const char *fn) {
+bool InputUtil::toBin(struct param * param, const char *fn, char version, bool compress) {
+    if(version >= 4)
+        return toBinMapped(param, fn, compress);
     char c;
     NDAT i;
     FILE *fid = fopen(fn,"wb");
+    if(fid == NULL) {
+        fprintf(stderr,"Can't write output file %s\n",fn);
+        return false;
+    }
 
     // version
-    c = bin_input_file_verstion;
+    c = version;
     fwrite (&c , sizeof(char), 1, fid);
     
     // N
@@ -578,23 +880,654 @@ bool InputUtil::toBin(struct param * param, const char *fn) {
         StripedArray<NPAR>::arrayToBinFile(param->dat_slice, szZ, fid);
     }
 
-    map<NCAT,string>::iterator it;
     // voc_group
-    for (it = param->map_group_bwd->begin(); it != param->map_group_bwd->end(); ++it) {
-        writeString(fid, it->second);
+    writeVocab(fid, param->voc_group);
+    // voc_skill
+    writeVocab(fid, param->voc_skill);
+    // voc_item
+    writeVocab(fid, param->voc_step);
+    
+    fclose(fid);
+    return true;
+}
+
+static inline unsigned long long binAlign(unsigned long long size) {
+    return (size + BIN_ALIGN - 1) / BIN_ALIGN * BIN_ALIGN;
+}
+
+static inline void binSet(const void **sec, struct bin_header *h, int s, const void *p, size_t size) {
+    sec[s] = p;
+    h->section[s][1] = (unsigned long long)size;
+}
+
+//
+// compressed columns: blocks of BIN_BLOCK_ROWS values are encoded separately, so they are encoded and decoded
+// in parallel; a section of a column is
+//  - codec, bits : unsigned int * 2 (bits per value of BC_BITS)
+//  - n : unsigned long long, number of values
+//  - ends of blocks : unsigned long long * ceil(n/BIN_BLOCK_ROWS), bytes from the start of the first block
+//  - blocks
+//
+
+static inline unsigned long long zigzag(long long v) {
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static inline long long unzigzag(unsigned long long u) {
+    return (long long)(u >> 1) ^ -(long long)(u & 1);
+}
+
+static inline unsigned char* putVarint(unsigned char *p, unsigned long long u) {
+    while(u >= 0x80) {
+        *p++ = (unsigned char)(u | 0x80);
+        u >>= 7;
     }
+    *p++ = (unsigned char)u;
+    return p;
+}
 
-    // voc_skill
-    for (it = param->map_skill_bwd->begin(); it != param->map_skill_bwd->end(); ++it) {
-        writeString(fid, it->second);
+static inline const unsigned char* getVarint(const unsigned char *p, const unsigned char *e, unsigned long long *u) { // NULL if e is reached
+    unsigned long long v = 0;
+    for(int shift=0; p<e && shift<64; shift+=7) {
+        unsigned char b = *p++;
+        v |= (unsigned long long)(b & 0x7F) << shift;
+        if( (b & 0x80) == 0 ) {
+            *u = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// out has room for 10 bytes per value, returns the end of the output
+template <typename T>
+static unsigned char* binEncodeBlock(const T *a, NDAT n, int codec, int bits, unsigned char *out) {
+    NDAT i, j;
+    if(codec == BC_BITS) {
+        unsigned int acc = 0;
+        int nacc = 0;
+        for(i=0; i<n; i++) {
+            acc |= (unsigned int)(a[i]+1) << nacc;
+            nacc += bits;
+            for(; nacc >= 8; nacc -= 8, acc >>= 8)
+                *out++ = (unsigned char)acc;
+        }
+        if(nacc > 0) *out++ = (unsigned char)acc;
+    } else if(codec == BC_DELTA) {
+        long long prev = 0;
+        for(i=0; i<n; i++) {
+            out = putVarint(out, zigzag((long long)a[i] - prev));
+            prev = a[i];
+        }
+    } else { // BC_RLE
+        for(i=0; i<n; i=j) {
+            for(j=i+1; j<n && a[j]==a[i]; j++);
+            out = putVarint(out, zigzag((long long)a[i]));
+            out = putVarint(out, (unsigned long long)(j-i));
+        }
+    }
+    return out;
+}
+
+template <typename T>
+static bool binDecodeBlock(const unsigned char *p, const unsigned char *e, int codec, int bits, T *a, NDAT n) {
+    NDAT i, j;
+    unsigned long long u, r;
+    if(codec == BC_BITS) {
+        if( bits < 1 || bits > 8 || (size_t)(e-p) < ((size_t)n*(size_t)bits + 7)/8 )
+            return false;
+        unsigned int acc = 0, mask = (1u << bits) - 1;
+        int nacc = 0;
+        for(i=0; i<n; i++) {
+            if(nacc < bits) {
+                acc |= (unsigned int)(*p++) << nacc;
+                nacc += 8;
+            }
+            a[i] = (T)((int)(acc & mask) - 1);
+            acc >>= bits;
+            nacc -= bits;
+        }
+    } else if(codec == BC_DELTA) {
+        long long prev = 0;
+        for(i=0; i<n; i++) {
+            if( (p = getVarint(p, e, &u)) == NULL )
+                return false;
+            prev += unzigzag(u);
+            a[i] = (T)prev;
+        }
+    } else if(codec == BC_RLE) {
+        for(i=0; i<n; ) {
+            if( (p = getVarint(p, e, &u)) == NULL || (p = getVarint(p, e, &r)) == NULL || r == 0 || r > (unsigned long long)(n-i) )
+                return false;
+            T v = (T)unzigzag(u);
+            for(j=0; j<(NDAT)r; j++)
+                a[i++] = v;
+        }
+    } else
+        return false;
+    return true;
+}
+
+// column to a section, returns it (to be freed) and its size
+template <typename T>
+static unsigned char* binEncode(const T *a, NDAT n, int codec, int bits, bool par, size_t *size) {
+    NDAT nb = (NDAT)(((long long)n + BIN_BLOCK_ROWS - 1) / BIN_BLOCK_ROWS);
+    unsigned char **blk = Calloc(unsigned char*, (size_t)nb);
+    size_t *len = Calloc(size_t, (size_t)nb);
+    #pragma omp parallel for if(par) schedule(dynamic)
+    for(NDAT b=0; b<nb; b++) {
+        NDAT nbl = MIN(BIN_BLOCK_ROWS, n - b*BIN_BLOCK_ROWS);
+        blk[b] = Malloc(unsigned char, (size_t)nbl*10);
+        len[b] = (size_t)(binEncodeBlock(&a[(size_t)b*BIN_BLOCK_ROWS], nbl, codec, bits, blk[b]) - blk[b]);
+    }
+    size_t head = 2*sizeof(unsigned int) + sizeof(unsigned long long)*(1 + (size_t)nb), total = head;
+    for(NDAT b=0; b<nb; b++)
+        total += len[b];
+    unsigned char *sec = Malloc(unsigned char, total);
+    ((unsigned int*)sec)[0] = (unsigned int)codec;
+    ((unsigned int*)sec)[1] = (unsigned int)bits;
+    ((unsigned long long*)sec)[1] = (unsigned long long)n;
+    unsigned long long *end = &((unsigned long long*)sec)[2];
+    size_t off = 0;
+    for(NDAT b=0; b<nb; b++) {
+        memcpy(sec + head + off, blk[b], len[b]);
+        off += len[b];
+        end[b] = (unsigned long long)off;
+        free(blk[b]);
+    }
+    free(blk);
+    free(len);
+    *size = total;
+    return sec;
+}
+
+// section to a new column of n values, NULL if it is not one, or is damaged
+template <typename T>
+static T* binDecode(const unsigned char *sec, size_t size, NDAT n, bool par) {
+    NDAT nb = (NDAT)(((long long)n + BIN_BLOCK_ROWS - 1) / BIN_BLOCK_ROWS);
+    size_t head = 2*sizeof(unsigned int) + sizeof(unsigned long long)*(1 + (size_t)nb);
+    if( size < head || ((const unsigned long long*)sec)[1] != (unsigned long long)n )
+        return NULL;
+    int codec = (int)((const unsigned int*)sec)[0], bits = (int)((const unsigned int*)sec)[1];
+    const unsigned long long *end = &((const unsigned long long*)sec)[2];
+    for(NDAT b=0; b<nb; b++)
+        if( end[b] > size - head || (b>0 && end[b] < end[b-1]) )
+            return NULL;
+    T *a = Malloc(T, (size_t)MAX(n,1));
+    int ok = 1;
+    #pragma omp parallel for if(par) schedule(dynamic)
+    for(NDAT b=0; b<nb; b++) {
+        const unsigned char *p = sec + head + ((b==0)?0:end[b-1]);
+        NDAT nbl = MIN(BIN_BLOCK_ROWS, n - b*BIN_BLOCK_ROWS);
+        if( !binDecodeBlock(p, sec + head + end[b], codec, bits, &a[(size_t)b*BIN_BLOCK_ROWS], nbl) ) {
+            #pragma omp atomic write
+            ok = 0;
+        }
+    }
+    if(!ok) {
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+// true if a decoded column stays below hi (and at or above lo), the data blocks carry no checksum
+template <typename T>
+static bool binInRange(const T *a, NDAT n, long long lo, long long hi) {
+    for(NDAT t=0; t<n; t++)
+        if( (long long)a[t] < lo || (long long)a[t] >= hi )
+            return false;
+    return true;
+}
+
+// codec for observations: bits if they are -1..127
+static unsigned char* binEncodeObs(const NPAR *a, NDAT n, bool par, size_t *size) {
+    int max = 0, min = 0;
+    for(NDAT t=0; t<n; t++) {
+        if(a[t] > max) max = a[t];
+        if(a[t] < min) min = a[t];
+    }
+    if(min < -1)
+        return binEncode<NPAR>(a, n, BC_DELTA, 0, par, size);
+    int bits = 1;
+    while( (1 << bits) <= max + 1 ) bits++;
+    return binEncode<NPAR>(a, n, BC_BITS, bits, par, size);
+}
+
+bool InputUtil::toBinMapped(struct param * param, const char *fn, bool compress) {
+    NDAT x, t;
+    NCAT k, g;
+    bool multi = param->multiskill != 0;
+    bool par = param->parallel != 0;
+    FILE *fid = fopen(fn,"wb");
+    if(fid == NULL) {
+        fprintf(stderr,"Can't write output file %s\n",fn);
+        return false;
     }
+    struct bin_header h;
+    memset(&h, 0, sizeof(struct bin_header));
+    h.version = 4;
+    h.multiskill = param->multiskill;
+    h.compressed = compress?1:0;
+    h.size_t_size = (char)sizeof(size_t);
+    h.N = param->N;
+    h.Nstacked = param->Nstacked;
+    h.N_null = param->N_null;
+    h.nO = param->nO;
+    h.nG = param->nG;
+    h.nI = param->nI;
+    h.nK = param->nK;
+    h.nZ = param->nZ;
+    const void *sec[BS_NUM];
+    memset(sec, 0, sizeof(sec));
+    unsigned char *enc[BS_NUM]; // encoded sections, to be freed
+    memset(enc, 0, sizeof(enc));
+    size_t N = (size_t)param->N, sz;
+    NDAT NZ = multi?param->Nstacked:param->N;
     
-    // voc_item
-    for (it =  param->map_step_bwd->begin(); it != param->map_step_bwd->end(); ++it) {
-        writeString(fid, it->second);
+    // row arrays
+    if(compress) {
+        enc[BS_OBS]   = binEncodeObs(param->dat_obs, param->N, par, &sz);
+        binSet(sec, &h, BS_OBS, enc[BS_OBS], sz);
+        enc[BS_GROUP] = binEncode<NCAT>(param->dat_group, param->N, BC_DELTA, 0, par, &sz);
+        binSet(sec, &h, BS_GROUP, enc[BS_GROUP], sz);
+        enc[BS_ITEM]  = binEncode<NCAT>(param->dat_item, param->N, BC_DELTA, 0, par, &sz);
+        binSet(sec, &h, BS_ITEM, enc[BS_ITEM], sz);
+        if(!multi) {
+            enc[BS_SKILL] = binEncode<NCAT>(param->dat_skill, param->N, BC_RLE, 0, par, &sz);
+            binSet(sec, &h, BS_SKILL, enc[BS_SKILL], sz);
+        } else {
+            enc[BS_SKILL_STACKED] = binEncode<NCAT>(param->dat_skill_stacked, param->Nstacked, BC_RLE, 0, par, &sz);
+            binSet(sec, &h, BS_SKILL_STACKED, enc[BS_SKILL_STACKED], sz);
+            enc[BS_SKILL_RCOUNT]  = binEncode<NCAT>(param->dat_skill_rcount, param->N, BC_RLE, 0, par, &sz);
+            binSet(sec, &h, BS_SKILL_RCOUNT, enc[BS_SKILL_RCOUNT], sz);
+            enc[BS_SKILL_RIX]     = binEncode<NDAT>(param->dat_skill_rix, param->N, BC_DELTA, 0, par, &sz);
+            binSet(sec, &h, BS_SKILL_RIX, enc[BS_SKILL_RIX], sz);
+        }
+        if(param->nZ > 1) {
+            enc[BS_SLICE] = binEncode<NPAR>(param->dat_slice, NZ, BC_RLE, 0, par, &sz);
+            binSet(sec, &h, BS_SLICE, enc[BS_SLICE], sz);
+        }
+    } else {
+        binSet(sec, &h, BS_OBS,   param->dat_obs,   N*sizeof(NPAR));
+        binSet(sec, &h, BS_GROUP, param->dat_group, N*sizeof(NCAT));
+        binSet(sec, &h, BS_ITEM,  param->dat_item,  N*sizeof(NCAT));
+        if(!multi)
+            binSet(sec, &h, BS_SKILL, param->dat_skill, N*sizeof(NCAT));
+        else {
+            binSet(sec, &h, BS_SKILL_STACKED, param->dat_skill_stacked, (size_t)param->Nstacked*sizeof(NCAT));
+            binSet(sec, &h, BS_SKILL_RCOUNT,  param->dat_skill_rcount,  N*sizeof(NCAT));
+            binSet(sec, &h, BS_SKILL_RIX,     param->dat_skill_rix,     N*sizeof(NDAT));
+        }
+        if(param->nZ > 1)
+            binSet(sec, &h, BS_SLICE, param->dat_slice, (size_t)NZ*sizeof(NPAR));
     }
     
+    // sequence index, not in compressed files, structure_data is quick compared to decoding
+    NDAT *seq_start = NULL, *seq_ix = NULL, *seq_ix_stacked = NULL, *k_start = NULL, *g_start = NULL, *k_seq = NULL, *g_seq = NULL;
+    NDAT *null_start = NULL, *null_ix = NULL, *null_ix_stacked = NULL;
+    NCAT *null_g = NULL;
+    NPAR *seq_obs = NULL;
+    if(!compress) {
+        h.nSeq = param->nSeq;
+        h.n_null_skill_group = param->n_null_skill_group;
+        seq_start = Malloc(NDAT, (size_t)param->nSeq + 1);
+        seq_start[0] = 0;
+        for(x=0; x<param->nSeq; x++)
+            seq_start[x+1] = seq_start[x] + param->all_data[x].n;
+        seq_ix = Malloc(NDAT, (size_t)seq_start[param->nSeq]);
+        seq_ix_stacked = multi?Malloc(NDAT, (size_t)seq_start[param->nSeq]):NULL;
+        for(x=0; x<param->nSeq; x++) {
+            memcpy(&seq_ix[ seq_start[x] ], param->all_data[x].ix, sizeof(NDAT)*(size_t)param->all_data[x].n);
+            if(multi)
+                memcpy(&seq_ix_stacked[ seq_start[x] ], param->all_data[x].ix_stacked, sizeof(NDAT)*(size_t)param->all_data[x].n);
+        }
+        k_start = Malloc(NDAT, (size_t)param->nK + 1);
+        g_start = Malloc(NDAT, (size_t)param->nG + 1);
+        k_start[0] = g_start[0] = 0;
+        for(k=0; k<param->nK; k++) k_start[k+1] = k_start[k] + param->k_numg[k];
+        for(g=0; g<param->nG; g++) g_start[g+1] = g_start[g] + param->g_numk[g];
+        k_seq = Malloc(NDAT, (size_t)param->nSeq);
+        g_seq = Malloc(NDAT, (size_t)param->nSeq);
+        seq_obs = Malloc(NPAR, (size_t)seq_start[param->nSeq]);
+        NDAT off = 0;
+        for(x=0; x<param->nSeq; x++) {
+            k_seq[x] = (NDAT)(param->k_data[x] - param->all_data);
+            g_seq[x] = (NDAT)(param->g_data[x] - param->all_data);
+            for(t=0; t<param->k_data[x]->n; t++)
+                seq_obs[off++] = param->dat_obs[ param->k_data[x]->ix[t] ];
+        }
+        NCAT n_null = param->n_null_skill_group;
+        null_g = Malloc(NCAT, (size_t)n_null);
+        null_start = Malloc(NDAT, (size_t)n_null + 1);
+        null_start[0] = 0;
+        for(g=0; g<n_null; g++) {
+            null_g[g] = param->null_skills[g].g;
+            null_start[g+1] = null_start[g] + param->null_skills[g].n;
+        }
+        null_ix = Malloc(NDAT, (size_t)null_start[n_null]);
+        null_ix_stacked = multi?Malloc(NDAT, (size_t)null_start[n_null]):NULL;
+        for(g=0; g<n_null; g++) {
+            memcpy(&null_ix[ null_start[g] ], param->null_skills[g].ix, sizeof(NDAT)*(size_t)param->null_skills[g].n);
+            if(multi)
+                memcpy(&null_ix_stacked[ null_start[g] ], param->null_skills[g].ix_stacked, sizeof(NDAT)*(size_t)param->null_skills[g].n);
+        }
+        size_t npos = (size_t)seq_start[param->nSeq], nnull = (size_t)null_start[n_null];
+        binSet(sec, &h, BS_SEQ_START, seq_start, ((size_t)param->nSeq+1)*sizeof(NDAT));
+        binSet(sec, &h, BS_SEQ_IX, seq_ix, npos*sizeof(NDAT));
+        if(multi)
+            binSet(sec, &h, BS_SEQ_IX_STACKED, seq_ix_stacked, npos*sizeof(NDAT));
+        binSet(sec, &h, BS_K_START, k_start, ((size_t)param->nK+1)*sizeof(NDAT));
+        binSet(sec, &h, BS_K_SEQ,   k_seq,   (size_t)param->nSeq*sizeof(NDAT));
+        binSet(sec, &h, BS_G_START, g_start, ((size_t)param->nG+1)*sizeof(NDAT));
+        binSet(sec, &h, BS_G_SEQ,   g_seq,   (size_t)param->nSeq*sizeof(NDAT));
+        binSet(sec, &h, BS_NULL_G,     null_g,     (size_t)n_null*sizeof(NCAT));
+        binSet(sec, &h, BS_NULL_START, null_start, ((size_t)n_null+1)*sizeof(NDAT));
+        binSet(sec, &h, BS_NULL_IX,    null_ix,    nnull*sizeof(NDAT));
+        if(multi)
+            binSet(sec, &h, BS_NULL_IX_STACKED, null_ix_stacked, nnull*sizeof(NDAT));
+        binSet(sec, &h, BS_SEQ_OBS, seq_obs, npos*sizeof(NPAR));
+    }
     
+    // vocabularies, compressed files have the strings only
+    struct vocab *voc[3] = {param->voc_group, param->voc_skill, param->voc_step};
+    for(int i=0; i<3; i++) {
+        binSet(sec, &h, BS_VOC_ARENA +4*i, voc[i]->arena,  voc[i]->size);
+        if(compress) continue;
+        h.voc_mask[i] = voc[i]->mask;
+        binSet(sec, &h, BS_VOC_OFFSET+4*i, voc[i]->offset, ((size_t)voc[i]->n+1)*sizeof(size_t));
+        binSet(sec, &h, BS_VOC_HASH  +4*i, voc[i]->hash,   (size_t)voc[i]->n*sizeof(unsigned int));
+        binSet(sec, &h, BS_VOC_TABLE +4*i, voc[i]->table,  ((size_t)voc[i]->mask+1)*sizeof(NCAT));
+    }
+    unsigned long long pos = binAlign(sizeof(struct bin_header));
+    for(int i=0; i<BS_NUM; i++) {
+        h.section[i][0] = pos;
+        pos += binAlign(h.section[i][1]);
+    }
+    h.checksum = hashString((const char*)&h, sizeof(struct bin_header));
+    
+    // write
+    char zero[BIN_ALIGN];
+    memset(zero, 0, (size_t)BIN_ALIGN);
+    fwrite(&h, sizeof(struct bin_header), 1, fid);
+    fwrite(zero, 1, (size_t)(binAlign(sizeof(struct bin_header)) - sizeof(struct bin_header)), fid);
+    for(int i=0; i<BS_NUM; i++) {
+        if(h.section[i][1] == 0) continue;
+        fwrite(sec[i], 1, (size_t)h.section[i][1], fid);
+        fwrite(zero, 1, (size_t)(binAlign(h.section[i][1]) - h.section[i][1]), fid);
+    }
+    bool ok = ferror(fid)==0;
     fclose(fid);
+    if(!ok)
+        fprintf(stderr,"Error writing output file %s\n",fn);
+    
+    for(int i=0; i<BS_NUM; i++)
+        if(enc[i] != NULL) free(enc[i]);
+    if(seq_start != NULL) free(seq_start);
+    if(seq_ix != NULL) free(seq_ix);
+    if(seq_ix_stacked != NULL) free(seq_ix_stacked);
+    if(k_start != NULL) free(k_start);
+    if(g_start != NULL) free(g_start);
+    if(k_seq != NULL) free(k_seq);
+    if(g_seq != NULL) free(g_seq);
+    if(seq_obs != NULL) free(seq_obs);
+    if(null_g != NULL) free(null_g);
+    if(null_start != NULL) free(null_start);
+    if(null_ix != NULL) free(null_ix);
+    if(null_ix_stacked != NULL) free(null_ix_stacked);
+    return ok;
+}
+
+// pointer to a section of the mapped file, if its size is as expected
+static void* binSection(char *base, const struct bin_header *h, int s, size_t count, size_t size, bool *ok) {
+    if( h->section[s][1] != (unsigned long long)count*size ) {
+        *ok = false;
+        return NULL;
+    }
+    return base + h->section[s][0];
+}
+
+// starts of a CSR index into a section of total entries: from 0, non-decreasing, up to total
+template<typename T>
+static bool binStartsValid(const T *start, NDAT n, size_t total) {
+    if( start[0] != 0 || (size_t)start[n] != total )
+        return false;
+    for(NDAT i=0; i<n; i++)
+        if( start[i] > start[i+1] )
+            return false;
+    return true;
+}
+
+bool InputUtil::readBinMapped(const char *fn, struct param * param) {
+	int fd = open(fn, O_RDONLY);
+    if( fd < 0 ) {
+        fprintf(stderr,"Could not read input file (%s).\n",fn);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = (size_t)st.st_size;
+    if(size < sizeof(struct bin_header)) {
+        fprintf(stderr,"Error reading header from %s\n",fn);
+        close(fd);
+        return false;
+    }
+    // private and writable: pages are shared with the page cache, unless written to (which fitting does not do)
+    char *base = (char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        fprintf(stderr,"Could not map input file (%s) into memory.\n",fn);
+        return false;
+    }
+    struct bin_header h;
+    memcpy(&h, base, sizeof(struct bin_header));
+    unsigned int checksum = h.checksum;
+    h.checksum = 0;
+    bool ok = hashString((const char*)&h, sizeof(struct bin_header)) == checksum;
+    for(int i=0; i<BS_NUM && ok; i++)
+        ok = h.section[i][0]%BIN_ALIGN==0 && h.section[i][0] + h.section[i][1] <= (unsigned long long)size;
+    if(!ok) {
+        fprintf(stderr,"Header of %s is damaged\n",fn);
+        munmap(base, size);
+        return false;
+    }
+    if(h.size_t_size != (char)sizeof(size_t)) {
+        fprintf(stderr,"%s was written on a platform with %d-byte size_t, expected %d\n",fn,(int)h.size_t_size,(int)sizeof(size_t));
+        munmap(base, size);
+        return false;
+    }
+    if(h.nZ<1) {
+        fprintf(stderr,"Number of slices should be at least 1\n");
+        munmap(base, size);
+        return false;
+    }
+    param->N = h.N;
+    param->Nstacked = h.Nstacked;
+    param->N_null = h.N_null;
+    param->nO = (NPAR)h.nO;
+    param->nG = h.nG;
+    param->nI = h.nI;
+    param->nK = h.nK;
+    param->nZ = (NPAR)h.nZ;
+    param->multiskill = h.multiskill;
+    param->nSeq = h.nSeq;
+    param->n_null_skill_group = h.n_null_skill_group;
+    if(h.compressed) { // decoded into memory, the file is not needed afterwards
+        ok = readBinCompressed(base, &h, param);
+        munmap(base, size);
+        if(!ok)
+            fprintf(stderr,"Error decoding data from %s\n",fn);
+        return ok;
+    }
+    bool multi = param->multiskill != 0;
+    size_t N = (size_t)h.N;
+    
+    // row arrays
+    param->dat_obs   = (NPAR*)binSection(base, &h, BS_OBS,   N, sizeof(NPAR), &ok);
+    param->dat_group = (NCAT*)binSection(base, &h, BS_GROUP, N, sizeof(NCAT), &ok);
+    param->dat_item  = (NCAT*)binSection(base, &h, BS_ITEM,  N, sizeof(NCAT), &ok);
+    if(!multi)
+        param->dat_skill = (NCAT*)binSection(base, &h, BS_SKILL, N, sizeof(NCAT), &ok);
+    else {
+        param->dat_skill_stacked = (NCAT*)binSection(base, &h, BS_SKILL_STACKED, (size_t)h.Nstacked, sizeof(NCAT), &ok);
+        param->dat_skill_rcount  = (NCAT*)binSection(base, &h, BS_SKILL_RCOUNT,  N, sizeof(NCAT), &ok);
+        param->dat_skill_rix     = (NDAT*)binSection(base, &h, BS_SKILL_RIX,     N, sizeof(NDAT), &ok);
+    }
+    if(param->nZ > 1)
+        param->dat_slice = (NPAR*)binSection(base, &h, BS_SLICE, multi?(size_t)h.Nstacked:N, sizeof(NPAR), &ok);
+    // sequence index
+    NDAT *seq_start = (NDAT*)binSection(base, &h, BS_SEQ_START, (size_t)h.nSeq+1, sizeof(NDAT), &ok);
+    size_t npos = (ok && seq_start[h.nSeq]>0)?(size_t)seq_start[h.nSeq]:0;
+    NDAT *seq_ix = (NDAT*)binSection(base, &h, BS_SEQ_IX, npos, sizeof(NDAT), &ok);
+    NDAT *seq_ix_stacked = multi?(NDAT*)binSection(base, &h, BS_SEQ_IX_STACKED, npos, sizeof(NDAT), &ok):NULL;
+    NDAT *k_start = (NDAT*)binSection(base, &h, BS_K_START, (size_t)h.nK+1, sizeof(NDAT), &ok);
+    NDAT *k_seq   = (NDAT*)binSection(base, &h, BS_K_SEQ,   (size_t)h.nSeq,  sizeof(NDAT), &ok);
+    NDAT *g_start = (NDAT*)binSection(base, &h, BS_G_START, (size_t)h.nG+1, sizeof(NDAT), &ok);
+    NDAT *g_seq   = (NDAT*)binSection(base, &h, BS_G_SEQ,   (size_t)h.nSeq,  sizeof(NDAT), &ok);
+    NCAT *null_g     = (NCAT*)binSection(base, &h, BS_NULL_G,     (size_t)h.n_null_skill_group,   sizeof(NCAT), &ok);
+    NDAT *null_start = (NDAT*)binSection(base, &h, BS_NULL_START, (size_t)h.n_null_skill_group+1, sizeof(NDAT), &ok);
+    size_t nnull = (ok && null_start[h.n_null_skill_group]>0)?(size_t)null_start[h.n_null_skill_group]:0;
+    NDAT *null_ix = (NDAT*)binSection(base, &h, BS_NULL_IX, nnull, sizeof(NDAT), &ok);
+    NDAT *null_ix_stacked = multi?(NDAT*)binSection(base, &h, BS_NULL_IX_STACKED, nnull, sizeof(NDAT), &ok):NULL;
+    NPAR *seq_obs = (NPAR*)binSection(base, &h, BS_SEQ_OBS, npos, sizeof(NPAR), &ok);
+    // the checksum covers the header only: starts of the index have to stay within their sections, and
+    // the values have to index rows and sequences that exist, before any of them are used
+    ok = ok && binStartsValid(seq_start, h.nSeq, npos) && binStartsValid(k_start, h.nK, (size_t)h.nSeq) &&
+        binStartsValid(g_start, h.nG, (size_t)h.nSeq) && binStartsValid(null_start, h.n_null_skill_group, nnull);
+    ok = ok && binInRange(seq_ix, (NDAT)npos, 0, h.N) && binInRange(null_ix, (NDAT)nnull, 0, h.N) &&
+        binInRange(k_seq, h.nSeq, 0, h.nSeq) && binInRange(g_seq, h.nSeq, 0, h.nSeq) &&
+        binInRange(null_g, h.n_null_skill_group, 0, h.nG);
+    if(ok && multi)
+        ok = binInRange(seq_ix_stacked, (NDAT)npos, 0, h.Nstacked) && binInRange(null_ix_stacked, (NDAT)nnull, 0, h.Nstacked);
+    // vocabularies
+    NCAT voc_n[3] = {h.nG, h.nK, h.nI};
+    struct vocab *voc[3] = {NULL, NULL, NULL};
+    for(int i=0; i<3 && ok; i++) {
+        char *arena = (char*)binSection(base, &h, BS_VOC_ARENA+4*i, (size_t)h.section[BS_VOC_ARENA+4*i][1], 1, &ok);
+        size_t *offset = (size_t*)binSection(base, &h, BS_VOC_OFFSET+4*i, (size_t)voc_n[i]+1, sizeof(size_t), &ok);
+        unsigned int *hash = (unsigned int*)binSection(base, &h, BS_VOC_HASH+4*i, (size_t)voc_n[i], sizeof(unsigned int), &ok);
+        NCAT *table = (NCAT*)binSection(base, &h, BS_VOC_TABLE+4*i, (size_t)h.voc_mask[i]+1, sizeof(NCAT), &ok);
+        ok = ok && binStartsValid(offset, voc_n[i], (size_t)h.section[BS_VOC_ARENA+4*i][1]) && // strings stay within the arena
+            (voc_n[i]==0 || (offset[voc_n[i]]>0 && arena[ offset[voc_n[i]]-1 ]==0)) && binInRange(table, (NDAT)h.voc_mask[i]+1, 0, (long long)voc_n[i]+1);
+        voc[i] = ok?mapVocab(voc_n[i], arena, (size_t)h.section[BS_VOC_ARENA+4*i][1], offset, hash, table, h.voc_mask[i]):NULL;
+    }
+    if(!ok) {
+        fprintf(stderr,"Sections of %s are damaged or do not match its header\n",fn);
+        for(int i=0; i<3; i++)
+            if(voc[i] != NULL) freeVocab(voc[i]);
+        munmap(base, size);
+        return false;
+    }
+    param->voc_group = voc[0];
+    param->voc_skill = voc[1];
+    param->voc_step  = voc[2];
+    param->bin_map = base;
+    param->bin_map_size = size;
+    
+    // sequences over the index, as structure_data would have them
+    NDAT x;
+    NCAT k, g;
+    param->all_data = Calloc(struct data, (size_t)param->nSeq);
+    for(x=0; x<param->nSeq; x++) {
+        struct data *dt = &param->all_data[x];
+        dt->n = seq_start[x+1] - seq_start[x];
+        dt->ix = &seq_ix[ seq_start[x] ];
+        dt->ix_stacked = multi?&seq_ix_stacked[ seq_start[x] ]:NULL;
+    }
+    param->k_numg = Calloc(NCAT, (size_t)param->nK);
+    param->k_data = Malloc(struct data *, (size_t)param->nSeq);
+    param->k_g_data = Malloc(struct data **, (size_t)param->nK);
+    for(k=0; k<param->nK; k++) {
+        param->k_numg[k] = k_start[k+1] - k_start[k];
+        param->k_g_data[k] = &param->k_data[ k_start[k] ];
+        for(x=k_start[k]; x<k_start[k+1]; x++) {
+            param->k_data[x] = &param->all_data[ k_seq[x] ];
+            param->k_data[x]->k = k;
+        }
+    }
+    param->g_numk = Calloc(NCAT, (size_t)param->nG);
+    param->g_data = Malloc(struct data *, (size_t)param->nSeq);
+    param->g_k_data = Calloc(struct data **, (size_t)param->nG);
+    for(g=0; g<param->nG; g++) {
+        param->g_numk[g] = g_start[g+1] - g_start[g];
+        param->g_k_data[g] = &param->g_data[ g_start[g] ];
+        for(x=g_start[g]; x<g_start[g+1]; x++) {
+            param->g_data[x] = &param->all_data[ g_seq[x] ];
+            param->g_data[x]->g = g;
+        }
+    }
+    param->null_skills = Calloc(struct data, (size_t)param->n_null_skill_group);
+    for(g=0; g<param->n_null_skill_group; g++) {
+        struct data *dt = &param->null_skills[g];
+        dt->n = null_start[g+1] - null_start[g];
+        dt->g = null_g[g];
+        dt->k = -1;
+        dt->ix = &null_ix[ null_start[g] ];
+        dt->ix_stacked = multi?&null_ix_stacked[ null_start[g] ]:NULL;
+    }
+    // observations of sequences, in place if they are fit by skill
+    if(param->structure==STRUCTURE_SKILL) {
+        param->seq_obs = seq_obs;
+        NDAT off = 0;
+        for(x=0; x<param->nSeq; x++) {
+            param->k_data[x]->obs = &seq_obs[off];
+            off += param->k_data[x]->n;
+        }
+    } else
+        gather_seq_obs(param);
     return true;
 }
+
+bool InputUtil::readBinCompressed(char *base, const struct bin_header *h, struct param * param) {
+    bool par = param->parallel != 0;
+    bool multi = param->multiskill != 0;
+    NDAT NZ = multi?h->Nstacked:h->N;
+    #define BIN_SEC(s) (const unsigned char*)(base + h->section[s][0]), (size_t)h->section[s][1]
+    param->dat_obs   = binDecode<NPAR>(BIN_SEC(BS_OBS),   h->N, par);
+    param->dat_group = binDecode<NCAT>(BIN_SEC(BS_GROUP), h->N, par);
+    param->dat_item  = binDecode<NCAT>(BIN_SEC(BS_ITEM),  h->N, par);
+    bool ok = param->dat_obs != NULL && param->dat_group != NULL && param->dat_item != NULL;
+    if(!multi) {
+        param->dat_skill = binDecode<NCAT>(BIN_SEC(BS_SKILL), h->N, par);
+        ok = ok && param->dat_skill != NULL;
+    } else {
+        param->dat_skill_stacked = binDecode<NCAT>(BIN_SEC(BS_SKILL_STACKED), h->Nstacked, par);
+        param->dat_skill_rcount  = binDecode<NCAT>(BIN_SEC(BS_SKILL_RCOUNT),  h->N, par);
+        param->dat_skill_rix     = binDecode<NDAT>(BIN_SEC(BS_SKILL_RIX),     h->N, par);
+        ok = ok && param->dat_skill_stacked != NULL && param->dat_skill_rcount != NULL && param->dat_skill_rix != NULL;
+    }
+    if(param->nZ > 1) {
+        param->dat_slice = binDecode<NPAR>(BIN_SEC(BS_SLICE), NZ, par);
+        ok = ok && param->dat_slice != NULL;
+    }
+    #undef BIN_SEC
+    // ids index straight into the model and the structuring arrays
+    ok = ok && binInRange(param->dat_obs, h->N, SCHAR_MIN, h->nO) &&
+        binInRange(param->dat_group, h->N, 0, h->nG) && binInRange(param->dat_item, h->N, 0, h->nI);
+    if(ok && !multi)
+        ok = binInRange(param->dat_skill, h->N, -1, h->nK);
+    if(ok && multi) {
+        ok = binInRange(param->dat_skill_stacked, h->Nstacked, -1, h->nK) &&
+            binInRange(param->dat_skill_rcount, h->N, 1, NCAT_MAX);
+        for(NDAT t=0; t<h->N && ok; t++)
+            ok = param->dat_skill_rix[t] >= 0 &&
+                (long long)param->dat_skill_rix[t] + param->dat_skill_rcount[t] <= (long long)h->Nstacked;
+    }
+    if(ok && param->nZ > 1)
+        ok = binInRange(param->dat_slice, NZ, 0, param->nZ);
+    // vocabularies from their strings
+    NCAT voc_n[3] = {h->nG, h->nK, h->nI};
+    struct vocab **voc[3] = {&param->voc_group, &param->voc_skill, &param->voc_step};
+    for(int i=0; i<3; i++) {
+        *voc[i] = newVocab();
+        const char *p = base + h->section[BS_VOC_ARENA+4*i][0], *e = p + h->section[BS_VOC_ARENA+4*i][1], *z;
+        for(NCAT n=0; n<voc_n[i] && ok; n++) {
+            if( (z = (const char*)memchr(p, 0, (size_t)(e-p))) == NULL || addVocab(*voc[i], p, (size_t)(z-p)) != n ) {
+                ok = false;
+                break;
+            }
+            p = z + 1;
+        }
+    }
+    return ok;
+}
@@ -40,17 +40,64 @@
 
 //#define bin_input_file_verstion 1
 //#define bin_input_file_verstion 2 // increase number of skills/students to a 4 byte integer
-#define bin_input_file_verstion 3 // added Nstacked, changed how multi-skills are stored and added slices (single and multi-coded)
+//#define bin_input_file_verstion 3 // added Nstacked, changed how multi-skills are stored and added slices (single and multi-coded)
+#define bin_input_file_verstion 4 // memory-mappable: header with a table of 64-byte aligned sections, sequence index, vocabularies with hash tables
+#define BIN_ALIGN 64 // alignment of sections in the binary file (version 4)
+#define BIN_BLOCK_ROWS 65536 // rows in a block of a compressed column, blocks are encoded and decoded separately
+#define TXT_CHUNKS_PER_THREAD 4 // chunks of lines per thread when text input is parsed in parallel
+#define TXT_RING_BLOCK (1<<24) // bytes of decompressed text parsed at a time (compressed text input)
+#define TXT_RING_BUFFERS 3 // buffers of decompressed text: one parsed, others filled meanwhile
+
+// sections of the binary file, version 4
+enum BIN_SECTION {
+    BS_OBS, BS_GROUP, BS_ITEM,                      // row arrays: dat_obs, dat_group, dat_item
+    BS_SKILL,                                       // dat_skill (single skill)
+    BS_SKILL_STACKED, BS_SKILL_RCOUNT, BS_SKILL_RIX,// dat_skill_stacked, dat_skill_rcount, dat_skill_rix (multiskill)
+    BS_SLICE,                                       // dat_slice (nZ>1)
+    BS_SEQ_START,                                   // nSeq+1, rows of sequence x (all_data order) are seq_ix[ start[x] ... start[x+1]-1 ]
+    BS_SEQ_IX, BS_SEQ_IX_STACKED,                   // data.ix and data.ix_stacked of all sequences, back to back
+    BS_K_START, BS_K_SEQ,                           // nK+1 offsets into nSeq sequences by skill (k_data, all_data indices)
+    BS_G_START, BS_G_SEQ,                           // nG+1 offsets into nSeq sequences by group (g_data, all_data indices)
+    BS_NULL_G, BS_NULL_START,                       // groups of null skill sequences, and n_null_skill_group+1 offsets into
+    BS_NULL_IX, BS_NULL_IX_STACKED,                 //   their data.ix and data.ix_stacked
+    BS_SEQ_OBS,                                     // observations of sequences in k_data order (seq_obs of skill structure)
+    BS_VOC_ARENA, BS_VOC_OFFSET, BS_VOC_HASH, BS_VOC_TABLE, // vocabulary of groups, then of skills (+4), and steps (+8)
+    BS_NUM = BS_VOC_ARENA + 12
+};
+
+// encodings of columns of the compressed binary file (version 4)
+enum BIN_CODEC {
+    BC_BITS  = 1, // value+1 in a fixed number of bits, for observations
+    BC_DELTA = 2, // difference from the previous value, zigzag varint, for ids
+    BC_RLE   = 3  // runs: value (zigzag varint) and length (varint), for skills
+};
+
+// header of the binary file, version 4, the file is mapped into memory and the arrays are used in place
+struct bin_header {
+    char version;          // as in earlier versions, the first byte
+    char multiskill;
+    char size_t_size;      // sizeof(size_t) of the writer, vocabulary offsets are size_t
+    char compressed;       // 1 - row arrays are encoded (BIN_CODEC) and decoded on reading, no sequence index or vocabulary hash tables
+    NDAT N, Nstacked, N_null, nO, nG, nI, nK, nZ;
+    NDAT nSeq, n_null_skill_group;
+    unsigned int voc_mask[3]; // hash table masks of vocabularies: groups, skills, steps
+    unsigned int checksum; // FNV-1a of the header with this set to 0
+    unsigned long long section[BS_NUM][2]; // offset from the start of the file and size, in bytes
+};
 
 class InputUtil {
 public:
     static bool readTxt(const char *fn, struct param * param); // read txt into param
+    static bool readTxtBuffer(const char *buf, size_t size, struct param * param); // read txt that is in memory into param
     static bool readBin(const char *fn, struct param * param); // read bin into param
-    static bool toBin(struct param * param, const char *fn);// writes data in param to bin file
+    static bool toBin(struct param * param, const char *fn, char version = bin_input_file_verstion, bool compress = false);// writes data in param to bin file, version 4 needs structured data (structure_data) unless compressed
     // experimental
     static void writeInputMatrix(const char *filename, struct param* p, NCAT xndat, struct data** x_data);
 private:
-    static void writeString(FILE *f, string str);
-    static string readString(FILE *f);
+    static void writeVocab(FILE *f, struct vocab *v);
+    static bool readVocab(FILE *f, NCAT n, struct vocab *v);
+    static bool readBinMapped(const char *fn, struct param * param); // version 4
+    static bool toBinMapped(struct param * param, const char *fn, bool compress); // version 4
+    static bool readBinCompressed(char *base, const struct bin_header *h, struct param * param); // version 4, compressed
 };
 #endif /* defined(__HMM__InputUtil__) */
@@ -0,0 +1,504 @@
+/*
+ 
+ Copyright (c) 2012-2015, Michael (Mikhail) Yudelson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Michael (Mikhail) Yudelson nor the
+ names of other contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "StateFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * State file, mapped into memory (shared) and updated in place:
+ *  - two header slots : struct state_file_header, the current one is the valid slot with the larger seq
+ *  - sections : enum STATE_FILE_SECTION, each starts at a multiple of STATE_FILE_ALIGN bytes and has room for the
+ *      capacities in the header; labels are struct vocab arrays and pairs struct state_store arrays, with their hash
+ *      tables, so a run looks up the pairs of its own rows only, and adds new ones at the end
+ * An update is a batch of records of absolute p(L) by labels. It is appended to the log and synced first, then applied
+ * to the mapping, which is synced before the header in the other slot counts what was added, then the log is emptied.
+ * If a run stops in between, the next one finds the batch in the log, rebuilds the hash tables for the counts of the
+ * current header (dropping slots of a torn update), and applies the batch again. When the room for pairs or labels is
+ * used up, the file is written anew with it doubled and renamed over the old one.
+ */
+
+static inline unsigned long long stateAlign(unsigned long long size) {
+    return (size + STATE_FILE_ALIGN - 1) / STATE_FILE_ALIGN * STATE_FILE_ALIGN;
+}
+
+// sections for the capacities in the header, after the header slots; size of the file
+static unsigned long long stateLayout(struct state_file_header *h) {
+    unsigned long long cap = (unsigned long long)h->cap, capG = (unsigned long long)h->capG, capK = (unsigned long long)h->capK;
+    h->section[SFS_PAIR_G][1]     = cap*sizeof(NCAT);
+    h->section[SFS_PAIR_K][1]     = cap*sizeof(NCAT);
+    h->section[SFS_PAIR_P][1]     = cap*(unsigned long long)h->nS*sizeof(NUMBER);
+    h->section[SFS_PAIR_TABLE][1] = 2*cap*sizeof(NDAT);
+    h->section[SFS_G_ARENA][1]    = h->capacityG;
+    h->section[SFS_G_OFFSET][1]   = (capG+1)*sizeof(size_t);
+    h->section[SFS_G_HASH][1]     = capG*sizeof(unsigned int);
+    h->section[SFS_G_TABLE][1]    = 2*capG*sizeof(NCAT);
+    h->section[SFS_K_ARENA][1]    = h->capacityK;
+    h->section[SFS_K_OFFSET][1]   = (capK+1)*sizeof(size_t);
+    h->section[SFS_K_HASH][1]     = capK*sizeof(unsigned int);
+    h->section[SFS_K_TABLE][1]    = 2*capK*sizeof(NCAT);
+    unsigned long long pos = 2*STATE_FILE_SLOT;
+    for(int s=0; s<SFS_NUM; s++) {
+        h->section[s][0] = pos;
+        pos += stateAlign(h->section[s][1]);
+    }
+    return pos;
+}
+
+static inline bool statePow2(long long x) {
+    return x > 0 && (x & (x-1)) == 0;
+}
+
+// header in a slot, false if it is not a whole one of this platform, or does not fit the file
+static bool stateHeader(const char *slot, size_t size, struct state_file_header *h) {
+    struct state_file_header c;
+    memcpy(h, slot, sizeof(struct state_file_header));
+    memcpy(&c, slot, sizeof(struct state_file_header));
+    c.checksum = 0;
+    if( memcmp(h->magic, STATE_FILE_MAGIC, 4)!=0 || hashString((const char*)&c, sizeof(struct state_file_header)) != h->checksum )
+        return false;
+    if( h->version > state_file_version || h->size_t_size != (char)sizeof(size_t) || h->number_size != (char)sizeof(NUMBER) || h->nS < 1 )
+        return false;
+    if( !statePow2(h->cap) || !statePow2(h->capG) || !statePow2(h->capK) || h->n < 0 || h->n > h->cap ||
+       h->nG < 0 || h->nG > h->capG || h->nK < 0 || h->nK > h->capK || h->sizeG > h->capacityG || h->sizeK > h->capacityK )
+        return false;
+    if( stateLayout(&c) > (unsigned long long)size )
+        return false;
+    return memcmp(c.section, h->section, sizeof(c.section))==0;
+}
+
+static inline char* stateSection(struct state_file *sf, int s) {
+    return sf->base + sf->h.section[s][0];
+}
+
+// labels and pairs over the mapping, for the counts of the header
+static void stateViews(struct state_file *sf) {
+    struct state_file_header *h = &sf->h;
+    sf->voc_group = mapVocab(h->nG, stateSection(sf, SFS_G_ARENA), (size_t)h->sizeG, (size_t*)stateSection(sf, SFS_G_OFFSET),
+                             (unsigned int*)stateSection(sf, SFS_G_HASH), (NCAT*)stateSection(sf, SFS_G_TABLE), 2*(unsigned int)h->capG - 1);
+    sf->voc_skill = mapVocab(h->nK, stateSection(sf, SFS_K_ARENA), (size_t)h->sizeK, (size_t*)stateSection(sf, SFS_K_OFFSET),
+                             (unsigned int*)stateSection(sf, SFS_K_HASH), (NCAT*)stateSection(sf, SFS_K_TABLE), 2*(unsigned int)h->capK - 1);
+    sf->voc_group->cap = h->capG;
+    sf->voc_group->capacity = (size_t)h->capacityG;
+    sf->voc_skill->cap = h->capK;
+    sf->voc_skill->capacity = (size_t)h->capacityK;
+    sf->pairs.nS = h->nS;
+    sf->pairs.n = h->n;
+    sf->pairs.cap = h->cap;
+    sf->pairs.g = (NCAT*)stateSection(sf, SFS_PAIR_G);
+    sf->pairs.k = (NCAT*)stateSection(sf, SFS_PAIR_K);
+    sf->pairs.p = (NUMBER*)stateSection(sf, SFS_PAIR_P);
+    sf->pairs.set = NULL;
+    sf->pairs.table = (NDAT*)stateSection(sf, SFS_PAIR_TABLE);
+    sf->pairs.mask = 2*h->cap - 1;
+}
+
+// hash tables from the labels and pairs that are counted, slots of the ones that are not are dropped
+static void stateRehash(struct state_file *sf) {
+    struct vocab *v[2] = {sf->voc_group, sf->voc_skill};
+    for(int i=0; i<2; i++) {
+        memset(v[i]->table, 0, sizeof(NCAT)*((size_t)v[i]->mask + 1));
+        for(NCAT x=0; x<v[i]->n; x++) {
+            unsigned int h = v[i]->hash[x] & v[i]->mask;
+            while( v[i]->table[h] != 0 )
+                h = (h + 1) & v[i]->mask;
+            v[i]->table[h] = x + 1;
+        }
+    }
+    struct state_store *ss = &sf->pairs;
+    memset(ss->table, 0, sizeof(NDAT)*((size_t)ss->mask + 1));
+    for(NDAT ix=0; ix<ss->n; ix++) {
+        NDAT h = hashState(ss->g[ix], ss->k[ix], ss->mask);
+        while( ss->table[h] != 0 )
+            h = (h + 1) & ss->mask;
+        ss->table[h] = ix + 1;
+    }
+}
+
+// id of a label, added at the end if new, there is room for it
+static NCAT stateAddLabel(struct vocab *v, const char *s, size_t len) {
+    NCAT ix = findVocab(v, s, len);
+    if(ix >= 0) return ix;
+    unsigned int hs = hashString(s, len), h = hs & v->mask;
+    while( v->table[h] != 0 )
+        h = (h + 1) & v->mask;
+    ix = v->n++;
+    memcpy(v->arena + v->size, s, len);
+    v->arena[v->size + len] = 0;
+    v->size += len + 1;
+    v->offset[ix+1] = v->size;
+    v->hash[ix] = hs;
+    v->table[h] = ix + 1;
+    return ix;
+}
+
+// index of a pair, added at the end if new, there is room for it
+static NDAT stateAddPair(struct state_store *ss, NCAT g, NCAT k) {
+    NDAT h = hashState(g, k, ss->mask), ix;
+    while( (ix = ss->table[h]) != 0 ) {
+        if( ss->g[ix-1]==g && ss->k[ix-1]==k )
+            return ix-1;
+        h = (h + 1) & ss->mask;
+    }
+    ix = ss->n++;
+    ss->g[ix] = g;
+    ss->k[ix] = k;
+    ss->table[h] = ix + 1;
+    return ix;
+}
+
+// counts of the views to the header, written to the other slot, after all it counts
+static void stateWriteHeader(struct state_file *sf) {
+    struct state_file_header *h = &sf->h;
+    h->seq++;
+    h->n = sf->pairs.n;
+    h->nG = sf->voc_group->n;
+    h->sizeG = (unsigned long long)sf->voc_group->size;
+    h->nK = sf->voc_skill->n;
+    h->sizeK = (unsigned long long)sf->voc_skill->size;
+    h->checksum = 0;
+    h->checksum = hashString((const char*)h, sizeof(struct state_file_header));
+    char *slot = sf->base + (h->seq%2)*STATE_FILE_SLOT;
+    memcpy(slot, h, sizeof(struct state_file_header));
+    if( msync(slot, STATE_FILE_SLOT, MS_SYNC) != 0 ) {
+        fprintf(stderr,"Error writing state file %s\n",sf->filename);
+        exit(1);
+    }
+}
+
+static void stateSyncDir(const char *filename) { // so that a rename in it is durable
+    char *dir = Malloc(char, strlen(filename) + 2);
+    strcpy(dir, filename);
+    char *sl = strrchr(dir, '/');
+    if(sl == NULL) strcpy(dir, ".");
+    else sl[(sl==dir)?1:0] = 0;
+    int fd = open(dir, O_RDONLY);
+    if(fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+// a state file of the capacities in h, with the labels and pairs of from if it is not NULL, is written to
+// filename.tmp and renamed to filename, so there is either the old file or the whole new one
+static void stateWriteFile(const char *filename, struct state_file_header *h, struct state_file *from) {
+    size_t size = (size_t)stateLayout(h);
+    char *tmp = Malloc(char, strlen(filename) + 5);
+    sprintf(tmp, "%s.tmp", filename);
+    int fd = open(tmp, O_RDWR|O_CREAT|O_TRUNC, 0644);
+    char *base = (fd >= 0 && ftruncate(fd, (off_t)size)==0)?(char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0):(char*)MAP_FAILED;
+    if(base == MAP_FAILED) {
+        fprintf(stderr,"Can't write state file %s\n",tmp);
+        exit(1);
+    }
+    struct state_file sf;
+    memset(&sf, 0, sizeof(struct state_file));
+    sf.filename = tmp;
+    sf.base = base;
+    sf.size = size;
+    sf.h = *h;
+    sf.h.n = sf.h.nG = sf.h.nK = 0;
+    sf.h.sizeG = sf.h.sizeK = 0;
+    stateViews(&sf);
+    sf.voc_group->offset[0] = 0;
+    sf.voc_skill->offset[0] = 0;
+    if(from != NULL) { // ids stay the same
+        struct vocab *v[2] = {sf.voc_group, sf.voc_skill}, *fv[2] = {from->voc_group, from->voc_skill};
+        for(int i=0; i<2; i++) {
+            v[i]->n = fv[i]->n;
+            v[i]->size = fv[i]->size;
+            memcpy(v[i]->arena, fv[i]->arena, fv[i]->size);
+            memcpy(v[i]->offset, fv[i]->offset, sizeof(size_t)*((size_t)fv[i]->n + 1));
+            memcpy(v[i]->hash, fv[i]->hash, sizeof(unsigned int)*(size_t)fv[i]->n);
+        }
+        NDAT n = from->pairs.n;
+        sf.pairs.n = n;
+        memcpy(sf.pairs.g, from->pairs.g, sizeof(NCAT)*(size_t)n);
+        memcpy(sf.pairs.k, from->pairs.k, sizeof(NCAT)*(size_t)n);
+        memcpy(sf.pairs.p, from->pairs.p, sizeof(NUMBER)*(size_t)n*(size_t)h->nS);
+        sf.h.seq = from->h.seq;
+    }
+    stateRehash(&sf);
+    if( msync(base, size, MS_SYNC) != 0 ) {
+        fprintf(stderr,"Error writing state file %s\n",tmp);
+        exit(1);
+    }
+    stateWriteHeader(&sf);
+    freeVocab(sf.voc_group);
+    freeVocab(sf.voc_skill);
+    munmap(base, size);
+    if( fsync(fd) != 0 || close(fd) != 0 || rename(tmp, filename) != 0 ) {
+        fprintf(stderr,"Can't write state file %s\n",filename);
+        exit(1);
+    }
+    stateSyncDir(filename);
+    free(tmp);
+}
+
+// map the file, the current header, views over it
+static void stateMap(struct state_file *sf) {
+    sf->fd = open(sf->filename, O_RDWR);
+    if(sf->fd < 0) {
+        fprintf(stderr,"Can't read state file %s\n",sf->filename);
+        exit(1);
+    }
+    struct stat st;
+    fstat(sf->fd, &st);
+    sf->size = (size_t)st.st_size;
+    sf->base = (sf->size >= 2*STATE_FILE_SLOT)?(char*)mmap(NULL, sf->size, PROT_READ|PROT_WRITE, MAP_SHARED, sf->fd, 0):(char*)MAP_FAILED;
+    if(sf->base == MAP_FAILED) {
+        fprintf(stderr,"Can't read state file %s\n",sf->filename);
+        exit(1);
+    }
+    madvise(sf->base, sf->size, MADV_RANDOM); // pages of the pairs looked up
+    struct state_file_header h[2];
+    bool ok[2];
+    for(int i=0; i<2; i++)
+        ok[i] = stateHeader(sf->base + i*STATE_FILE_SLOT, sf->size, &h[i]);
+    if(!ok[0] && !ok[1]) {
+        fprintf(stderr,"Header of state file %s is damaged, or it was written by a different version or on a different platform\n",sf->filename);
+        exit(1);
+    }
+    sf->h = h[ (ok[1] && (!ok[0] || h[1].seq > h[0].seq))?1:0 ];
+    stateViews(sf);
+}
+
+static void stateUnmap(struct state_file *sf) {
+    freeVocab(sf->voc_group);
+    freeVocab(sf->voc_skill);
+    munmap(sf->base, sf->size);
+    close(sf->fd);
+}
+
+// the file is written anew with the capacities that are used up doubled, so that a pair, and a student and a skill
+// label of the lengths given can be added
+static void stateGrow(struct state_file *sf, size_t glen, size_t klen) {
+    struct state_file_header h = sf->h;
+    if( sf->pairs.n == h.cap ) h.cap *= 2;
+    if( sf->voc_group->n == h.capG ) h.capG *= 2;
+    if( sf->voc_skill->n == h.capK ) h.capK *= 2;
+    while( sf->voc_group->size + glen + 1 > h.capacityG ) h.capacityG *= 2;
+    while( sf->voc_skill->size + klen + 1 > h.capacityK ) h.capacityK *= 2;
+    if( h.cap > NDAT_MAX/2 || h.capG > NCAT_MAX/2 || h.capK > NCAT_MAX/2 ) {
+        fprintf(stderr,"Too many student-skill pairs or labels for state file %s\n",sf->filename);
+        exit(1);
+    }
+    stateWriteFile(sf->filename, &h, sf);
+    stateUnmap(sf);
+    stateMap(sf);
+}
+
+// the batch is applied to the mapping, synced, and counted
+static void stateApply(struct state_file *sf) {
+    NPAR nS = sf->h.nS;
+    unsigned int len[2];
+    for(size_t pos=0; pos<sf->batch_n; ) {
+        const char *r = sf->batch + pos;
+        memcpy(len, r, sizeof(len));
+        r += sizeof(len);
+        if( sf->pairs.n == sf->h.cap || sf->voc_group->n == sf->h.capG || sf->voc_skill->n == sf->h.capK ||
+           sf->voc_group->size + len[0] + 1 > sf->h.capacityG || sf->voc_skill->size + len[1] + 1 > sf->h.capacityK )
+            stateGrow(sf, len[0], len[1]); // the log has the batch until it is all applied
+        NCAT g = stateAddLabel(sf->voc_group, r, len[0]);
+        NCAT k = stateAddLabel(sf->voc_skill, r + len[0], len[1]);
+        NDAT ix = stateAddPair(&sf->pairs, g, k);
+        memcpy(&sf->pairs.p[ (size_t)ix*nS ], r + len[0] + len[1], sizeof(NUMBER)*(size_t)nS);
+        pos += sizeof(len) + len[0] + len[1] + sizeof(NUMBER)*(size_t)nS;
+    }
+    if( msync(sf->base, sf->size, MS_SYNC) != 0 ) {
+        fprintf(stderr,"Error writing state file %s\n",sf->filename);
+        exit(1);
+    }
+    stateWriteHeader(sf);
+    sf->batch_n = 0;
+    sf->batch_records = 0;
+}
+
+static void stateEmptyLog(struct state_file *sf) {
+    if( ftruncate(sf->log_fd, 0) != 0 || fsync(sf->log_fd) != 0 ) {
+        fprintf(stderr,"Error writing the log of state file %s\n",sf->filename);
+        exit(1);
+    }
+}
+
+static void stateBatchAppend(struct state_file *sf, const void *s, size_t len) {
+    if( sf->batch_n + len > sf->batch_cap ) {
+        sf->batch_cap = MAX(2*sf->batch_cap, sf->batch_n + len + 4096);
+        sf->batch = (char*)realloc(sf->batch, sf->batch_cap);
+        if(sf->batch == NULL) {
+            fprintf(stderr,"Failed to allocate memory for %lu bytes of state updates.\n", (unsigned long)sf->batch_cap);
+            exit(1);
+        }
+    }
+    memcpy(sf->batch + sf->batch_n, s, len);
+    sf->batch_n += len;
+}
+
+struct state_file* openStateFile(const char *filename, NPAR nS) {
+    struct state_file *sf = Calloc(struct state_file, 1);
+    sf->filename = Malloc(char, strlen(filename) + 1);
+    strcpy(sf->filename, filename);
+    char *log = Malloc(char, strlen(filename) + 5);
+    sprintf(log, "%s.log", filename);
+    sf->log_fd = open(log, O_RDWR|O_CREAT|O_APPEND, 0644);
+    if(sf->log_fd < 0) {
+        fprintf(stderr,"Can't open log %s of state file %s\n",log,filename);
+        exit(1);
+    }
+    if( flock(sf->log_fd, LOCK_EX|LOCK_NB) != 0 ) {
+        fprintf(stderr,"State file %s is used by another process\n",filename);
+        exit(1);
+    }
+    struct stat st;
+    if( stat(filename, &st) != 0 ) { // a new one
+        struct state_file_header h;
+        memset(&h, 0, sizeof(struct state_file_header));
+        memcpy(h.magic, STATE_FILE_MAGIC, 4);
+        h.version = state_file_version;
+        h.size_t_size = (char)sizeof(size_t);
+        h.number_size = (char)sizeof(NUMBER);
+        h.nS = nS;
+        h.cap = 1024;
+        h.capG = h.capK = 256;
+        h.capacityG = h.capacityK = 4096;
+        stateWriteFile(filename, &h, NULL);
+    }
+    stateMap(sf);
+    if(sf->h.nS != nS) {
+        fprintf(stderr,"State file %s has %d states, the model has %d\n",filename,sf->h.nS,nS);
+        exit(1);
+    }
+    // batches in the log were not applied, or not all of their pages made it to the file
+    fstat(sf->log_fd, &st);
+    size_t size = (size_t)st.st_size, pos = 0;
+    if(size > 0) {
+        char *buf = Malloc(char, size);
+        size_t got = 0;
+        ssize_t r;
+        while( got < size && (r = pread(sf->log_fd, buf + got, size - got, (off_t)got)) > 0 )
+            got += (size_t)r;
+        struct state_log_batch b;
+        while( pos + sizeof(struct state_log_batch) <= got ) {
+            memcpy(&b, buf + pos, sizeof(struct state_log_batch));
+            if( memcmp(b.magic, STATE_LOG_MAGIC, 4)!=0 || b.size > got - pos - sizeof(struct state_log_batch) ||
+               hashString(buf + pos + sizeof(struct state_log_batch), (size_t)b.size) != b.checksum )
+                break;
+            stateBatchAppend(sf, buf + pos + sizeof(struct state_log_batch), (size_t)b.size);
+            sf->batch_records += b.records;
+            pos += sizeof(struct state_log_batch) + (size_t)b.size;
+        }
+        free(buf);
+        if(pos < size)
+            fprintf(stderr,"Warning! %lu bytes of an incomplete update at the end of the log of state file %s are dropped\n",(unsigned long)(size-pos),filename);
+        stateRehash(sf);
+        if(sf->batch_records > 0)
+            stateApply(sf);
+        stateEmptyLog(sf);
+    }
+    free(log);
+    return sf;
+}
+
+void closeStateFile(struct state_file *sf) {
+    stateUnmap(sf);
+    close(sf->log_fd);
+    if(sf->batch != NULL) free(sf->batch);
+    free(sf->filename);
+    free(sf);
+}
+
+bool getStateFile(struct state_file *sf, const char *group, size_t glen, const char *skill, size_t klen, NUMBER *p) {
+    NCAT g = findVocab(sf->voc_group, group, glen);
+    NCAT k = (g < 0)?-1:findVocab(sf->voc_skill, skill, klen);
+    NDAT ix = (k < 0)?-1:findState(&sf->pairs, g, k);
+    if(ix < 0)
+        return false;
+    memcpy(p, &sf->pairs.p[ (size_t)ix*sf->h.nS ], sizeof(NUMBER)*(size_t)sf->h.nS);
+    return true;
+}
+
+void putStateFile(struct state_file *sf, const char *group, size_t glen, const char *skill, size_t klen, const NUMBER *p) {
+    unsigned int len[2] = {(unsigned int)glen, (unsigned int)klen};
+    stateBatchAppend(sf, len, sizeof(len));
+    stateBatchAppend(sf, group, glen);
+    stateBatchAppend(sf, skill, klen);
+    stateBatchAppend(sf, p, sizeof(NUMBER)*(size_t)sf->h.nS);
+    sf->batch_records++;
+}
+
+void commitStateFile(struct state_file *sf) {
+    if(sf->batch_records == 0) return;
+    struct state_log_batch b;
+    memset(&b, 0, sizeof(struct state_log_batch));
+    memcpy(b.magic, STATE_LOG_MAGIC, 4);
+    b.checksum = hashString(sf->batch, sf->batch_n);
+    b.size = (unsigned long long)sf->batch_n;
+    b.records = sf->batch_records;
+    bool ok = write(sf->log_fd, &b, sizeof(struct state_log_batch)) == (ssize_t)sizeof(struct state_log_batch);
+    for(size_t off=0; ok && off<sf->batch_n; ) {
+        ssize_t r = write(sf->log_fd, sf->batch + off, sf->batch_n - off);
+        ok = r > 0;
+        if(ok) off += (size_t)r;
+    }
+    if( !ok || fsync(sf->log_fd) != 0 ) {
+        fprintf(stderr,"Error writing the log of state file %s\n",sf->filename);
+        exit(1);
+    }
+    stateApply(sf);
+    stateEmptyLog(sf);
+}
+
+NDAT readStates(struct state_file *sf, struct state_store *ss, const struct vocab *voc_group, const struct vocab *voc_skill, NDAT from) {
+    NDAT found = 0;
+    for(NDAT ix=from; ix<ss->n; ix++) {
+        if(ss->set[ix] != 0) continue;
+        NCAT g = ss->g[ix], k = ss->k[ix];
+        if( getStateFile(sf, vocabString(voc_group, g), vocabLength(voc_group, g), vocabString(voc_skill, k), vocabLength(voc_skill, k), &ss->p[ (size_t)ix*ss->nS ]) ) {
+            ss->set[ix] = 1;
+            found++;
+        }
+    }
+    return found;
+}
+
+void writeStates(struct state_file *sf, struct state_store *ss, const struct vocab *voc_group, const struct vocab *voc_skill, const NDAT *ix, NDAT n) {
+    if(ix == NULL) n = ss->n;
+    for(NDAT i=0; i<n; i++) {
+        NDAT x = (ix == NULL)?i:ix[i];
+        if(ix == NULL && ss->set[x] == 0) continue;
+        NCAT g = ss->g[x], k = ss->k[x];
+        putStateFile(sf, vocabString(voc_group, g), vocabLength(voc_group, g), vocabString(voc_skill, k), vocabLength(voc_skill, k), &ss->p[ (size_t)x*ss->nS ]);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ 
+ Copyright (c) 2012-2015, Michael (Mikhail) Yudelson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Michael (Mikhail) Yudelson nor the
+ names of other contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+//
+// knowledge states kept across runs: p(L) of student-skill pairs by their labels, in a memory-mapped file that is
+// updated in place, with a write-ahead log of the updates that are not in it yet
+//
+
+#ifndef __HMM__StateFile__
+#define __HMM__StateFile__
+
+#include "utils.h"
+
+#define state_file_version 1
+#define STATE_FILE_MAGIC "BKTS" // first bytes of a state file
+#define STATE_LOG_MAGIC "BKTL"  // first bytes of a batch in the log of a state file
+#define STATE_FILE_ALIGN 64     // alignment of sections in the state file
+#define STATE_FILE_SLOT 4096    // bytes of each of the two header slots, a page each
+
+// sections of the state file, each is allocated for the capacity in the header, not just what is used
+enum STATE_FILE_SECTION {
+    SFS_PAIR_G, SFS_PAIR_K, SFS_PAIR_P, SFS_PAIR_TABLE, // pairs: ids of student and skill labels, p(L) (nS each), hash table
+    SFS_G_ARENA, SFS_G_OFFSET, SFS_G_HASH, SFS_G_TABLE, // student labels with their hash table (struct vocab)
+    SFS_K_ARENA, SFS_K_OFFSET, SFS_K_HASH, SFS_K_TABLE, // skill labels with their hash table
+    SFS_NUM
+};
+
+// header of the state file, written to the slot seq%2, so a header torn by a crash leaves the other one
+struct state_file_header {
+    char magic[4];          // STATE_FILE_MAGIC
+    char version;
+    char size_t_size;       // sizeof(size_t) of the writer, label offsets are size_t
+    char number_size;       // sizeof(NUMBER) of the writer
+    NPAR nS;
+    unsigned long long seq; // the valid slot with the larger one is current
+    NDAT n, cap;            // pairs, and room for them (a power of 2, the hash table is twice that)
+    NCAT nG, capG, nK, capK;// labels, and room for them (powers of 2)
+    unsigned long long sizeG, capacityG, sizeK, capacityK; // bytes of the labels, and room for them
+    unsigned int checksum;  // FNV-1a of the header with this set to 0
+    unsigned long long section[SFS_NUM][2]; // offset from the start of the file and size, in bytes
+};
+
+// batch of updates in the log, followed by its records, each: unsigned int lengths of the student and skill labels,
+// the labels, nS NUMBERs of p(L); a batch is applied whole or not at all
+struct state_log_batch {
+    char magic[4];          // STATE_LOG_MAGIC
+    unsigned int checksum;  // FNV-1a of the records
+    unsigned long long size;// bytes of the records
+    NDAT records;
+};
+
+// open state file: the mapping, views of its labels and pairs, and a batch of updates being put together
+struct state_file {
+    char *filename;
+    int fd, log_fd;         // the file, and its log (filename.log, locked while the state file is open)
+    char *base;
+    size_t size;
+    struct state_file_header h;
+    struct vocab *voc_group, *voc_skill; // over the mapping
+    struct state_store pairs; // over the mapping, set is not used
+    char *batch;            // records: label lengths, labels, p(L)
+    size_t batch_n, batch_cap;
+    NDAT batch_records;
+};
+
+struct state_file* openStateFile(const char *filename, NPAR nS); // created if there is none, updates left in the log are applied
+void closeStateFile(struct state_file *sf); // updates that were not committed are dropped
+bool getStateFile(struct state_file *sf, const char *group, size_t glen, const char *skill, size_t klen, NUMBER *p); // p(L) of a pair, false if not there
+void putStateFile(struct state_file *sf, const char *group, size_t glen, const char *skill, size_t klen, const NUMBER *p); // to the batch
+void commitStateFile(struct state_file *sf); // the batch, to the log first, then into the file
+// p(L) of pairs from..n-1 of ss that are not set yet, from the state file, ids of ss are of voc_group and voc_skill;
+// number of pairs that were there
+NDAT readStates(struct state_file *sf, struct state_store *ss, const struct vocab *voc_group, const struct vocab *voc_skill, NDAT from);
+// p(L) of pairs ix[0..n-1] of ss, or all of them that are set if ix is NULL, to the batch of the state file
+void writeStates(struct state_file *sf, struct state_store *ss, const struct vocab *voc_group, const struct vocab *voc_skill, const NDAT *ix, NDAT n);
+
+#endif /* defined(__HMM__StateFile__) */
@@ -29,7 +29,10 @@
 
 /*
  * helper auto-expanded array without re-allocating the memory, by allocating 
- * chunks - stripes
+ * chunks - stripes; stripes grow geometrically (each new one is as large as the
+ * array so far), an array of known size is one stripe that can be handed off
+ * without copying (toArray), and arrays filled by separate threads can be merged
+ * by moving their stripes (merge)
  */
 
 #include <limits.h>
@@ -44,87 +47,92 @@
 
 #define NDAT_MAX INT_MAX
 typedef signed int NDAT;  // number of data rows, now 4 bill max
+#define STRIPE_MIN 1024   // size of the first stripe of an array that is grown by adding
 
 template <typename T>
 class StripedArray {
 public:
 	StripedArray();
-	StripedArray(NDAT _size); // predefined size
-	StripedArray(FILE *f, NDAT N);
+	StripedArray(NDAT _size); // predefined size, one stripe
+	StripedArray(FILE *f, NDAT N); // read N elements, into one stripe
 	~StripedArray();
 	NDAT getSize();
 	void add(T value);
+	void merge(StripedArray<T> *other); // append other (e.g. filled by another thread), moving its stripes, other is empty afterwards
 	T& operator [] (NDAT idx);
 	T get(NDAT idx);
 	void set(NDAT idx, T value);
 	void clear();
     NDAT toBinFile(FILE* f);
     static NDAT arrayToBinFile(T* ar, NDAT size, FILE* f);
-    T* toArray();
+    static T* binFileToArray(FILE* f, NDAT size); // read straight into a new array, NULL if there is less data
+    T* toArray(); // contiguous array, the stripe itself if there is one, the striped array is empty afterwards
+    void toArray(T* dest); // copy into dest
 private:
 	NDAT size; // linear
-	NDAT stripe_size;
 	NDAT nstripes;
-	NDAT size_last_stripe;
+	NDAT max_stripes; // stripe pointers allocated
 	T** stripes;
-	void addStripe();
+	NDAT *fill;  // elements in a stripe
+	NDAT *cap;   // size of a stripe
+	NDAT *start; // index of the first element of a stripe
+	void addStripe(NDAT stripe_size);
+	void morePointers();
+	NDAT findStripe(NDAT idx);
 };
 
 
 template <typename T>
 StripedArray<T>::StripedArray() {
 	this->size = 0;
-	this->stripe_size = 20000;
 	this->nstripes = 0;
-	this->size_last_stripe = 0;
+	this->max_stripes = 0;
 	this->stripes = NULL;
+	this->fill = NULL;
+	this->cap = NULL;
+	this->start = NULL;
 }
 
 // predefined size
 template <typename T>
 StripedArray<T>::StripedArray(NDAT _size) {
-	stripe_size = 20000;
-	size = _size;
-	nstripes = (NDAT)ceil((double)size/stripe_size);
-	size_last_stripe = (NDAT)fmod(size, (size_t)stripe_size);
-	stripes = (T **) calloc((size_t)nstripes, sizeof(T*));
-    NDAT num;
-    for(NDAT i=0; i<nstripes; i++) {
-        num = (i<(nstripes-1)?stripe_size:size_last_stripe);
-        stripes[i] = (T*)calloc((size_t)num, sizeof(T)); // alloc data
-    }
+	this->size = 0;
+	this->nstripes = 0;
+	this->max_stripes = 0;
+	this->stripes = NULL;
+	this->fill = NULL;
+	this->cap = NULL;
+	this->start = NULL;
+	if(_size > 0) {
+		addStripe(_size);
+		fill[0] = _size;
+		size = _size;
+	}
 }
 
 // from file
 template <typename T>
 StripedArray<T>::StripedArray(FILE *f, NDAT N) {
-	stripe_size = 20000;
-	size = N;
-	nstripes = (NDAT)ceil((double)N/stripe_size);
-	size_last_stripe = (NDAT)fmod(N, stripe_size);
-	stripes = (T **) calloc((size_t)nstripes, sizeof(T*));
-    NDAT num;
-    NDAT nread;
-    for(NDAT i=0; i<nstripes; i++) {
-        num = (i<(nstripes-1)?stripe_size:size_last_stripe);
-        stripes[i] = (T*)calloc((size_t)num, sizeof(T)); // alloc data
-        nread = (NDAT)fread (stripes[i], sizeof(T), (size_t)num, f);
-        if(nread != num) {
-            fprintf(stderr,"Error reading data from file\n");
-            return;
-        }
-    }
+	this->size = 0;
+	this->nstripes = 0;
+	this->max_stripes = 0;
+	this->stripes = NULL;
+	this->fill = NULL;
+	this->cap = NULL;
+	this->start = NULL;
+	if(N > 0) {
+		addStripe(N);
+		NDAT nread = (NDAT)fread (stripes[0], sizeof(T), (size_t)N, f);
+		if(nread != N)
+			fprintf(stderr,"Error reading data from file\n");
+		fill[0] = nread;
+		size = nread;
+	}
 }
 
 template <typename T>
 StripedArray<T>::~StripedArray() {
-	for(NDAT i=0; i<this->nstripes;i++) {
-		free(this->stripes[i]);
-    }
-	free(this->stripes);
-//	for(NDAT i=0; i<this->nstripes;i++)
-//		delete [] this->stripes[i];
-//	delete [] this->stripes;
+	clear();
 }
 
 template <typename T>
@@ -134,24 +142,72 @@ void StripedArray<T>::add(T value) {
 		return;
 	}
 	
-	// add stripe if necessary
-	if( this->nstripes==0 || this->size_last_stripe==this->stripe_size)
-		this->addStripe();
+	// add stripe if necessary, as large as the array so far
+	if( this->nstripes==0 || this->fill[this->nstripes-1]==this->cap[this->nstripes-1] )
+		this->addStripe( (this->size < STRIPE_MIN)?STRIPE_MIN:((this->size > NDAT_MAX/2)?NDAT_MAX-this->size:this->size) );
 	// place data
-	this->stripes[this->nstripes-1][this->size_last_stripe++] = value;
+	NDAT l = this->nstripes-1;
+	this->stripes[l][this->fill[l]++] = value;
 	this->size++;
 }
 
+template <typename T>
+void StripedArray<T>::merge(StripedArray<T> *other) {
+	if(other == this || other->nstripes == 0)
+		return;
+	if( (long long)this->size + other->size > NDAT_MAX-1) {
+		fprintf(stderr, "Error! Maximum array size reached.\n");
+		return;
+	}
+	for(NDAT i=0; i<other->nstripes; i++) {
+		if(this->nstripes == this->max_stripes)
+			morePointers();
+		NDAT l = this->nstripes++;
+		this->stripes[l] = other->stripes[i];
+		this->fill[l] = other->fill[i];
+		this->cap[l] = other->fill[i]; // stripes in the middle are not added to
+		this->start[l] = this->size;
+		this->size += other->fill[i];
+	}
+	free(other->stripes);
+	free(other->fill);
+	free(other->cap);
+	free(other->start);
+	other->size = 0;
+	other->nstripes = 0;
+	other->max_stripes = 0;
+	other->stripes = NULL;
+	other->fill = NULL;
+	other->cap = NULL;
+	other->start = NULL;
+}
+
 template <typename T>
 void StripedArray<T>::clear() {
 	for(NDAT i=0; i<this->nstripes;i++)
 		free(this->stripes[i]);
 	free(this->stripes);
+	free(this->fill);
+	free(this->cap);
+	free(this->start);
 	this->size = 0;
-	this->stripe_size = 20000;
 	this->nstripes = 0;
-	this->size_last_stripe = 0;
+	this->max_stripes = 0;
 	this->stripes = NULL;
+	this->fill = NULL;
+	this->cap = NULL;
+	this->start = NULL;
+}
+
+template <typename T>
+NDAT StripedArray<T>::findStripe(NDAT idx) { // last stripe that starts at or before idx
+	NDAT lo = 0, hi = this->nstripes-1, mid;
+	while(lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if(this->start[mid] <= idx) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
 }
 
 template <typename T>
@@ -160,13 +216,8 @@ T& StripedArray<T>::operator [](NDAT idx) {
 		fprintf(stderr, "   %d exceeds array size %d.\n",idx,this->size);
 		return NULL;
 	}
-	NDAT idx_stripe = idx / this->stripe_size;
-	NDAT idx_within = idx % this->stripe_size;
-//	if(idx_within>(this->size_last_stripe-1)) {
-//		fprintf(stderr, "Exception! Element index in last stripe %d exceeds sltipe size %d.\n",idx_within,this->size_last_stripe);
-//		return NULL;
-//	}
-	return this->stripes[idx_stripe][idx_within];
+	NDAT idx_stripe = findStripe(idx);
+	return this->stripes[idx_stripe][idx - this->start[idx_stripe]];
 }
 
 template <typename T>
@@ -175,13 +226,8 @@ T StripedArray<T>::get(NDAT idx) {
 		fprintf(stderr, "Exception! Element index %u exceeds array size %u\n",idx,this->size);
 		return (T)0;
 	}
-	NDAT idx_stripe = idx / this->stripe_size;
-	NDAT idx_within = idx % this->stripe_size;
-//	if(idx_within>(this->size_last_stripe-1)) {
-//		fprintf(stderr, "Exception! Element index in last stripe %d exceeds sltipe size %d\n",idx_within,this->size_last_stripe);
-//		return NULL;
-//	}
-	return this->stripes[idx_stripe][idx_within];
+	NDAT idx_stripe = findStripe(idx);
+	return this->stripes[idx_stripe][idx - this->start[idx_stripe]];
 }
 
 template <typename T>
@@ -190,13 +236,8 @@ void StripedArray<T>::set(NDAT idx, T value) {
 		fprintf(stderr, "Exception! Element index %u exceeds array size %u\n",idx,this->size);
 		return;
 	}
-	NDAT idx_stripe = idx / this->stripe_size;
-	NDAT idx_within = idx % this->stripe_size;
-    //	if(idx_within>(this->size_last_stripe-1)) {
-    //		fprintf(stderr, "Exception! Element index in last stripe %d exceeds sltipe size %d\n",idx_within,this->size_last_stripe);
-    //		return NULL;
-    //	}
-	this->stripes[idx_stripe][idx_within] = value;
+	NDAT idx_stripe = findStripe(idx);
+	this->stripes[idx_stripe][idx - this->start[idx_stripe]] = value;
 }
 
 
@@ -206,37 +247,34 @@ NDAT StripedArray<T>::getSize() {
 }
 
 template <typename T>
-void StripedArray<T>::addStripe() {
-	if(this->size_last_stripe<this->stripe_size && this->nstripes>0) {
-		fprintf(stderr, "Exception! You can only add stripes when none exits or previous is full.\n");
-		return;
-	}
-	
-	this->stripes = (T **) realloc(this->stripes,(size_t)(++this->nstripes)*sizeof(T*)); // add pointer
-//	T** new_stripes = Calloc(T*, (this->nstripes));
-//	memcpy(new_stripes, this->stripes, sizeof(T*)*this->nstripes );
-//	free(this->stripes);
-//	this->stripes = Malloc(T*,this->nstripes+1);
-//	memcpy(this->stripes, new_stripes, sizeof(T*)*this->nstripes );
-//	this->nstripes++;
-//	free(new_stripes);
-	
-//	this->stripes[this->nstripes-1] = Calloc(T, (size_t)this->stripe_size); // alloc data
-	this->stripes[this->nstripes-1] = (T*)calloc((size_t)this->stripe_size, sizeof(T)); // alloc data
-	this->size_last_stripe = 0; // reset counter
+void StripedArray<T>::morePointers() { // stripes grow geometrically, so there are few of them
+	this->max_stripes = (this->max_stripes==0)?32:2*this->max_stripes;
+	this->stripes = (T **) realloc(this->stripes, (size_t)this->max_stripes*sizeof(T*));
+	this->fill = (NDAT *) realloc(this->fill, (size_t)this->max_stripes*sizeof(NDAT));
+	this->cap = (NDAT *) realloc(this->cap, (size_t)this->max_stripes*sizeof(NDAT));
+	this->start = (NDAT *) realloc(this->start, (size_t)this->max_stripes*sizeof(NDAT));
+}
+
+template <typename T>
+void StripedArray<T>::addStripe(NDAT stripe_size) {
+	if(this->nstripes == this->max_stripes)
+		morePointers();
+	NDAT l = this->nstripes++;
+	this->stripes[l] = (T*)calloc((size_t)stripe_size, sizeof(T)); // alloc data
+	this->fill[l] = 0; // reset counter
+	this->cap[l] = stripe_size;
+	this->start[l] = this->size;
 }
 
 template <typename T>
 NDAT StripedArray<T>::toBinFile(FILE *f) {
-    NDAT num;
     NDAT nwrit;
     NDAT all_nwrit = 0;
     for(NDAT i=0; i<nstripes; i++) {
-        num = (NDAT)(i<(nstripes-1))?stripe_size:size_last_stripe;
-        nwrit = (NDAT)fwrite (stripes[i] , sizeof(T), (size_t)num, f);
+        nwrit = (NDAT)fwrite (stripes[i] , sizeof(T), (size_t)fill[i], f);
         all_nwrit += nwrit;
-        if(num != nwrit) {
-            fprintf(stderr, "Error writing. Attempted to write %u but %u were written.\n",num, nwrit);
+        if(fill[i] != nwrit) {
+            fprintf(stderr, "Error writing. Attempted to write %u but %u were written.\n",fill[i], nwrit);
             return 0;
         }
     }
@@ -248,15 +286,34 @@ NDAT StripedArray<T>::arrayToBinFile(T* ar, NDAT size, FILE* f) {
     return (NDAT)fwrite (ar, sizeof(T), (size_t)size, f);
 }
 
+template <typename T>
+T* StripedArray<T>::binFileToArray(FILE* f, NDAT size) {
+    T *result = (T*)malloc( (size_t)size*sizeof(T));
+    if( (NDAT)fread (result, sizeof(T), (size_t)size, f) != size ) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
 template <typename T>
 T* StripedArray<T>::toArray() {
-    T *result = (T*)malloc( (size_t)this->size*sizeof(T));
-    for(NDAT i=0; i<this->nstripes; i++) {
-        T* dest = &result[ i*this->stripe_size ];
-        size_t sz = sizeof(T)*( (i<(this->nstripes-1))?this->stripe_size:this->size_last_stripe );
-        memcpy( dest, this->stripes[i], sz );
+    T *result;
+    if(this->nstripes == 1) { // hand off
+        result = this->stripes[0];
+        this->nstripes = 0;
+    } else {
+        result = (T*)malloc( (size_t)this->size*sizeof(T));
+        toArray(result);
     }
+    clear();
     return result;
 }
 
+template <typename T>
+void StripedArray<T>::toArray(T* dest) {
+    for(NDAT i=0; i<this->nstripes; i++)
+        memcpy( &dest[ this->start[i] ], this->stripes[i], sizeof(T)*(size_t)this->fill[i] );
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,372 @@
+/*
+
+ Copyright (c) 2012-2015, Michael (Mikhail) Yudelson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Michael (Mikhail) Yudelson nor the
+ names of other contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//
+//  libbkt: the C interface (bkt.h) over HMMProblem, the caller's columns become the row arrays of a param
+//
+
+#include <string.h>
+#include <stdio.h>
+#include "utils.h"
+#include "HMMProblem.h"
+#include "bkt.h"
+
+// the caller's arrays are used as the row arrays as they are
+typedef char bkt_check_npar[(sizeof(NPAR)==sizeof(signed char))?1:-1];
+typedef char bkt_check_ncat[(sizeof(NCAT)==sizeof(int))?1:-1];
+typedef char bkt_check_ndat[(sizeof(NDAT)==sizeof(int))?1:-1];
+typedef char bkt_check_number[(sizeof(NUMBER)==sizeof(double))?1:-1];
+
+struct bkt_model {
+    struct param param; // sizes, options, and labels of a loaded model; row arrays only during a call
+    HMMProblem *hmm;
+};
+
+static bkt_model* bktNew() {
+    bkt_model *m = Calloc(bkt_model, 1);
+    set_param_defaults(&m->param);
+    m->hmm = NULL;
+    return m;
+}
+
+// copy the options into p; those of fitting only if fit
+static bool bktOptions(struct param *p, const bkt_options *o, bool fit) {
+    p->parallel = (NPAR)(o->parallel!=0);
+    p->reproducible = (NPAR)(o->reproducible!=0);
+    p->quiet = (NPAR)(o->quiet!=0);
+    p->metrics_target_obs = (NPAR)o->metrics_target_obs;
+    p->update_known = o->update_known;
+    p->update_unknown = o->update_unknown;
+    if( (p->update_known!='r' && p->update_known!='g') || (p->update_unknown!='t' && p->update_unknown!='g') ) {
+        fprintf(stderr,"p(L) update should be 'r' or 'g' with known observations, 't' or 'g' with unknown ones\n");
+        return false;
+    }
+    if(p->metrics_target_obs < 0) {
+        fprintf(stderr,"target observation to compute metrics against cannot be '%d'\n",p->metrics_target_obs+1);
+        return false;
+    }
+    if(!fit)
+        return true;
+    p->structure = (NPAR)o->structure;
+    p->solver = (NPAR)o->solver;
+    p->solver_setting = (NPAR)o->solver_setting;
+    p->nS = (NPAR)o->nS;
+    p->maxiter = o->maxiter;
+    p->tol = o->tol;
+    if( p->structure != STRUCTURE_SKILL && p->structure != STRUCTURE_GROUP ) {
+        fprintf(stderr, "Model Structure specified (%d) is out of range of allowed values\n",p->structure);
+        return false;
+    }
+    if( p->solver != METHOD_BW  && p->solver != METHOD_GD && p->solver != METHOD_CGD && p->solver != METHOD_GDL && p->solver != METHOD_GBB ) {
+        fprintf(stderr, "Method specified (%d) is out of range of allowed values\n",p->solver);
+        return false;
+    }
+    if( p->solver == METHOD_CGD && p->solver_setting != -1 &&
+       ( p->solver_setting != 1 && p->solver_setting != 2 && p->solver_setting != 3 && p->solver_setting != 4 ) ) {
+        fprintf(stderr, "Conjugate Gradient Descent setting specified (%d) is out of range of allowed values\n",p->solver_setting);
+        return false;
+    }
+    if(o->nS < 2 || o->nS > 127 || o->nO < 0 || o->nO > 127 || o->maxiter < 1) {
+        fprintf(stderr,"Number of states should be 2 to 127, of observations 0 to 127, of iterations 1 or more\n");
+        return false;
+    }
+    return true;
+}
+
+// the rows as the row arrays of p, only counts of skills of rows are made if there are several skills per row;
+// largest student, skill, and observation are in max_g, max_k, max_o
+static bool bktData(struct param *p, const bkt_data *d, NCAT *max_g, NCAT *max_k, int *max_o) {
+    if( d == NULL || d->N < 1 || d->obs == NULL || d->group == NULL ||
+       (d->skill_offset == NULL && d->skill == NULL) || (d->skill_offset != NULL && d->skills == NULL) ) {
+        fprintf(stderr,"Data should have rows, and observations, students, and skills of them\n");
+        return false;
+    }
+    bool multi = d->skill_offset != NULL;
+    NDAT N = d->N, N_null = 0, t;
+    NCAT mg = -1, mk = -1;
+    int mo = -1;
+    bool ok = !multi || d->skill_offset[0]==0;
+    for(t=0; t<N && ok; t++) {
+        const int *ar = multi?&d->skills[ d->skill_offset[t] ]:&d->skill[t];
+        int n = multi?d->skill_offset[t+1]-d->skill_offset[t]:1;
+        if(d->group[t] > mg) mg = d->group[t];
+        if(d->obs[t] > mo) mo = d->obs[t];
+        ok = d->group[t] >= 0 && n >= 1 && ar[0] >= -1 && (ar[0] >= 0 || n == 1);
+        if(ok && ar[0] < 0)
+            N_null++;
+        for(int l=0; l<n && ok && ar[0] >= 0; l++) {
+            ok = ar[l] >= 0;
+            if(ar[l] > mk) mk = ar[l];
+        }
+    }
+    if(!ok) {
+        fprintf(stderr,"Data row %d: students should be 0 or more, skills too, or a lone -1 if there is none\n", t-1);
+        return false;
+    }
+    p->N = N;
+    p->N_null = N_null;
+    p->Nstacked = multi?d->skill_offset[N]:N_null; // as the input readers count them
+    p->multiskill = multi?'~':0;
+    p->dat_obs = (NPAR*)d->obs;
+    p->dat_group = (NCAT*)d->group;
+    p->dat_item = NULL;
+    p->dat_skill = multi?NULL:(NCAT*)d->skill;
+    p->dat_skill_stacked = multi?(NCAT*)d->skills:NULL;
+    p->dat_skill_rix = multi?(NDAT*)d->skill_offset:NULL;
+    p->dat_skill_rcount = NULL;
+    if(multi) {
+        p->dat_skill_rcount = Malloc(NCAT, (size_t)N);
+        for(t=0; t<N; t++)
+            p->dat_skill_rcount[t] = d->skill_offset[t+1]-d->skill_offset[t];
+    }
+    *max_g = mg;
+    *max_k = mk;
+    *max_o = mo;
+    return true;
+}
+
+// the caller's rows are not kept
+static void bktDataRelease(struct param *p) {
+    if(p->dat_skill_rcount != NULL) free(p->dat_skill_rcount);
+    p->dat_obs = NULL;
+    p->dat_group = NULL;
+    p->dat_skill = NULL;
+    p->dat_skill_stacked = NULL;
+    p->dat_skill_rcount = NULL;
+    p->dat_skill_rix = NULL;
+    p->N = 0;
+    p->N_null = 0;
+    p->Nstacked = 0;
+}
+
+void bkt_default_options(bkt_options *o) {
+    struct param p;
+    set_param_defaults(&p);
+    o->structure = p.structure;
+    o->solver = p.solver;
+    o->solver_setting = p.solver_setting;
+    o->nS = p.nS;
+    o->nO = 0;
+    o->maxiter = p.maxiter;
+    o->tol = p.tol;
+    o->init_params = NULL;
+    o->param_lo = NULL;
+    o->param_hi = NULL;
+    o->parallel = p.parallel;
+    o->reproducible = p.reproducible;
+    o->update_known = p.update_known;
+    o->update_unknown = p.update_unknown;
+    o->metrics_target_obs = p.metrics_target_obs;
+    o->quiet = 1;
+    destroy_input_data(&p);
+}
+
+bkt_model* bkt_fit(const bkt_data *data, const bkt_options *options) {
+    bkt_options def;
+    if(options == NULL) {
+        bkt_default_options(&def);
+        options = &def;
+    }
+    bkt_model *m = bktNew();
+    struct param *p = &m->param;
+    NCAT max_g, max_k;
+    int max_o;
+    if( !bktOptions(p, options, true) || !bktData(p, data, &max_g, &max_k, &max_o) ) {
+        bkt_free(m);
+        return NULL;
+    }
+    p->nG = max_g + 1;
+    p->nK = max_k + 1;
+    p->nO = (NPAR)( (options->nO>0)?options->nO:max_o+1 );
+    NPAR nS = p->nS, nO = p->nO;
+    bool ok = true;
+    if(p->nK < 1 || nO < 2 || max_o >= nO) {
+        fprintf(stderr,"Data should have rows with skills, and 2 or more observations, fewer than %d\n", nO);
+        ok = false;
+    } else if(p->metrics_target_obs > nO-1) {
+        fprintf(stderr,"target observation to compute metrics against cannot be '%d'\n",p->metrics_target_obs+1);
+        ok = false;
+    } else if(options->init_params == NULL && (nS!=2 || nO!=2)) {
+        fprintf(stderr,"Starting parameters should be given if there are not 2 states and 2 observations\n");
+        ok = false;
+    }
+    if(!ok) {
+        bktDataRelease(p);
+        bkt_free(m);
+        return NULL;
+    }
+    // starting parameters and boundaries, as trainhmm sets them once nO is known
+    int n_init = (nS-1) + nS*(nS-1) + nS*(nO-1), n_lim = nS*(1+nS+nO);
+    if(options->init_params != NULL) {
+        free(p->init_params);
+        p->init_params = Malloc(NUMBER, (size_t)n_init);
+        memcpy(p->init_params, options->init_params, sizeof(NUMBER)*(size_t)n_init);
+    }
+    if(options->param_lo != NULL || nS!=2 || nO!=2) {
+        free(p->param_lo);
+        p->param_lo = Calloc(NUMBER, (size_t)n_lim);
+        if(options->param_lo != NULL)
+            memcpy(p->param_lo, options->param_lo, sizeof(NUMBER)*(size_t)n_lim);
+        p->lo_lims_specd = options->param_lo != NULL;
+    }
+    if(options->param_hi != NULL || nS!=2 || nO!=2) {
+        free(p->param_hi);
+        p->param_hi = Calloc(NUMBER, (size_t)n_lim);
+        for(int j=0; j<n_lim; j++)
+            p->param_hi[j] = (options->param_hi != NULL)?options->param_hi[j]:(NUMBER)1.0;
+        p->hi_lims_specd = options->param_hi != NULL;
+    }
+
+    structure_data(p);
+    zeroLabels(p);
+    m->hmm = new HMMProblem(p);
+    m->hmm->fit();
+    // the model keeps its parameters, not the data
+    destroy_structured_data(p);
+    bktDataRelease(p);
+    return m;
+}
+
+bkt_model* bkt_load(const char *filename, const bkt_options *options) {
+    bkt_options def;
+    if(options == NULL) {
+        bkt_default_options(&def);
+        options = &def;
+    }
+    FILE *fid = fopen(filename,"rb");
+    if(fid == NULL) {
+        fprintf(stderr,"Can't read model file %s\n",filename);
+        return NULL;
+    }
+    fclose(fid);
+    bkt_model *m = bktNew();
+    if( !bktOptions(&m->param, options, false) ) {
+        bkt_free(m);
+        return NULL;
+    }
+    m->hmm = HMMProblem::loadModel(filename, &m->param);
+    return m;
+}
+
+int bkt_save(bkt_model *m, const char *filename, int binary) {
+    struct param *p = &m->param;
+    FILE *fid = fopen(filename,"w");
+    if(fid == NULL) {
+        fprintf(stderr,"Can't write output model file %s\n",filename);
+        return -1;
+    }
+    fclose(fid);
+    // a model fit here has no labels, its ids are
+    bool by_group = p->structure==STRUCTURE_GROUP;
+    struct vocab **labels = by_group?&p->voc_group:&p->voc_skill;
+    if(*labels == NULL) {
+        char s[16];
+        *labels = newVocab();
+        for(NCAT x=0; x<(by_group?p->nG:p->nK); x++)
+            addVocab(*labels, s, (size_t)snprintf(s, sizeof(s), "%d", x));
+    }
+    p->binarymodel = (binary!=0)?1:0;
+    m->hmm->toFile(filename);
+    return 0;
+}
+
+void bkt_free(bkt_model *m) {
+    if(m == NULL)
+        return;
+    if(m->hmm != NULL)
+        delete m->hmm;
+    destroy_input_data(&m->param);
+    free(m);
+}
+
+void bkt_model_size(const bkt_model *m, int *structure, int *nX, int *nS, int *nO) {
+    const struct param *p = &m->param;
+    if(structure != NULL) *structure = p->structure;
+    if(nX != NULL) *nX = (p->structure==STRUCTURE_GROUP)?p->nG:p->nK;
+    if(nS != NULL) *nS = p->nS;
+    if(nO != NULL) *nO = p->nO;
+}
+
+int bkt_skill_id(const bkt_model *m, const char *label) {
+    return (m->param.voc_skill==NULL)?-1:findVocab(m->param.voc_skill, label, strlen(label));
+}
+
+int bkt_group_id(const bkt_model *m, const char *label) {
+    return (m->param.voc_group==NULL)?-1:findVocab(m->param.voc_group, label, strlen(label));
+}
+
+void bkt_params(const bkt_model *m, double *pi, double *A, double *B) {
+    const struct param *p = &m->param;
+    NCAT nX = (p->structure==STRUCTURE_GROUP)?p->nG:p->nK;
+    size_t nS = (size_t)p->nS, nO = (size_t)p->nO;
+    NUMBER **PI = m->hmm->getPI(), ***AA = m->hmm->getA(), ***BB = m->hmm->getB();
+    for(NCAT x=0; x<nX; x++)
+        for(size_t i=0; i<nS; i++) {
+            if(pi != NULL)
+                pi[x*nS + i] = PI[x][i];
+            if(A != NULL)
+                memcpy(&A[(x*nS + i)*nS], AA[x][i], sizeof(NUMBER)*nS);
+            if(B != NULL)
+                memcpy(&B[(x*nS + i)*nO], BB[x][i], sizeof(NUMBER)*nO);
+        }
+}
+
+double bkt_neg_loglik(const bkt_model *m) {
+    return m->hmm->getLogLik();
+}
+
+int bkt_predict(bkt_model *m, const bkt_data *data, double *predictions, double *states, double *metrics) {
+    struct param *p = &m->param;
+    if(states != NULL && predictions == NULL) {
+        fprintf(stderr,"States of skills are kept with the predictions only\n");
+        return -1;
+    }
+    NCAT max_g, max_k;
+    int max_o;
+    if( !bktData(p, data, &max_g, &max_k, &max_o) )
+        return -1;
+    bool by_group = p->structure==STRUCTURE_GROUP;
+    if( max_o >= p->nO || p->metrics_target_obs > p->nO-1 || (by_group && max_g >= p->nG) || (!by_group && max_k >= p->nK) ) {
+        fprintf(stderr,"Observations should be fewer than %d, %s fewer than %d, as in the model\n", p->nO,
+                by_group?"students":"skills", by_group?p->nG:p->nK);
+        bktDataRelease(p);
+        return -1;
+    }
+    // students (by skill) or skills (by student) the model does not have rows of are as many as the data have
+    NCAT nG = p->nG, nK = p->nK;
+    if(!by_group && max_g >= nG) p->nG = max_g + 1;
+    if(by_group && max_k >= nK) p->nK = max_k + 1;
+    p->predictions = (predictions==NULL)?0:((states==NULL)?1:2);
+    HMMProblem::predict(metrics, NULL, p->dat_obs, p->dat_group, p->dat_skill, p->dat_skill_stacked, p->dat_skill_rcount, p->dat_skill_rix, &m->hmm, 1, NULL, predictions, states, NULL);
+    p->nG = nG;
+    p->nK = nK;
+    p->predictions = 0;
+    bktDataRelease(p);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+
+ Copyright (c) 2012-2015, Michael (Mikhail) Yudelson
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Michael (Mikhail) Yudelson nor the
+ names of other contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+//
+//  C interface of libbkt: fitting and predicting in the caller's process, on the caller's arrays
+//
+//  Data are columns of rows, in the order of the input file rows would be. The arrays are the caller's: they are read
+//  where they are, not copied, and only during the call. Ids of students and skills are 0-based ints, the library
+//  does not see their labels. Errors are reported to stderr, as the executables do, and by the return value; an
+//  error inside the fitting itself (e.g. parameters that do not meet the constraints) exits the process, as it does
+//  in trainhmm. A model is not to be used by two calls at the same time.
+//
+
+#ifndef _BKT_H
+#define _BKT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BKT_API_VERSION 1
+
+typedef struct bkt_model bkt_model;
+
+typedef struct bkt_data {
+    int N;                      // rows
+    const signed char *obs;     // N observations, 0-based, negative if unknown
+    const int *group;           // N students
+    const int *skill;           // N skills, -1 if none; not read if skill_offset is given
+    const int *skill_offset;    // several skills per row: N+1 offsets of the rows' skills in skills, 0 first; or NULL
+    const int *skills;          // skill_offset[N] skills of the rows one after another, a lone -1 if none
+} bkt_data;
+
+typedef struct bkt_options {
+    int structure;              // 1 - by skill (default), 2 - by student
+    int solver;                 // 1 - Baum-Welch, 2 - gradient descent (default), 3 - conjugate gradient descent,
+                                // 4 - gradient descent with Lagrange step, 5 - Barzilai-Borwein
+    int solver_setting;         // conjugate gradient descent: 1 - Polak-Ribiere (default), 2 - Fletcher-Reeves,
+                                // 3 - Hestenes-Stiefel, 4 - Dai-Yuan; -1 - the default
+    int nS;                     // hidden states, 2 by default
+    int nO;                     // observations, 0 (default) - the largest in the data + 1
+    int maxiter;                // iterations, 200 by default
+    double tol;                 // tolerance of the stopping criterion, 0.01 by default
+    const double *init_params;  // (nS-1) + nS*(nS-1) + nS*(nO-1) starting PI, A, B; NULL - 0.5, 1,0.4, 0.8,0.2 (2 by 2)
+    const double *param_lo;     // nS*(1+nS+nO) lower boundaries of PI, A, B; NULL - the default ones
+    const double *param_hi;     // nS*(1+nS+nO) upper boundaries
+    int parallel;               // 1 - fit and predict in parallel (OpenMP), 0 - not (default)
+    int reproducible;           // 1 - parallel sums do not depend on the number of threads
+    char update_known;          // predicting, p(L) update as predicthmm -U: 'r' - by the observation (default), unknown
+                                // ones by transition only; 'g' - by a guess, whether the observation is known or not
+    char update_unknown;        // 't' (default) or 'g', checked as in predicthmm -U, prediction does not use it
+    int metrics_target_obs;     // observation the metrics are computed against, 0-based, 0 by default
+    int quiet;                  // 1 - nothing to stdout (default)
+} bkt_options;
+
+void bkt_default_options(bkt_options *options);
+
+// fit a model, NULL if the data or the options are wrong
+bkt_model* bkt_fit(const bkt_data *data, const bkt_options *options);
+// read a model file (text or binary) written by trainhmm or bkt_save; only the prediction options are used, may be NULL
+bkt_model* bkt_load(const char *filename, const bkt_options *options);
+// write a model file, binary!=0 - in the binary format; ids are the labels if the model was fit by bkt_fit
+int bkt_save(bkt_model *model, const char *filename, int binary);
+void bkt_free(bkt_model *model);
+
+// rows of parameters: skills (structure 1) or students (structure 2)
+void bkt_model_size(const bkt_model *model, int *structure, int *nX, int *nS, int *nO);
+// id of a skill or student label of a loaded model, -1 if there is none
+int bkt_skill_id(const bkt_model *model, const char *label);
+int bkt_group_id(const bkt_model *model, const char *label);
+// copies of PI (nX by nS), A (nX by nS by nS), B (nX by nS by nO), row-major; any of them can be NULL
+void bkt_params(const bkt_model *model, double *pi, double *A, double *B);
+// negative log-likelihood of the data the model was fit to, 0 if loaded
+double bkt_neg_loglik(const bkt_model *model);
+
+// predict the rows in order, updating p(L) of student-skill pairs as predicthmm does, all from the model's starting
+// p(L); predictions - N by nO, or NULL; states - p(L) of the row's skills after the row (N, or skill_offset[N]
+// entries), rows without a skill are not written, or NULL; predictions cannot be NULL if states are not;
+// metrics - 6: LL, LL without rows with no skill, RMSE, RMSE without them, accuracy, accuracy without them, or NULL;
+// 0 if predicted, otherwise -1
+int bkt_predict(bkt_model *model, const bkt_data *data, double *predictions, double *states, double *metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,6 +37,8 @@ using namespace std;
 
 char source_format = 't';
 char target_format = 'b';
+char bin_version = bin_input_file_verstion;
+bool bin_compress = false;
 struct param param;
 
 void exit_with_help() {
@@ -47,6 +49,16 @@ void exit_with_help() {
 		   "-t : target file format 't' - text, 'b' - binary  (default is 'b' - binary)\n"
            "-d : delimiter for multiple skills per observation; 0-single skill per\n"
            "     observation (default), otherwise -- delimiter character, e.g. '-d ~'.\n"
+           "-v : version of the binary file, 4 (default) - mapped into memory by\n"
+           "     trainhmm and predicthmm, with the sequences of the data precomputed,\n"
+           "     3 - read into memory, for older versions of the tools.\n"
+           "-c : compress the binary file (version 4), default - 0 (no), 1 - yes,\n"
+           "     observations are bit-packed, ids are delta- and run-length coded and\n"
+           "     decoded when read (in parallel with -P 1), sequences are not stored.\n"
+           "-P : use parallel processing, defaul - 0 (no parallel processing), 1 -\n"
+           "     parse chunks of the text file separately.\n"
+           "-T : number of threads for parallel processing (-P 1), default - 0\n"
+           "     (OpenMP default, e.g. OMP_NUM_THREADS or the number of cores).\n"
 		   );
 	exit(1);
 }
@@ -54,7 +66,7 @@ void exit_with_help() {
 void parse_arguments(int argc, char **argv, char *input_file_name, char *output_file_name) {
 	// parse command line options, starting from 1 (0 is path to executable)
 	// go in pairs, looking at whether first in pair starts with '-', if not, stop parsing arguments
-	int i;
+	int i, n;
 	for(i=1;i<argc;i++)
 	{
 		if(argv[i][0] != '-') break; // end of options stop parsing
@@ -78,6 +90,38 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *output_
 				break;
             case  'd':
 				param.multiskill = argv[i][0]; // just grab first character (later, maybe several)
+                break;
+            case  'v':
+				n = atoi(argv[i]);
+                if(n!=3 && n!=4) {
+					fprintf(stderr,"version of the binary file (-v) should be 3 or 4\n");
+					exit_with_help();
+                }
+                bin_version = (char)n;
+                break;
+            case  'c':
+				n = atoi(argv[i]);
+                if(n!=0 && n!=1) {
+					fprintf(stderr,"compression flag (-c) should be 0 or 1\n");
+					exit_with_help();
+                }
+                bin_compress = n==1;
+                break;
+            case  'P':
+				n = atoi(argv[i]);
+                if(n!=0 && n!=1) {
+					fprintf(stderr,"parallel processing flag (-P) should be 0 or 1\n");
+					exit_with_help();
+                }
+                param.parallel = (NPAR)n;
+                break;
+            case  'T':
+				n = atoi(argv[i]);
+                if(n<0) {
+					fprintf(stderr,"number of threads (-T) should be non-negative\n");
+					exit_with_help();
+                }
+                param.num_threads = n;
                 break;
 			default:
 				fprintf(stderr,"unknown option: -%c\n", argv[i-1][1]);
@@ -90,6 +134,10 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *output_
         fprintf(stderr,"ERROR! source and target formats should not be the same");
         exit_with_help();
     }
+    if( bin_compress && bin_version < 4) {
+        fprintf(stderr,"ERROR! only version 4 of the binary file can be compressed\n");
+        exit_with_help();
+    }
 	
 	// next argument should be input file name
 	if(i>=argc) // if not
@@ -110,16 +158,21 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *output_
 
 int main (int argc, char ** argv) {
     
-	clock_t tm0 = clock();
+	double tm0 = omp_get_wtime();
 	char input_file[1024];
 	char output_file[1024];
     
 	set_param_defaults(&param);
 	parse_arguments(argc, argv, input_file, output_file);
+    if(param.num_threads>0)
+        omp_set_num_threads(param.num_threads);
     
     if( source_format=='t') {
-        InputUtil::readTxt(input_file, &param);
-        InputUtil::toBin(&param, output_file);
+        if( !InputUtil::readTxt(input_file, &param) )
+            return 1;
+        if(bin_version >= 4 && !bin_compress) // sequences are stored too
+            structure_data(&param);
+        InputUtil::toBin(&param, output_file, bin_version, bin_compress);
     }
     else {
         InputUtil::readBin(input_file, &param);
@@ -128,7 +181,7 @@ int main (int argc, char ** argv) {
 	destroy_input_data(&param);
 	
 	if(param.quiet == 0)
-		printf("overall time running is %8.6f seconds\n",(NUMBER)(clock()-tm0)/CLOCKS_PER_SEC);
+		printf("overall time running is %8.6f seconds\n",omp_get_wtime()-tm0);
     return 0;
 }
 
@@ -0,0 +1,133 @@
+/*
+ 
+ Copyright (c) 2012-2015, Michael (Mikhail) Yudelson
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of the Michael (Mikhail) Yudelson nor the
+ names of other contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+//
+//  The main executable of the model conversion utility
+//
+
+#include "utils.h"
+#include "HMMProblem.h"
+using namespace std;
+
+char source_format = 't';
+char target_format = 'b';
+struct param param;
+
+void exit_with_help() {
+	printf(
+		   "Usage: modelconvert [options] source_file [target_file]\n"
+		   "options:\n"
+		   "-s : source model format 't' - text, 'b' - binary  (default is 't' - text)\n"
+		   "-t : target model format 't' - text, 'b' - binary  (default is 'b' - binary)\n"
+           "     Binary models are written by trainhmm with '-M 1' and are read by\n"
+           "     predicthmm and trainhmm (-0) just as text models are.\n"
+		   );
+	exit(1);
+}
+
+void parse_arguments(int argc, char **argv, char *input_file_name, char *output_file_name) {
+	// parse command line options, starting from 1 (0 is path to executable)
+	// go in pairs, looking at whether first in pair starts with '-', if not, stop parsing arguments
+	int i;
+	for(i=1;i<argc;i++)
+	{
+		if(argv[i][0] != '-') break; // end of options stop parsing
+		if(++i>=argc)
+			exit_with_help();
+		switch(argv[i-1][1])
+		{
+			case 's':
+				source_format = argv[i][0];
+                if( source_format!='t' && source_format!='b') {
+					fprintf(stderr,"ERROR! source format should be either text 't', or binary 'b'\n");
+					exit_with_help();
+				}
+				break;
+			case 't':
+				target_format = argv[i][0];
+                if( target_format!='t' && target_format!='b') {
+					fprintf(stderr,"ERROR! target format should be either text 't', or binary 'b'\n");
+					exit_with_help();
+				}
+				break;
+			default:
+				fprintf(stderr,"unknown option: -%c\n", argv[i-1][1]);
+				exit_with_help();
+				break;
+		}
+	}
+//    post-argument checks
+    if( source_format == target_format) {
+        fprintf(stderr,"ERROR! source and target formats should not be the same");
+        exit_with_help();
+    }
+	
+	// next argument should be input file name
+	if(i>=argc) // if not
+		exit_with_help(); // leave
+	
+	strcpy(input_file_name, argv[i++]); // copy and advance
+	
+	if(i>=argc) { // no output file name specified
+        if(target_format=='b')
+            strcpy(output_file_name,"model.bin");
+        else
+            strcpy(output_file_name,"model.txt");
+	} else {
+		strcpy(output_file_name,argv[i++]); // copy and advance
+    }
+
+}
+
+int main (int argc, char ** argv) {
+    
+	double tm0 = omp_get_wtime();
+	char input_file[1024];
+	char output_file[1024];
+    
+	set_param_defaults(&param);
+	parse_arguments(argc, argv, input_file, output_file);
+    
+    if( (source_format=='b') != HMMProblem::isModelBin(input_file) ) {
+        fprintf(stderr,"ERROR! %s is not a %s model file\n", input_file, (source_format=='b')?"binary":"text");
+        return 1;
+    }
+    // read the whole model, labels too, and write it in the other format
+    HMMProblem *hmm = HMMProblem::loadModel(input_file, &param);
+    param.binarymodel = (target_format=='b')?1:0;
+    hmm->toFile(output_file);
+    delete hmm;
+	// free data
+	destroy_input_data(&param);
+	
+	if(param.quiet == 0)
+		printf("overall time running is %8.6f seconds\n",omp_get_wtime()-tm0);
+    return 0;
+}
+
@@ -36,36 +36,56 @@
 #include <time.h>
 #include <map>
 #include <list>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "utils.h"
 #include "HMMProblem.h"
 #include "InputUtil.h"
+#include "StateFile.h"
 using namespace std;
 
 #define COLUMNS 4
+#define SERVE_MAX_CLIENTS 64 // connections to the socket served at a time
+#define SERVE_MAX_PENDING (1<<26) // bytes of answers a connection has not taken yet, before its requests wait
 
 struct param param;
 static char *line = NULL;
 NUMBER* metrics;
-map<string,NCAT> data_map_group_fwd;
-map<NCAT,string> data_map_group_bwd;
-map<string,NCAT> map_step;
-map<string,NCAT> model_map_skill_fwd;
-map<NCAT,string> model_map_skill_bwd;
+char serve_path[1024]; // resident server: Unix domain socket, or '-' for stdin and stdout
+char state_path[1024]; // state file p(L) of student-skill pairs are carried in from run to run
 void exit_with_help();
 void parse_arguments(int argc, char **argv, char *input_file_name, char *model_file_name, char *predict_file_name);
 void read_predict_data(const char *filename);
 void predict(const char *predict_file, HMMProblem *hmm);
+int serve(const char *path, HMMProblem *hmm);
 
 int main (int argc, char ** argv) {
-	clock_t tm0 = clock();
-	printf("predicthmm starting...\n");
+	double tm0 = omp_get_wtime();
 	set_param_defaults(&param);
 	
 	char input_file[1024];
 	char model_file[1024];
 	char predict_file[1024];
 	
+	serve_path[0] = 0;
+	state_path[0] = 0;
 	parse_arguments(argc, argv, input_file, model_file, predict_file);
+    if(serve_path[0] != 0) { // no input file, requests come as they are
+        HMMProblem *hmm = HMMProblem::loadModel(model_file, &param);
+        int ret = serve(serve_path, hmm);
+        delete hmm;
+        destroy_input_data(&param);
+        return ret;
+    }
+	printf("predicthmm starting...\n");
+    if(param.num_threads>0)
+        omp_set_num_threads(param.num_threads);
     // param.predictions = 2; // do not force it on
 
     // read data
@@ -76,25 +96,34 @@ int main (int argc, char ** argv) {
     }
     
     // read model header
-	FILE *fid = fopen(model_file,"r");
-	if(fid == NULL)
-	{
-		fprintf(stderr,"Can't read model file %s\n",model_file);
-		exit(1);
-	}
+	FILE *fid = NULL;
+    struct bin_model *bm = NULL; // binary model, its rows are read for the labels of the data only
 	int max_line_length = 1024;
 	char *line = Malloc(char,(size_t)max_line_length);
 	NDAT line_no = 0;
     struct param param_model;
     set_param_defaults(&param_model);
     bool overwrite = false;
+    if( HMMProblem::isModelBin(model_file) )
+        bm = HMMProblem::openModelBin(model_file, &param_model);
+    else {
+        fid = fopen(model_file,"r");
+        if(fid == NULL)
+        {
+            fprintf(stderr,"Can't read model file %s\n",model_file);
+            exit(1);
+        }
 //    if(overwrite)
         readSolverInfo(fid, &param_model, &line_no);
 //    else
 //        readSolverInfo(fid, &initparam, &line_no);
+    }
     
     // copy partial info from param_model to param
     if(param.nO==0) param.nO = param_model.nO;
+    
+    // parameters are by skill or by group as in the model
+    param.structure = param_model.structure;
 	
     // copy number of states from the model
     param.nS = param_model.nS;
@@ -115,21 +144,49 @@ int main (int argc, char ** argv) {
             break;
     }
     // read model body
-    hmm->readModelBody(fid, &param_model, &line_no, overwrite);
-  	fclose(fid);
+    if(bm != NULL) {
+        hmm->readModelBin(bm, overwrite);
+        HMMProblem::closeModelBin(bm);
+    } else {
+        hmm->readModelBody(fid, &param_model, &line_no, overwrite);
+        fclose(fid);
+    }
 	free(line);
     
 	if(param.quiet == 0)
         printf("input read, nO=%d, nG=%d, nK=%d, nI=%d\n",param.nO, param.nG, param.nK, param.nI);
 	
-	clock_t tm = clock();
+	double tm = omp_get_wtime();
 //    if(param.metrics>0 || param.predictions>0) {
         metrics = Calloc(NUMBER, (size_t)7);// LL, AIC, BIC, RMSE, RMSEnonull, Acc, Acc_nonull;
 //    }
-	HMMProblem::predict(metrics, predict_file, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, &hmm, 1, NULL);
+    // p(L) of the pairs of the rows start where earlier runs left them, and are stored back
+    struct state_file *sf = NULL;
+    struct state_store states;
+    if(state_path[0] != 0) {
+        sf = openStateFile(state_path, param.nS);
+        initStateStore(&states, param.nS);
+        for(NDAT t=0; t<param.N; t++) {
+            NCAT *ar = (param.multiskill==0)?&param.dat_skill[t]:&param.dat_skill_stacked[ param.dat_skill_rix[t] ];
+            int n = (param.multiskill==0)?1:param.dat_skill_rcount[t];
+            if(ar[0]<0) continue; // null skill
+            for(int l=0; l<n; l++)
+                addState(&states, param.dat_group[t], ar[l]);
+        }
+        NDAT found = readStates(sf, &states, param.voc_group, param.voc_skill, 0);
+        if(param.quiet == 0)
+            printf("state file read, %d of %d student-skill pairs were there\n", found, states.n);
+    }
+	HMMProblem::predict(metrics, predict_file, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, &hmm, 1, NULL, NULL, NULL, (sf==NULL)?NULL:&states);
+    if(sf != NULL) {
+        writeStates(sf, &states, param.voc_group, param.voc_skill, NULL, 0);
+        commitStateFile(sf);
+        closeStateFile(sf);
+        freeStateStore(&states);
+    }
 //    predict(predict_file, hmm);
 	if(param.quiet == 0)
-		printf("predicting is done in %8.6f seconds\n",(NUMBER)(clock()-tm)/CLOCKS_PER_SEC);
+		printf("predicting is done in %8.6f seconds\n",omp_get_wtime()-tm);
     //if( param.predictions>0 ) {
         printf("trained model LL=%15.7f (%15.7f), AIC=%8.6f, BIC=%8.6f, RMSE=%8.6f (%8.6f), Acc=%8.6f (%8.6f)\n",
                metrics[0], metrics[1], // ll's
@@ -143,13 +200,14 @@ int main (int argc, char ** argv) {
 	
     delete hmm;
 	if(param.quiet == 0)
-		printf("overall time running is %8.6f seconds\n",(NUMBER)(clock()-tm0)/CLOCKS_PER_SEC);
+		printf("overall time running is %8.6f seconds\n",omp_get_wtime()-tm0);
     return 0;
 }
 
 void exit_with_help() {
 	printf(
 		   "Usage: predicthmm [options] input_file model_file [predicted_response_file]\n"
+		   "       predicthmm [options] -S socket_file|- model_file\n"
            "options:\n"
            "-q : quiet mode, without output, 0-no (default), or 1-yes\n"
            "-d : delimiter for multiple skills per observation; 0-single skill per\n"
@@ -172,6 +230,32 @@ void exit_with_help() {
            "     For examle, '-U g,g would require 'guessing' of what the observation was\n"
            "     using model parameters and the running value of the probabilities of state\n"
            "     distributions.\n"
+           "-P : use parallel processing, defaul - 0 (no parallel processing), 1 -\n"
+           "     predict separate students separately.\n"
+           "-T : number of threads for parallel processing (-P 1), default - 0\n"
+           "     (OpenMP default, e.g. OMP_NUM_THREADS or the number of cores).\n"
+           "-R : reproducible results of parallel processing, 0 - no (default, fastest),\n"
+           "     1 - metrics are summed in fixed blocks of students and a fixed order,\n"
+           "     so they do not depend on the number of threads.\n"
+           "-S : serve predictions, the model is read once and p(L) of student-skill\n"
+           "     pairs are kept in memory; requests are read from a Unix domain socket\n"
+           "     (created at the path given), or from stdin if '-' (answers to stdout).\n"
+           "     A request is a line of tab-separated fields, answers come in the order\n"
+           "     of requests, so they can be sent without waiting (pipelined):\n"
+           "       O <observation> <student> <skill(s)> - observe: predict, then update\n"
+           "         p(L) as predicting a row of input_file does (-U), '.' observation\n"
+           "         is unknown;\n"
+           "       P <student> <skill(s)> - predict without an update.\n"
+           "     The answer is a line of probabilities of the observations followed by\n"
+           "     p(L) of the skill(s) (after the update), or 'E <message>' if the\n"
+           "     request is wrong. Skills are delimited as in input_file (-d).\n"
+           "-K : state file, p(L) of student-skill pairs are read from it (by their\n"
+           "     labels) as the starting ones, and the p(L) they end with are stored in\n"
+           "     it, so the next run goes on from there with the rows of its input_file\n"
+           "     only. Created if there is none. Updates go to state_file.log first, a\n"
+           "     run that stops before they are stored leaves the file as it was (or they\n"
+           "     are stored by the next run). With -S, p(L) updated by a round of\n"
+           "     requests are stored before the answers are sent.\n"
 		   );
 	exit(1);
 }
@@ -179,7 +263,7 @@ void exit_with_help() {
 void parse_arguments(int argc, char **argv, char *input_file_name, char *model_file_name, char *predict_file_name) {
 	// parse command line options, starting from 1 (0 is path to executable)
 	// go in pairs, looking at whether first in pair starts with '-', if not, stop parsing arguments
-	int i;
+	int i, n;
     char * ch;
 	for(i=1;i<argc;i++)
 	{
@@ -218,6 +302,36 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *model_f
                     fprintf(stderr,"specification of how probabilities of states should be updated (-U) is incorrect, it sould be r|g[,t|g] \n");
                     exit_with_help();
                 }
+                break;
+            case  'P':
+				n = atoi(argv[i]);
+                if(n!=0 && n!=1) {
+					fprintf(stderr,"parallel processing flag (-P) should be 0 or 1\n");
+					exit_with_help();
+                }
+                param.parallel = (NPAR)n;
+                break;
+            case  'T':
+				n = atoi(argv[i]);
+                if(n<0) {
+					fprintf(stderr,"number of threads (-T) should be non-negative\n");
+					exit_with_help();
+                }
+                param.num_threads = n;
+                break;
+            case  'R':
+				n = atoi(argv[i]);
+                if(n!=0 && n!=1) {
+					fprintf(stderr,"reproducible results flag (-R) should be 0 or 1\n");
+					exit_with_help();
+                }
+                param.reproducible = (NPAR)n;
+                break;
+            case  'S':
+                strcpy(serve_path, argv[i]);
+                break;
+            case  'K':
+                strcpy(state_path, argv[i]);
                 break;
 			default:
 				fprintf(stderr,"unknown option: -%c\n", argv[i-1][1]);
@@ -230,10 +344,14 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *model_f
         exit_with_help();
     }
 	
-	// next argument should be input (training) file name
+	// next argument should be input (training) file name, unless serving
 	if(i>=argc) // if not
 		exit_with_help(); // leave
 	
+	if(serve_path[0] != 0) {
+		strcpy(model_file_name, argv[i]);
+		return;
+	}
 	strcpy(input_file_name, argv[i++]); // copy and advance
 	
 	if(i>=argc) { // no model file name specified
@@ -252,3 +370,383 @@ void parse_arguments(int argc, char **argv, char *input_file_name, char *model_f
         }
 	}
 }
+
+//
+// resident server: requests are answered as rows of input_file would be predicted, one student-skill state store
+// is shared by all connections; requests are handled one connection at a time, all complete lines of a read
+// are answered with one write
+//
+
+struct serve_buf {
+    char *s;
+    size_t n, cap;
+    size_t off; // written out up to, answers
+};
+
+static void serveAppend(struct serve_buf *b, const char *s, size_t len) {
+    if(b->off > 0 && b->n + len > b->cap) { // drop what was written
+        memmove(b->s, b->s + b->off, b->n - b->off);
+        b->n -= b->off;
+        b->off = 0;
+    }
+    if(b->n + len > b->cap) {
+        b->cap = MAX(2*b->cap, b->n + len + 4096);
+        b->s = (char*)realloc(b->s, b->cap);
+    }
+    memcpy(b->s + b->n, s, len);
+    b->n += len;
+}
+
+static void serveError(struct serve_buf *out, const char *msg) {
+    serveAppend(out, "E\t", 2);
+    serveAppend(out, msg, strlen(msg));
+    serveAppend(out, "\n", 1);
+}
+
+static void serveNumbers(struct serve_buf *out, const NUMBER *a, int n, int step, bool last) {
+    char num[64];
+    for(int i=0; i<n; i++) {
+        int len = snprintf(num, sizeof(num), "%12.10f%s", a[(size_t)i*step], (i==n-1 && last)?"\n":"\t");
+        serveAppend(out, num, (size_t)len);
+    }
+}
+
+struct serve_state {
+    HMMProblem *hmm;
+    struct state_store states;
+    struct predict_data pd;
+    struct data dt;
+    NCAT *ks;           // skills of the request
+    NCAT ks_cap;
+    NUMBER *local_pred; // nO
+    NUMBER *pLe;        // nS
+    NUMBER **pL;        // ks_cap
+    NUMBER *state;      // p(L) of the skills, ks_cap
+    struct state_file *sf; // state file, or NULL
+    NDAT *dirty;        // pairs updated since the last commit to the state file (set to 2)
+    NDAT ndirty, dirty_cap;
+};
+
+// label to id: fixed labels are those of the model (its rows), others are added as they come
+static NCAT serveLabel(struct vocab *v, bool fixed, const char *s, size_t len) {
+    return fixed?findVocab(v, s, len):addVocab(v, s, len);
+}
+
+static void serveLine(struct serve_state *st, char *l, struct serve_buf *out) {
+    NPAR nS = param.nS, nO = param.nO;
+    bool by_group = param.structure==STRUCTURE_GROUP;
+    char *f[5];
+    int nf = 0;
+    for(char *p = l; nf<5; ) { // tab-separated fields
+        f[nf++] = p;
+        p = strchr(p, '\t');
+        if(p == NULL) break;
+        *p++ = 0;
+    }
+    bool observe = strcmp(f[0],"O")==0;
+    if( (!observe && strcmp(f[0],"P")!=0) || nf != (observe?4:3) ) {
+        serveError(out, "request should be 'O observation student skill(s)' or 'P student skill(s)'");
+        return;
+    }
+    NPAR o = -1;
+    if(observe) {
+        int obs = atoi(f[1]) - 1; // as in input_file, '.' is unknown
+        if(obs >= nO) {
+            serveError(out, "observation exceeds the number of observations of the model");
+            return;
+        }
+        o = (NPAR)obs;
+    }
+    char *student = f[observe?2:1], *skills = f[observe?3:2];
+    NCAT g = serveLabel(param.voc_group, by_group, student, strlen(student));
+    if(g < 0) {
+        serveError(out, "student is not in the model");
+        return;
+    }
+    // skills, '.' is the null skill
+    NCAT n = 0;
+    bool null_skill = strcmp(skills,".")==0 || strcmp(skills," ")==0;
+    for(char *k = skills; !null_skill && k != NULL; n++) {
+        char *ke = (param.multiskill!=0)?strchr(k, param.multiskill):NULL;
+        size_t len = (ke==NULL)?strlen(k):(size_t)(ke-k);
+        if(n == st->ks_cap) {
+            st->ks_cap *= 2;
+            st->ks = (NCAT*)realloc(st->ks, sizeof(NCAT)*(size_t)st->ks_cap);
+            st->pL = (NUMBER**)realloc(st->pL, sizeof(NUMBER*)*(size_t)st->ks_cap);
+            st->state = (NUMBER*)realloc(st->state, sizeof(NUMBER)*(size_t)st->ks_cap);
+        }
+        st->ks[n] = serveLabel(param.voc_skill, !by_group, k, len);
+        if(st->ks[n] < 0) {
+            serveError(out, "skill is not in the model");
+            return;
+        }
+        k = (ke==NULL)?NULL:ke+1;
+    }
+    if(null_skill) {
+        st->ks[0] = -1;
+        n = 1;
+    }
+    if(!null_skill) { // states of the pairs, before pointers to them are taken
+        NDAT n0 = st->states.n;
+        for(NCAT l=0; l<n; l++)
+            addState(&st->states, g, st->ks[l]);
+        if(st->sf != NULL && st->states.n > n0) // new pairs start from the state file
+            readStates(st->sf, &st->states, param.voc_group, param.voc_skill, n0);
+    }
+    
+    if(observe) { // as a row of input_file
+        NDAT rix = 0;
+        NCAT rcount = n;
+        st->pd.dat_obs = &o;
+        st->pd.dat_group = &g;
+        st->pd.dat_skill = st->ks;
+        st->pd.dat_skill_stacked = st->ks;
+        st->pd.dat_skill_rcount = &rcount;
+        st->pd.dat_skill_rix = &rix;
+        st->pd.dat_state = st->state; // may have grown
+        struct predict_metrics pm = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        HMMProblem::predictRow(&st->pd, 0, &st->dt, st->local_pred, st->pLe, st->pL, &pm);
+        for(NCAT l=0; st->sf != NULL && !null_skill && l<n; l++) {
+            NDAT ix = findState(&st->states, g, st->ks[l]);
+            if(st->states.set[ix] == 2) continue;
+            if(st->ndirty == st->dirty_cap) {
+                st->dirty_cap *= 2;
+                st->dirty = (NDAT*)realloc(st->dirty, sizeof(NDAT)*(size_t)st->dirty_cap);
+            }
+            st->dirty[st->ndirty++] = ix;
+            st->states.set[ix] = 2;
+        }
+        serveNumbers(out, st->pd.dat_predict, nO, 1, null_skill);
+        if(!null_skill)
+            serveNumbers(out, st->pd.dat_state, n, 1, true);
+        return;
+    }
+    // predict only
+    if(null_skill) {
+        for(NPAR m=0; m<nO; m++)
+            st->local_pred[m] = st->hmm->getNullSkillObs(m);
+        serveNumbers(out, st->local_pred, nO, 1, true);
+        return;
+    }
+    st->dt.g = g;
+    for(NCAT l=0; l<n; l++) {
+        NDAT ix = findState(&st->states, g, st->ks[l]);
+        st->pL[l] = &st->states.p[ (size_t)ix*nS ];
+        if( st->states.set[ix]==0 ) {
+            st->dt.k = st->ks[l];
+            for(NPAR i=0; i<nS; i++)
+                st->pL[l][i] = st->hmm->getPI(&st->dt, i);
+            st->states.set[ix] = 1;
+        }
+        st->state[l] = st->pL[l][0];
+    }
+    st->hmm->producePCorrect(st->pL, st->local_pred, st->ks, n, &st->dt);
+    projectsimplex(st->local_pred, nO);
+    serveNumbers(out, st->local_pred, nO, 1, false);
+    serveNumbers(out, st->state, n, 1, true);
+}
+
+// p(L) of the pairs updated since the last commit, to the state file
+static void serveCommit(struct serve_state *st) {
+    if(st->sf == NULL || st->ndirty == 0) return;
+    writeStates(st->sf, &st->states, param.voc_group, param.voc_skill, st->dirty, st->ndirty);
+    commitStateFile(st->sf);
+    for(NDAT i=0; i<st->ndirty; i++)
+        st->states.set[ st->dirty[i] ] = 1;
+    st->ndirty = 0;
+}
+
+// answer the complete lines in in, the rest (a part of a line) is moved to its start
+static void serveLines(struct serve_state *st, struct serve_buf *in, struct serve_buf *out) {
+    char *p = in->s, *e = in->s + in->n, *nl;
+    while( p < e && (nl = (char*)memchr(p, '\n', (size_t)(e-p))) != NULL ) {
+        *nl = 0;
+        if(nl > p && nl[-1] == '\r') nl[-1] = 0;
+        if(*p != 0) // empty lines are not requests
+            serveLine(st, p, out);
+        p = nl + 1;
+    }
+    in->n = (size_t)(e-p);
+    memmove(in->s, p, in->n);
+}
+
+// read what is there and answer it into out; false if there is no more to read
+static bool serveRead(struct serve_state *st, int fd, struct serve_buf *in, struct serve_buf *out) {
+    if(in->cap - in->n < 65536) {
+        in->cap = MAX(2*in->cap, in->n + 65536);
+        in->s = (char*)realloc(in->s, in->cap);
+    }
+    ssize_t r = read(fd, in->s + in->n, in->cap - in->n - 1);
+    if(r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if(r <= 0) { // a last line without a new line is a request too
+        if(in->n > 0) {
+            in->s[in->n++] = '\n';
+            serveLines(st, in, out);
+        }
+        return false;
+    }
+    in->n += (size_t)r;
+    serveLines(st, in, out);
+    return true;
+}
+
+// write out what the fd takes; false if it is closed
+static bool serveWrite(int fd, struct serve_buf *out) {
+    while(out->off < out->n) {
+        ssize_t k = write(fd, out->s + out->off, out->n - out->off);
+        if(k < 0 && errno == EINTR) continue;
+        if(k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true; // the rest when it is writable
+        if(k <= 0) return false;
+        out->off += (size_t)k;
+    }
+    out->n = out->off = 0;
+    return true;
+}
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serveSignal(int sig) {
+    serve_stop = 1;
+}
+
+int serve(const char *path, HMMProblem *hmm) {
+    struct serve_state st;
+    st.hmm = hmm;
+    initStateStore(&st.states, param.nS);
+    param.predictions = 2; // predictRow keeps predictions and p(L) in pd
+    st.ks_cap = 16;
+    st.ks = Malloc(NCAT, (size_t)st.ks_cap);
+    st.pL = Malloc(NUMBER*, (size_t)st.ks_cap);
+    st.state = Malloc(NUMBER, (size_t)st.ks_cap);
+    st.local_pred = init1D<NUMBER>(param.nO);
+    st.pLe = init1D<NUMBER>(param.nS);
+    st.pd.hmms = &st.hmm;
+    st.pd.nhmms = 1;
+    st.pd.hmm_idx = NULL;
+    st.pd.states = &st.states;
+    st.pd.fid = NULL;
+    st.pd.dat_predict = init1D<NUMBER>(param.nO);
+    st.pd.dat_state = st.state;
+    st.sf = (state_path[0] != 0)?openStateFile(state_path, param.nS):NULL;
+    st.dirty_cap = 1024;
+    st.dirty = Malloc(NDAT, (size_t)st.dirty_cap);
+    st.ndirty = 0;
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serveSignal; // no SA_RESTART, poll and read return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    int ret = 0;
+    struct serve_buf out = {NULL, 0, 0, 0};
+    if(strcmp(path,"-")==0) { // stdin, stdout
+        struct serve_buf in = {NULL, 0, 0, 0};
+        if(param.quiet == 0)
+            fprintf(stderr,"predicthmm serving requests from stdin\n");
+        bool more = true;
+        while( !serve_stop && more ) {
+            more = serveRead(&st, STDIN_FILENO, &in, &out);
+            serveCommit(&st);
+            more = serveWrite(STDOUT_FILENO, &out) && more; // blocking, answers of a read are written before the next one
+        }
+        free(in.s);
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        struct stat sb;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if( strlen(path) >= sizeof(addr.sun_path) ) {
+            fprintf(stderr,"Socket path %s is too long\n", path);
+            ret = 1;
+        } else {
+            strcpy(addr.sun_path, path);
+            if( stat(path, &sb)==0 && S_ISSOCK(sb.st_mode) ) // left by an earlier server
+                unlink(path);
+            if( fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SERVE_MAX_CLIENTS) != 0 ) {
+                fprintf(stderr,"Could not listen on socket %s\n", path);
+                ret = 1;
+            }
+        }
+        if(ret == 0) {
+            if(param.quiet == 0)
+                printf("predicthmm serving requests on %s\n", path);
+            fflush(stdout);
+            // connections are non-blocking, answers wait in their out buffer until the connection takes them,
+            // its requests are not read while too many answers wait
+            struct pollfd pfd[SERVE_MAX_CLIENTS+1];
+            struct serve_buf in[SERVE_MAX_CLIENTS+1], outs[SERVE_MAX_CLIENTS+1];
+            bool eof[SERVE_MAX_CLIENTS+1];
+            memset(in, 0, sizeof(in));
+            memset(outs, 0, sizeof(outs));
+            int nfd = 1;
+            pfd[0].fd = fd;
+            pfd[0].events = POLLIN;
+            while( !serve_stop ) {
+                for(int c=1; c<nfd; c++)
+                    pfd[c].events = (short)( ((!eof[c] && outs[c].n - outs[c].off < SERVE_MAX_PENDING)?POLLIN:0) | ((outs[c].off < outs[c].n)?POLLOUT:0) );
+                if( poll(pfd, (nfds_t)nfd, -1) < 0 ) {
+                    if(errno == EINTR) continue;
+                    break;
+                }
+                for(int c=1; c<nfd; c++)
+                    if( (pfd[c].revents & (POLLIN|POLLHUP)) != 0 && !eof[c] )
+                        eof[c] = !serveRead(&st, pfd[c].fd, &in[c], &outs[c]);
+                serveCommit(&st); // the answers of the round go out after what they updated is stored
+                for(int c=nfd-1; c>0; c--) { // connections, closed ones are replaced by the last one
+                    bool open = true;
+                    if( (pfd[c].revents & (POLLERR|POLLNVAL)) != 0 )
+                        open = false;
+                    else if( outs[c].off < outs[c].n )
+                        open = serveWrite(pfd[c].fd, &outs[c]);
+                    if( !open || (eof[c] && outs[c].off == outs[c].n) ) {
+                        close(pfd[c].fd);
+                        free(in[c].s);
+                        free(outs[c].s);
+                        nfd--;
+                        pfd[c] = pfd[nfd];
+                        in[c] = in[nfd];
+                        outs[c] = outs[nfd];
+                        eof[c] = eof[nfd];
+                        memset(&in[nfd], 0, sizeof(struct serve_buf));
+                        memset(&outs[nfd], 0, sizeof(struct serve_buf));
+                    }
+                }
+                if( (pfd[0].revents & POLLIN) != 0 ) {
+                    int cfd = accept(fd, NULL, NULL);
+                    if(cfd >= 0 && nfd <= SERVE_MAX_CLIENTS) {
+                        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+                        pfd[nfd].fd = cfd;
+                        pfd[nfd].revents = 0;
+                        eof[nfd] = false;
+                        nfd++;
+                    } else if(cfd >= 0)
+                        close(cfd);
+                }
+            }
+            for(int c=1; c<nfd; c++) {
+                close(pfd[c].fd);
+                free(in[c].s);
+                free(outs[c].s);
+            }
+            unlink(path);
+        }
+        if(fd >= 0) close(fd);
+    }
+    free(out.s);
+    serveCommit(&st);
+    if(st.sf != NULL)
+        closeStateFile(st.sf);
+    free(st.dirty);
+    freeStateStore(&st.states);
+    free(st.ks);
+    free(st.pL);
+    free(st.state);
+    free(st.local_pred);
+    free(st.pLe);
+    free(st.pd.dat_predict);
+    return ret;
+}
@@ -49,12 +49,10 @@ void parse_arguments_step1(int argc, char **argv, char *input_file_name, char *o
 void parse_arguments_step2(int argc, char **argv, FILE *fid_console); // things that do need data file read, namely, number of observations
 
 bool read_and_structure_data(const char *filename, FILE *fid_console);
-NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console);//SEQ
-NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console);//SEQ
-NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console);//SEQ
-//NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);//PAR
-//NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);//PAR
-//NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);//PAR
+NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);
+NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);
+NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console);
+void fit_folds(HMMProblem **hmms, struct param **views, const char *model_file_name, int q, double *tm_fit, FILE *fid_console);
 
 static int max_line_length;
 static char * line;
@@ -77,8 +75,7 @@ static char* readline(FILE *fid) {
 
 int main (int argc, char ** argv) {
     
-	clock_t tm_all = clock();//overall time //SEQ
-//    double _tm_all = omp_get_wtime(); //PAR
+    double tm_all = omp_get_wtime();
     
 	char input_file[1024]; // data
 	char output_file[1024]; // model
@@ -90,6 +87,8 @@ int main (int argc, char ** argv) {
     
     // parse parameters, step 1
 	parse_arguments_step1(argc, argv, input_file, output_file, predict_file, colsole_file);
+    if(param.num_threads>0)
+        omp_set_num_threads(param.num_threads);
 
     FILE *fid_console = NULL;
     if(param.duplicate_console==1)
@@ -100,12 +99,10 @@ int main (int argc, char ** argv) {
         if(param.duplicate_console==1) fprintf(fid_console, "trainhmm starting...\n");
     }
 
-    clock_t tm_read = clock();//overall time //SEQ
-//    double _tm_read = omp_get_wtime(); //PAR
+    double tm_read = omp_get_wtime();
     int read_ok = read_and_structure_data(input_file, fid_console);
-    tm_read = (clock_t)(clock()-tm_read);//SEQ
     
-//    _tm_read = omp_get_wtime()-_tm_read;//PAR
+    tm_read = omp_get_wtime()-tm_read;
     
     if( ! read_ok )
         return 0;
@@ -124,10 +121,8 @@ int main (int argc, char ** argv) {
     // erase blocking labels
     zeroLabels(&param);
 
-    clock_t tm_fit = 0; //SEQ
-    clock_t tm_predict = 0; //SEQ
-//    double _tm_fit;//PAR
-//    double _tm_predict;//PAR
+    double tm_fit = 0;
+    double tm_predict = 0;
     
     if(param.cv_folds==0) { // not cross-validation
         // create problem
@@ -139,11 +134,9 @@ int main (int argc, char ** argv) {
                 hmm = new HMMProblem(&param);
                 break;
         }
-        tm_fit = clock(); //SEQ
-//        _tm_fit = omp_get_wtime(); //PAR
+        tm_fit = omp_get_wtime();
         hmm->fit();
-        tm_fit = clock()-tm_fit;//SEQ
-//        _tm_fit = omp_get_wtime()-_tm_fit;//PAR
+        tm_fit = omp_get_wtime()-tm_fit;
         
         // write model
         hmm->toFile(output_file);
@@ -152,12 +145,10 @@ int main (int argc, char ** argv) {
             NUMBER* metrics = Calloc(NUMBER, (size_t)7); // LL, AIC, BIC, RMSE, RMSEnonull, Acc, Acc_nonull;
             // takes care of predictions and metrics, writes predictions if param.predictions==1
             
-            tm_predict = clock(); //SEQ
-//            _tm_predict = omp_get_wtime(); //PAR
-			HMMProblem::predict(metrics, predict_file, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, &hmm, 1, NULL);
+            tm_predict = omp_get_wtime();
+			HMMProblem::predict(metrics, predict_file, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, &hmm, 1, NULL, NULL, NULL, NULL);
             
-            tm_predict = clock()-tm_predict;//SEQ
-//            _tm_predict = omp_get_wtime()-_tm_predict;//PAR
+            tm_predict = omp_get_wtime()-tm_predict;
             
             if( param.metrics>0 /*&& !param.quiet*/) {
                 printf("trained model LL=%15.7f (%15.7f), AIC=%8.6f, BIC=%8.6f, RMSE=%8.6f (%8.6f), Acc=%8.6f (%8.6f)\n",
@@ -181,16 +172,13 @@ int main (int argc, char ** argv) {
 		NUMBER n_par = 0;
         switch (param.cv_strat) {
             case CV_GROUP:
-                n_par = cross_validate(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);//SEQ
-//                cross_validate(metrics, predict_file, output_file, &_tm_fit, &_tm_predict, fid_console);//PAR
+                n_par = cross_validate(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);
                 break;
             case CV_ITEM:
-                n_par = cross_validate_item(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);//SEQ
-//                cross_validate_item(metrics, predict_file, output_file, &_tm_fit, &_tm_predict, fid_console);//PAR
+                n_par = cross_validate_item(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);
                 break;
             case CV_NSTR:
-                n_par = cross_validate_nstrat(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);//SEQ
-//                cross_validate_nstrat(metrics, predict_file, output_file, &_tm_fit, &_tm_predict, fid_console);//PAR
+                n_par = cross_validate_nstrat(metrics, predict_file, output_file, &tm_fit, &tm_predict, fid_console);
                 break;
             default:
                 
@@ -215,10 +203,8 @@ int main (int argc, char ** argv) {
 	destroy_input_data(&param);
 	
 //	if(param.quiet == 0) {
-        printf("timing: overall %f seconds, read %f, fit %f, predict %f\n",(NUMBER)((clock()-tm_all)/CLOCKS_PER_SEC), (NUMBER)tm_read/CLOCKS_PER_SEC,  (NUMBER)tm_fit/CLOCKS_PER_SEC,  (NUMBER)tm_predict/CLOCKS_PER_SEC);//SEQ
-        if(param.duplicate_console==1) fprintf(fid_console, "timing: overall %f seconds, read %f, fit %f, predict %f\n",(NUMBER)((clock()-tm_all)/CLOCKS_PER_SEC), (NUMBER)tm_read/CLOCKS_PER_SEC,  (NUMBER)tm_fit/CLOCKS_PER_SEC,  (NUMBER)tm_predict/CLOCKS_PER_SEC);//SEQ
-//        if(param.duplicate_console==1) fprintf(fid_console, "timing: overall %lf sec, read %lf sec, fit %lf sec, predict %lf sec\n",omp_get_wtime()-_tm_all, _tm_read, _tm_fit, _tm_predict);//PAR
-//        printf("timing: overall %lf sec, read %lf sec, fit %lf sec, predict %lf sec\n",omp_get_wtime()-_tm_all, _tm_read, _tm_fit, _tm_predict);//PAR
+        if(param.duplicate_console==1) fprintf(fid_console, "timing: overall %lf sec, read %lf sec, fit %lf sec, predict %lf sec\n",omp_get_wtime()-tm_all, tm_read, tm_fit, tm_predict);
+        printf("timing: overall %lf sec, read %lf sec, fit %lf sec, predict %lf sec\n",omp_get_wtime()-tm_all, tm_read, tm_fit, tm_predict);
 //    }
     
     if(param.duplicate_console==1)
@@ -286,12 +272,23 @@ void exit_with_help() {
            "-d : delimiter for multiple skills per observation; 0-single skill per\n"
            "     observation (default), otherwise -- delimiter character, e.g. '-d ~'.\n"
            "-b : treat input file as binary input file (specifications TBA).\n"
+           "-M : write the model file in binary format, 0-no (default, text), 1-yes;\n"
+           "     predicthmm maps it into memory and reads only the parameters of the\n"
+           "     skills (students) in its input, modelconvert converts to and from text.\n"
            "-B : block re-estimation of prior, transitions, or emissions parameters\n"
            "     respectively (defailt is '-B 0,0,0'), to block re-estimation of transition\n"
            "     probabilities specify '-B 0,1,0'.\n"
            "-P : use parallel processing, defaul - 0 (no parallel processing), 1 - fit\n"
-           "     separate skills/students separately, 2 - fit separate sequences within\n"
-           "     skill/student separately.\n"
+           "     separate skills/students separately, adapting to the data: largest\n"
+           "     first, sequences of skills too large for one thread, and of the single\n"
+           "     skill fit (-f), are shared among threads; 2 - fit separate sequences\n"
+           "     within skill/student separately.\n"
+           "     With any of them, students are predicted (-p, -v) separately too.\n"
+           "-T : number of threads for parallel processing (-P 1 or 2), default - 0\n"
+           "     (OpenMP default, e.g. OMP_NUM_THREADS or the number of cores).\n"
+           "-R : reproducible results of parallel processing, 0 - no (default, fastest),\n"
+           "     1 - sums over sequences are done in fixed chunks and a fixed order, so\n"
+           "     the model does not depend on the number of threads.\n"
            "-o : in addition to printing to console, print output to the file specified\n"
            "     default is empty.\n"
 		   );
@@ -411,6 +408,13 @@ void parse_arguments_step1(int argc, char **argv, char *input_file_name, char *o
                 break;
 			case 'b':
                 param.binaryinput = atoi( strtok(argv[i],"\t\n\r"));
+                break;
+			case 'M':
+                param.binarymodel = atoi( strtok(argv[i],"\t\n\r"));
+				if(param.binarymodel!=0 && param.binarymodel!=1) {
+					fprintf(stderr,"ERROR! Binary model flag should be 0 or 1\n");
+					exit_with_help();
+				}
                 break;
 			case 'v':
 				param.cv_folds   = (NPAR)atoi( strtok(argv[i],",\t\n\r"));
@@ -473,12 +477,28 @@ void parse_arguments_step1(int argc, char **argv, char *input_file_name, char *o
                 break;
             case  'P':
 				n = atoi(argv[i]);
-                if(n!=0 && n!=1 && n!=2) {
-					fprintf(stderr,"parallel processing flag (-P) should be 0 or 1\n");
+                if(n<0 || n>2) {
+					fprintf(stderr,"parallel processing flag (-P) should be 0, 1, or 2\n");
 					exit_with_help();
                 }
                 param.parallel = (NPAR)n;
                 break;
+            case  'T':
+				n = atoi(argv[i]);
+                if(n<0) {
+					fprintf(stderr,"number of threads (-T) should be non-negative\n");
+					exit_with_help();
+                }
+                param.num_threads = n;
+                break;
+            case  'R':
+				n = atoi(argv[i]);
+                if(n!=0 && n!=1) {
+					fprintf(stderr,"reproducible results flag (-R) should be 0 or 1\n");
+					exit_with_help();
+                }
+                param.reproducible = (NPAR)n;
+                break;
             case 'c': {
                     StripedArray<NUMBER> * tmp_array = new StripedArray<NUMBER>();
                     ch = strtok(argv[i],",\t\n\r");
@@ -705,277 +725,17 @@ bool read_and_structure_data(const char *filename, FILE *fid_console) {
     if(! readok )
         return false;
     
-	//	2. distribute data into nK skill bins
-	//		create
-	//          skill_group_map[nK][nG] - explicit 'sparse' map of skills and groups, here 1 means done
-	//			k_numg[nK]        - number of groups per skill                 RETAIN
-	
-	NDAT t = 0;
-    NDAT t_stacked = 0;
-	NCAT g, k;
-//	NPAR o;
-	NPAR **skill_group_map = init2D<NPAR>(param.nK, param.nG); // binary map of skills to groups
-	param.k_numg = Calloc(NCAT, (size_t)param.nK);
-	param.g_numk = Calloc(NCAT, (size_t)param.nG);
-    NDAT *count_null_skill_group = Calloc(NDAT, (size_t)param.nG); // count null skill occurences per group
-    NCAT *index_null_skill_group = Calloc(NCAT, (size_t)param.nG); // index of group in compressed array
-    
-	// Pass A
-	for(t=0; t<param.N; t++) {
-        if(param.multiskill==0)
-            k = param.dat_skill[t];//[t];
-        else
-            k = param.dat_skill_stacked[ param.dat_skill_rix[t] ]; // first skill of multi-skill
-
-        g = param.dat_group[t];//[t];
-		// null skill : just count
-		if( k < 0 ) {
-            if(count_null_skill_group[g]==0) param.n_null_skill_group++;
-            count_null_skill_group[g]++;
-			continue;
-		}
-        NCAT *ar;
-        int n;
-        if(param.multiskill==0) {
-            k = param.dat_skill[t];
-            ar = &k;
-            n = 1;
-        } else {
-            k = param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            ar = &param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            n = param.dat_skill_rcount[t];
-        }
-        for(int l=0; l<n; l++) {
-            k = ar[l];
-            if( skill_group_map[k][g] == 0 ) {
-                skill_group_map[k][g] = 1;
-                param.k_numg[k]++;
-                param.g_numk[g]++;
-            }
-        }
-	}
-    for(k=0; k<param.nK; k++) param.nSeq += param.k_numg[k];
-    param.all_data = Calloc(struct data, (size_t)param.nSeq);
-    
-	// Section B
-	param.k_g_data = Malloc(struct data **, (size_t)param.nK);
-	param.k_data = Malloc(struct data *, (size_t)param.nSeq);
-    //	for(k=0; k<param.nK; k++)
-    //		param.k_g_data[k] = Calloc(struct data*, param.k_numg[k]);
-	param.g_k_data = Calloc(struct data **, (size_t)param.nG);
-	param.g_data = Malloc(struct data *, (size_t)param.nSeq);
-    //	for(g=0; g<param.nG; g++)
-    //		param.g_k_data[g] = Calloc(struct data*, param.g_numk[g]);
-	param.null_skills = Calloc(struct data, (size_t)param.n_null_skill_group);
-    // index compressed array of null-skill-BY-group
-    NCAT idx = 0;
-	for(g=0; g<param.nG; g++)
-        if( count_null_skill_group[g] >0 ) index_null_skill_group[g] = idx++;
-    
-	// Pass C
-	NDAT *k_countg = Calloc(NDAT, (size_t)param.nK); // track current group in skill
-	NDAT *g_countk = Calloc(NDAT, (size_t)param.nG); // track current skill in group
-    // set k_countg and g_countk pointers to relative positions
-    NDAT sumk=0, sumg=0;
-    for(k=0; k<param.nK; k++) {
-        k_countg[k] = sumk;
-        param.k_g_data[k] = &param.k_data[sumk];
-        sumk += param.k_numg[k];
-    }
-    for(g=0; g<param.nG; g++) {
-        g_countk[g] = sumg;
-        param.g_k_data[g] = &param.g_data[sumg];
-        sumg += param.g_numk[g];
-    }
-    
-    NDAT n_all_data = 0;
-	for(t=0; t<param.N; t++) {
-        NCAT *ar;
-        int n;
-        if(param.multiskill==0) {
-            k = param.dat_skill[t];
-            ar = &k;
-            n = 1;
-        } else {
-            k = param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            ar = &param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            n = param.dat_skill_rcount[t];
-        }
-        for(int l=0; l<n; l++) {
-            k = ar[l];
-            g = param.dat_group[t];//[t];
-            // now allocate space for the data
-            if( k < 0 ) {
-                NCAT gidx = index_null_skill_group[g];
-                if( param.null_skills[gidx].ix != NULL) // was obs // check if we allocated it already
-                    continue;
-                param.null_skills[gidx].n = count_null_skill_group[g];
-				param.null_skills[gidx].g = g;
-				param.null_skills[gidx].k = -1;
-                param.null_skills[gidx].cnt = 0;
-                //                param.null_skills[gidx].obs = Calloc(NPAR, count_null_skill_group[g]);
-				param.null_skills[gidx].ix = Calloc(NDAT, (size_t)count_null_skill_group[g]);
-				if(param.multiskill!=0)
-					param.null_skills[gidx].ix_stacked = Calloc(NDAT, (size_t)count_null_skill_group[g]);
-                // no time for null skills is necessary
-//                if(param.time)
-//                    param.null_skills[gidx].time = Calloc(int, (size_t)count_null_skill_group[g]);
-                param.null_skills[gidx].alpha = NULL;
-                param.null_skills[gidx].beta = NULL;
-                param.null_skills[gidx].gamma = NULL;
-				param.null_skills[gidx].xi = NULL;
-                param.null_skills[gidx].c = NULL;
-                param.null_skills[gidx].p_O_param = 0.0;
-                continue;
-            }
-            if( skill_group_map[k][g]==0) {
-                fprintf(stderr, "ERROR! position [%d,%d] in skill_group_map should have been 1\n",k,g);
-                if(param.duplicate_console==1) fprintf(fid_console,"ERROR! position [%d,%d] in skill_group_map should have been 1\n",k,g);
-            } else if( skill_group_map[k][g]==1 ) { // insert new sequence and grab new data
-                // link
-                param.k_data[ k_countg[k] ] = &param.all_data[n_all_data]; // in linear array
-                param.g_data[ g_countk[g] ] = &param.all_data[n_all_data]; // in linear array
-                // param.k_g_data[k] and param.g_k_data[g] are already linked
-                //                param.k_g_data[k][ k_countg[k] ] = Calloc(struct data, 1); // grab
-                //                param.g_k_data[g][ g_countk[g] ] = param.k_g_data[k][ k_countg[k] ]; // relink
-                //                param.k_g_data[k][ k_countg[k] ]->n = 1; // init data << VV
-                //                param.k_g_data[k][ k_countg[k] ]->k = k; // init k
-                //                param.k_g_data[k][ k_countg[k] ]->g = g; // init g
-                //                param.k_g_data[k][ k_countg[k] ]->cnt = 0;
-                //                param.k_g_data[k][ k_countg[k] ]->obs = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->alpha = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->beta = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->gamma = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->xi = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->c = NULL;
-                //                param.k_g_data[k][ k_countg[k] ]->p_O_param = 0.0;
-                //                param.k_g_data[k][ k_countg[k] ]->loglik = 0.0;
-                param.all_data[n_all_data].n = 1; // init data << VV
-                param.all_data[n_all_data].k = k; // init k
-                param.all_data[n_all_data].g = g; // init g
-                param.all_data[n_all_data].cnt = 0;
-                //                param.all_data[n_all_data].obs = NULL;
-                param.all_data[n_all_data].ix = NULL;
-                param.all_data[n_all_data].ix_stacked = NULL;
-                param.all_data[n_all_data].alpha = NULL;
-                param.all_data[n_all_data].beta = NULL;
-                param.all_data[n_all_data].gamma = NULL;
-                param.all_data[n_all_data].xi = NULL;
-                param.all_data[n_all_data].c = NULL;
-                param.all_data[n_all_data].p_O_param = 0.0;
-                param.all_data[n_all_data].loglik = 0.0;
-                k_countg[k]++; // count
-                g_countk[g]++; // count
-                skill_group_map[k][g] = 2; // mark
-                n_all_data++;
-            } else if( skill_group_map[k][g]== 2) { // update data count, LINEAR SEARCH :(
-                int gidx;
-                //                for(gidx=(k_countg[k]-(NCAT)1); gidx>=0 && param.k_g_data[k][gidx]->g!=g; gidx--)
-                //                    ;
-                for(gidx=(k_countg[k]-1); gidx>=0 && param.k_data[gidx]->g!=g; gidx--)
-                    ;
-                if( param.k_data[gidx]->g==g)
-                    param.k_data[gidx]->n++;
-                else {
-                    fprintf(stderr, "ERROR! position of group %d in skill %d not found\n",g,k);
-                    if(param.duplicate_console==1) fprintf(fid_console,"ERROR! position of group %d in skill %d not found\n",g,k);
-                }
-            }
-        }
-	}
-	// recycle
-	free(k_countg);
-	free(g_countk);
-    free(count_null_skill_group);
-    
-    //	3 fill data
-    //		pass A
-    //			fill k_g_data.data (g_k_data is already linked)
-    //				using skill_group_map as marker, 3 - data grabbed
-	k_countg = Calloc(NDAT, (size_t)param.nK); // track current group in skill
-	g_countk = Calloc(NDAT, (size_t)param.nG); // track current skill in group
-	for(t=0; t<param.N; t++) {
-		g = param.dat_group[t];
-        NCAT *ar;
-        int n;
-        if(param.multiskill==0) {
-            k = param.dat_skill[t];
-            ar = &k;
-            n = 1;
-        } else {
-            k = param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            ar = &param.dat_skill_stacked[ param.dat_skill_rix[t] ];
-            n = param.dat_skill_rcount[t];
-        }
-        for(int l=0; l<n; l++) {
-            k = ar[l];
-            if( k < 0 ) {
-                NCAT gidx = index_null_skill_group[g];
-                //                param.null_skills[gidx].obs[ param.null_skills[gidx].cnt++ ] = o; // use .cnt as counter
-				param.null_skills[gidx].ix[ param.null_skills[gidx].cnt++ ] = t; // use .cnt as counter
-				if(param.multiskill!=0)
-					param.null_skills[gidx].ix_stacked[ param.null_skills[gidx].cnt-1 ] = t_stacked; // use prior value version of cnt that was increased for ix
-                continue;
-            }
-            if( skill_group_map[k][g]<2) {
-                fprintf(stderr, "ERROR! position [%d,%d] in skill_group_map should have been 2\n",k,g);
-                if(param.duplicate_console==1) fprintf(fid_console, "ERROR! position [%d,%d] in skill_group_map should have been 2\n",k,g);
-            } else if( skill_group_map[k][g]==2 ) { // grab data and insert first dat point
-//                param.k_g_data[k][ k_countg[k] ]->obs = Calloc(NPAR, (size_t)param.k_g_data[k][ k_countg[k] ]->n); // grab
-//                param.k_g_data[k][ k_countg[k] ]->obs[0] = o; // insert
-                param.k_g_data[k][ k_countg[k] ]->ix = Calloc(NDAT, (size_t)param.k_g_data[k][ k_countg[k] ]->n); // grab
-                param.k_g_data[k][ k_countg[k] ]->ix[0] = t; // insert
-                if(param.multiskill!=0) {
-                    param.k_g_data[k][ k_countg[k] ]->ix_stacked = Calloc(NDAT, (size_t)param.k_g_data[k][ k_countg[k] ]->n); // grab
-                    param.k_g_data[k][ k_countg[k] ]->ix_stacked[0] = t_stacked; // first stacked index
-                }
-                param.k_g_data[k][ k_countg[k] ]->cnt++; // increase data counter
-                k_countg[k]++; // count unique groups forward
-                g_countk[g]++; // count unique skills forward
-                skill_group_map[k][g] = 3; // mark
-            } else if( skill_group_map[k][g]== 3) { // insert next data point and inc counter, LINEAR SEARCH :(
-                NCAT gidx;
-                //			for(gidx=0; gidx < k_countg[k] && param.k_g_data[k][gidx]->g!=g; gidx++)
-                for(gidx=(k_countg[k]-(NCAT)1); gidx>=0 && param.k_g_data[k][gidx]->g!=g; gidx--)
-                    ; // skip
-                if( param.k_g_data[k][gidx]->g==g ) {
-                    NDAT pos = param.k_g_data[k][ gidx ]->cnt; // copy position
-                    //                    param.k_g_data[k][ gidx ]->obs[pos] = o; // insert
-                    param.k_g_data[k][ gidx ]->ix[pos] = t; // insert
-                    if(param.multiskill!=0)
-                        param.k_g_data[k][ gidx ]->ix_stacked[pos] = t_stacked; // insert
-                    param.k_g_data[k][ gidx ]->cnt++; // increase data counter
-                }
-                else {
-                    fprintf(stderr, "ERROR! position of group %d in skill %d not found\n",g,k);
-                    if(param.duplicate_console==1) fprintf(fid_console, "ERROR! position of group %d in skill %d not found\n",g,k);
-                }
-            }
-            t_stacked++;
-        }// all skills on the row
-    } // all t
-	// recycle
-	free(k_countg);
-	free(g_countk);
-    free(index_null_skill_group);
-	free2D<NPAR>(skill_group_map, param.nK);
-    // reset `cnt'
-    for(g=0; g<param.nG; g++) // for all groups
-        for(k=0; k<param.g_numk[g]; k++) // for all skills in it
-            param.g_k_data[g][k]->cnt = 0;
-    for(NCAT x=0; x<param.n_null_skill_group; x++)
-        param.null_skills[x].cnt = 0;
-
+    // sequences of skill-group pairs, unless the (version 4) binary input has them already
+    if(param.all_data == NULL)
+        structure_data(&param);
     return true;
 }
 
-NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console) {//SEQ
-//NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {//PAR
-    clock_t tm0;//SEQ
-//    double _tm0;//PAR
+NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {
+    double tm0;
     char *ch;
     NPAR f;
-    NCAT g,k;
+    NCAT g;
     FILE *fid = NULL; // file for storing prediction should that be necessary
     FILE *fid_folds = NULL; // file for reading/writing folds
     if(param.predictions>0) {  // if we have to write the predictions file
@@ -1038,71 +798,43 @@ NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_f
     
     // create and fit multiple problems
     HMMProblem* hmms[param.cv_folds];
+    struct param* views[param.cv_folds];
     int q = param.quiet;
     param.quiet = 1;
+    NPAR *block_g = Calloc(NPAR, (size_t)param.nG);
+    NPAR *block_null = Calloc(NPAR, (size_t)param.n_null_skill_group);
     for(f=0; f<param.cv_folds; f++) {
+        // block respective data - do not fit the data belonging to the fold
+        for(g=0; g<param.nG; g++) // for all groups
+            block_g[g] = (NPAR)(folds[g]==f);
+        // block nulls
+        for(NCAT x=0; x<param.n_null_skill_group; x++)
+            block_null[x] = (NPAR)(param.null_skills[x].g == f);
+        views[f] = create_fold_view(&param, block_g, block_null, NULL);
         switch(param.structure)
         {
             case STRUCTURE_SKILL: // Conjugate Gradient Descent
             case STRUCTURE_GROUP: // Conjugate Gradient Descent
-                hmms[f] = new HMMProblem(&param);
+                hmms[f] = new HMMProblem(views[f]);
                 break;
        }
-        // block respective data - do not fit the data belonging to the fold
-        for(g=0; g<param.nG; g++) // for all groups
-            if(folds[g]==f) { // if in current fold
-                for(k=0; k<param.g_numk[g]; k++) // for all skills in it
-                    param.g_k_data[g][k]->cnt = 1; // block it
-            }
-        // block nulls
-        for(NCAT x=0; x<param.n_null_skill_group; x++) {
-            if( param.null_skills[x].g == f)
-                param.null_skills[x].cnt = 1;
-        }
-
-        // now compute
-        tm0 = clock(); //SEQ
-//        _tm0 = omp_get_wtime(); //PAR
-        hmms[f]->fit();
-        *(tm_fit) += (clock_t)(clock()- tm0);//SEQ
-//        *(tm_fit) += omp_get_wtime()-_tm0;//PAR
-        
-        // write model
-        char fname[1024];
-        sprintf(fname,"%s_%i",model_file_name,f);
-        hmms[f]->toFile(fname);
-        
-        // UN-block respective data
-        for(g=0; g<param.nG; g++) // for all groups
-            if(folds[g]==f) { // if in current fold
-                for(k=0; k<param.g_numk[g]; k++) // for all skills in it
-                    param.g_k_data[g][k]->cnt = 0; // UN-block it
-            }
-        // UN-block nulls
-        for(NCAT x=0; x<param.n_null_skill_group; x++) {
-            if( param.null_skills[x].g == f)
-                param.null_skills[x].cnt = 0;
-        }
-        if(q == 0) {
-            printf("fold %d is done\n",f+1);
-            if(param.duplicate_console==1) fprintf(fid_console,"fold %d is done\n",f+1);
-        }
     }
+    free(block_g);
+    free(block_null);
+    fit_folds(hmms, views, model_file_name, q, tm_fit, fid_console);
     param.quiet = (NPAR)q;
     
-    tm0 = clock();//SEQ
-//    _tm0 = omp_get_wtime();//PAR
+    tm0 = omp_get_wtime();
 	
 	// new prediction
 	//		create a general fold-identifying array
 	NPAR *dat_fold = Calloc(NPAR, param.N);
 	for(NDAT t=0; t<param.N; t++) dat_fold[t] = folds[ param.dat_group[t] ];
 	//		predict
-	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, dat_fold);
+	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, dat_fold, NULL, NULL, NULL);
 	free(dat_fold);
 	
-	*(tm_predict) += (clock_t)(clock()- tm0);//SEQ
-//    *(tm_predict) += omp_get_wtime()-_tm0;//PAR
+    *(tm_predict) += omp_get_wtime()-tm0;
 	
 	
     // delete problems
@@ -1112,19 +844,19 @@ NUMBER cross_validate(NUMBER* metrics, const char *filename, const char *model_f
         delete hmms[f];
     }
     n_par /= param.cv_folds;
+    for(f=0; f<param.cv_folds; f++)
+        destroy_fold_view(views[f], &param);
 	
     free(folds);
 	
 	return (n_par);
 }
 
-NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console) {//SEQ
-//void cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {//PAR
+NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {
     NPAR f;
     NCAT I; // item
     NDAT t;
-    clock_t tm0;//SEQ
-//    double _tm0;//PAR
+    double tm0;
     char *ch;
     FILE *fid = NULL; // file for storing prediction should that be necessary
     FILE *fid_folds = NULL; // file for reading/writing folds
@@ -1139,7 +871,6 @@ NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *mo
     }
     // produce folds
     NPAR *folds = Calloc(NPAR, (size_t)param.nI);
-    NDAT *fold_counts = Calloc(NDAT, (size_t)param.cv_folds);
     srand ( (unsigned int)time(NULL) ); // randomize
 
     // folds file
@@ -1186,69 +917,40 @@ NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *mo
             free(line);
     }
     
-    // count number of items in each fold
-    for(t=0; t<param.N; t++) fold_counts[ folds[param.dat_item[t]/*->get(t)*/] ]++;
     // create and fit multiple problems
     HMMProblem* hmms[param.cv_folds];
+    struct param* views[param.cv_folds];
     int q = param.quiet;
     param.quiet = 1;
+    NPAR *hide_t = Calloc(NPAR, (size_t)param.N);
     for(f=0; f<param.cv_folds; f++) {
+        // block respective data - do not fit the data belonging to the fold
+        for(t=0; t<param.N; t++)
+            hide_t[t] = (NPAR)( folds[ param.dat_item[t]/*->get(t)*/ ] == f );
+        views[f] = create_fold_view(&param, NULL, NULL, hide_t); // fitting reads observations from there
         switch(param.structure)
         {
             case STRUCTURE_SKILL: // Conjugate Gradient Descent
             case STRUCTURE_GROUP: // Conjugate Gradient Descent
-                hmms[f] = new HMMProblem(&param);
+                hmms[f] = new HMMProblem(views[f]);
                 break;
         }
-        // block respective data - do not fit the data belonging to the fold
-        NPAR *saved_obs = Calloc(NPAR, (size_t)fold_counts[f]);
-        NDAT count_saved = 0;
-        for(t=0; t<param.N; t++) {
-            if( folds[ param.dat_item[t]/*->get(t)*/ ] == f ) {
-                saved_obs[count_saved++] = param.dat_obs[t];
-                param.dat_obs[t] = -1;//->set(t, -1);
-            }
-        }
-        // now compute
-        tm0 = clock(); //SEQ
-//        _tm0 = omp_get_wtime(); //PAR
-        
-        hmms[f]->fit();
-        *(tm_fit) += (clock_t)(clock()- tm0);//SEQ
-//        *(tm_fit) += omp_get_wtime()-_tm0;//PAR
-        
-        // write model
-        char fname[1024];
-        sprintf(fname,"%s_%i",model_file_name,f);
-        hmms[f]->toFile(fname);
-        
-        // UN-block respective data
-        count_saved = 0;
-        for(t=0; t<param.N; t++)
-            if( folds[ param.dat_item[t]/*->get(t)*/ ] == f )
-                param.dat_obs[t]=saved_obs[count_saved++];//->set(t, saved_obs[count_saved++]);
-        free(saved_obs);
-        if(q == 0) {
-            printf("fold %d is done\n",f+1);
-            if(param.duplicate_console==1) fprintf(fid_console, "fold %d is done\n",f+1);
-        }
     }
-    free(fold_counts);
+    free(hide_t);
+    fit_folds(hmms, views, model_file_name, q, tm_fit, fid_console);
     param.quiet = (NPAR)q;
 
-    tm0 = clock();//SEQ
-//    _tm0 = omp_get_wtime();//PAR
+    tm0 = omp_get_wtime();
 	
 	// new prediction
 	//		create a general fold-identifying array
 	NPAR *dat_fold = Calloc(NPAR, param.N);
 	for(NDAT t=0; t<param.N; t++) dat_fold[t] = folds[ param.dat_item[t] ];
 	//		predict
-	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, dat_fold);
+	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, dat_fold, NULL, NULL, NULL);
 	free(dat_fold);
 	
-	*(tm_predict) += (clock_t)(clock()- tm0);//SEQ
-//    *(tm_predict) += omp_get_wtime()-_tm0;//PAR
+    *(tm_predict) += omp_get_wtime()-tm0;
     
     // delete problems
     NCAT n_par = 0;
@@ -1257,18 +959,18 @@ NUMBER cross_validate_item(NUMBER* metrics, const char *filename, const char *mo
         delete hmms[f];
     }
     n_par /= f;
+    for(f=0; f<param.cv_folds; f++)
+        destroy_fold_view(views[f], &param);
     free(folds);
 
 	return n_par;
 }
 
-NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, clock_t *tm_fit, clock_t *tm_predict, FILE *fid_console) {//SEQ
-//void cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {//PAR
+NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *model_file_name, double *tm_fit, double *tm_predict, FILE *fid_console) {
     NPAR f;
     NCAT U; // unstratified
     NDAT t;
-    clock_t tm0;//SEQ
-//    double _tm0;//PAR
+    double tm0;
     char *ch;
     FILE *fid = NULL; // file for storing prediction should that be necessary
     FILE *fid_folds = NULL; // file for reading/writing folds
@@ -1283,7 +985,6 @@ NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *
     }
     // produce folds
     NPAR *folds = Calloc(NPAR, (size_t)param.N);
-    NDAT *fold_counts = Calloc(NDAT, (size_t)param.cv_folds);
 	
     srand ( (unsigned int)time(NULL) ); // randomize
 	
@@ -1332,64 +1033,36 @@ NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *
     }
     
     
-    // count number of items in each fold
-    for(t=0; t<param.N; t++)  fold_counts[ folds[param.dat_item[t]/*->get(t)*/] ]++;
     // create and fit multiple problems
     HMMProblem* hmms[param.cv_folds];
+    struct param* views[param.cv_folds];
     int q = param.quiet;
     param.quiet = 1;
+    NPAR *hide_t = Calloc(NPAR, (size_t)param.N);
     for(f=0; f<param.cv_folds; f++) {
+        // block respective data - do not fit the data belonging to the fold
+        for(t=0; t<param.N; t++)
+            hide_t[t] = (NPAR)( folds[ param.dat_item[t]/*->get(t)*/ ] == f );
+        views[f] = create_fold_view(&param, NULL, NULL, hide_t); // fitting reads observations from there
         switch(param.structure)
         {
             case STRUCTURE_SKILL: // Conjugate Gradient Descent
             case STRUCTURE_GROUP: // Conjugate Gradient Descent
-                hmms[f] = new HMMProblem(&param);
+                hmms[f] = new HMMProblem(views[f]);
                 break;
         }
-        // block respective data - do not fit the data belonging to the fold
-        NPAR *saved_obs = Calloc(NPAR, (size_t)fold_counts[f]);
-        NDAT count_saved = 0;
-        for(t=0; t<param.N; t++) {
-            if( folds[ param.dat_item[t]/*->get(t)*/ ] == f ) {
-                saved_obs[count_saved++] = param.dat_obs[t];
-                param.dat_obs[t]=-1;//->set(t, -1);
-            }
-        }
-        // now compute
-        tm0 = clock(); //SEQ
-//        _tm0 = omp_get_wtime(); //PAR
-        hmms[f]->fit();
-        *(tm_fit) += (clock_t)(clock()- tm0);//SEQ
-//        *(tm_fit) += omp_get_wtime()-_tm0;//PAR
-        
-        // write model
-        char fname[1024];
-        sprintf(fname,"%s_%i",model_file_name,f);
-        hmms[f]->toFile(fname);
-        
-        // UN-block respective data
-        count_saved = 0;
-        for(t=0; t<param.N; t++)
-            if( folds[ param.dat_item[t]/*->get(t)*/ ] == f )
-                param.dat_obs[t]=saved_obs[count_saved++];//->set(t, saved_obs[count_saved++]);
-        free(saved_obs);
-        if(q == 0) {
-            printf("fold %d is done\n",f+1);
-            if(param.duplicate_console==1) fprintf(fid_console, "fold %d is done\n",f+1);
-        }
     }
-    free(fold_counts);
+    free(hide_t);
+    fit_folds(hmms, views, model_file_name, q, tm_fit, fid_console);
     param.quiet = (NPAR)q;
     
-    tm0 = clock();//SEQ
-//    _tm0 = omp_get_wtime();//PAR
+    tm0 = omp_get_wtime();
 	
 	// new prediction
 	//		predict
-	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, folds);
+	HMMProblem::predict(metrics, filename, param.dat_obs, param.dat_group, param.dat_skill, param.dat_skill_stacked, param.dat_skill_rcount, param.dat_skill_rix, hmms, param.cv_folds/*nhmms*/, folds, NULL, NULL, NULL);
 	
-	*(tm_predict) += (clock_t)(clock()- tm0);//SEQ
-//    *(tm_predict) += omp_get_wtime()-_tm0;//PAR
+    *(tm_predict) += omp_get_wtime()-tm0;
     
     // delete problems
     NCAT n_par = 0;
@@ -1398,7 +1071,34 @@ NUMBER cross_validate_nstrat(NUMBER* metrics, const char *filename, const char *
         delete hmms[f];
     }
     n_par /= f;
+    for(f=0; f<param.cv_folds; f++)
+        destroy_fold_view(views[f], &param);
     free(folds);
 	
 	return n_par;
-}
\ No newline at end of file
+}
+
+void fit_folds(HMMProblem **hmms, struct param **views, const char *model_file_name, int q, double *tm_fit, FILE *fid_console) {
+    // folds are independent and fit at the same time when parallel, each of them serially then
+    int concurrent = (param.parallel!=0 && omp_get_max_threads()>1)?1:0;
+    double tm0 = omp_get_wtime();
+    #pragma omp parallel for schedule(dynamic) if(concurrent)
+    for(NPAR f=0; f<param.cv_folds; f++) {
+        if(concurrent) views[f]->parallel = 0;
+        hmms[f]->fit();
+        views[f]->parallel = param.parallel; // for predicting
+        
+        // write model
+        char fname[1024];
+        sprintf(fname,"%s_%i",model_file_name,f);
+        hmms[f]->toFile(fname);
+        if(q == 0) {
+            #pragma omp critical(fold_done)
+            {
+                printf("fold %d is done\n",f+1);
+                if(param.duplicate_console==1) fprintf(fid_console,"fold %d is done\n",f+1);
+            }
+        }
+    }
+    *(tm_fit) += omp_get_wtime()-tm0;
+}
@@ -28,6 +28,7 @@
  */
 
 #include "utils.h"
+#include <sys/mman.h>
 using namespace std;
 
 // project of others
@@ -112,8 +113,6 @@ void projectsimplex(NUMBER* ar, NPAR size) {
     NPAR *at_hi = Calloc(NPAR, (size_t)size);
     NPAR *at_lo = Calloc(NPAR, (size_t)size);
     NUMBER err, lambda;
-    NUMBER* ar_copy = Calloc(NUMBER, (size_t)size);
-    memcpy(ar_copy, ar, (size_t)size);
     int iter = 0;
     while( !issimplex(ar, size) ) {
         lambda = 0;
@@ -188,8 +187,6 @@ void projectsimplexbounded(NUMBER* ar, NUMBER *lb, NUMBER *ub, NPAR size) {
 	NPAR *at_hi = Calloc(NPAR, (size_t)size);
 	NPAR *at_lo = Calloc(NPAR, (size_t)size);
 	NUMBER err, lambda, v;
-    NUMBER* ar_copy = Calloc(NUMBER, (size_t)size);
-    memcpy(ar_copy, ar, (size_t)size);
     int iter = 0;
     for(i=0; i<size; i++)
         if(ar[i]!=ar[i]) {
@@ -486,6 +483,8 @@ void set_param_defaults(struct param *param) {
     param->update_known          = 'r';
     param->update_unknown        = 't';
     param->binaryinput           = 0;
+    param->binarymodel           = 0;
+    param->Cslices               = 0;
 	param->Cw                     = Calloc(NUMBER, (size_t)1);
     param->Cw[0]                  = 0;
     param->Ccenters              = NULL;
@@ -509,18 +508,19 @@ void set_param_defaults(struct param *param) {
     param->cv_inout_flag = 'o'; // default rule, we're writing folds out
     param->multiskill = 0; // single skill per ovservation by default
     param->parallel = 0; // parallelization flag, no parallelization (0) by default
+    param->num_threads = 0; // OpenMP default number of threads
+    param->reproducible = 0; // fastest parallel sums by default
     // parse running settings
     param->init_reset = false; // init parameters specified
     param->lo_lims_specd = false; // parameter limits s`pecified
     param->hi_lims_specd = false; // parameter limits s`pecified
     param->stat_specd_gt2 = false; // number of states specified to be >2
     // vocabilaries
-    param->map_group_fwd = NULL;
-    param->map_group_bwd = NULL;
-    param->map_step_fwd = NULL;
-    param->map_step_bwd = NULL;
-    param->map_skill_fwd = NULL;
-    param->map_skill_bwd = NULL;
+    param->voc_group = NULL;
+    param->voc_step = NULL;
+    param->voc_skill = NULL;
+    param->bin_map = NULL;
+    param->bin_map_size = 0;
 	// derived from data - set to 0
     param->N  = 0; //will be dynamically set in read_data_...()
     param->Nstacked  = 0; //will be dynamically set in read_data_...()
@@ -539,6 +539,7 @@ void set_param_defaults(struct param *param) {
 	param->g_numk = NULL;
 	param->g_data = NULL;
 	param->g_k_data = NULL;
+    param->seq_obs = NULL;
     param->N_null = 0;
     param->n_null_skill_group = 0;
     param->null_skills = NULL;
@@ -570,20 +571,34 @@ void destroy_input_data(struct param *param) {
 	if(param->param_hi != NULL) free(param->param_hi);
 	
     // data - checks if pointers to data are null anyway (whether we delete linear columns of data or not)
-	if(param->dat_obs != NULL) free( param->dat_obs );
-	if(param->dat_group != NULL) free( param->dat_group );
-	if(param->dat_item != NULL) free( param->dat_item );
-	if(param->dat_skill != NULL) free( param->dat_skill );
-    if(param->dat_skill_stacked != NULL) free( param->dat_skill_stacked );
-    if(param->dat_skill_rcount != NULL) free( param->dat_skill_rcount );
-    if(param->dat_skill_rix != NULL) free( param->dat_skill_rix );
-    if( param->Cslices>0 ) {
-        free( param->Cw );
-        free( param->Ccenters );
+    // row arrays and indices of sequences in the mapped binary input are not freed, the file is unmapped at the end
+    bool mapped = param->bin_map != NULL;
+    if(!mapped) {
+        if(param->dat_obs != NULL) free( param->dat_obs );
+        if(param->dat_group != NULL) free( param->dat_group );
+        if(param->dat_item != NULL) free( param->dat_item );
+        if(param->dat_skill != NULL) free( param->dat_skill );
+        if(param->dat_skill_stacked != NULL) free( param->dat_skill_stacked );
+        if(param->dat_skill_rcount != NULL) free( param->dat_skill_rcount );
+        if(param->dat_skill_rix != NULL) free( param->dat_skill_rix );
     }
-    
+    if(param->Cw != NULL) free( param->Cw );
+    if(param->Ccenters != NULL) free( param->Ccenters );
+    destroy_structured_data(param);
+    // vocabularies
+    if(param->voc_group != NULL) freeVocab(param->voc_group);
+    if(param->voc_step != NULL)  freeVocab(param->voc_step);
+    if(param->voc_skill != NULL) freeVocab(param->voc_skill);
+    if(mapped) {
+        munmap(param->bin_map, param->bin_map_size);
+        param->bin_map = NULL;
+    }
+}
+
+void destroy_structured_data(struct param *param) {
+    bool mapped = param->bin_map != NULL;
     // not null skills
-    for(NDAT kg=0;kg<param->nSeq; kg++) {
+    for(NDAT kg=0;kg<param->nSeq && !mapped; kg++) {
 		free(param->all_data[kg].ix); // was obs;
 		if( param->all_data[kg].ix_stacked != NULL ) free(param->all_data[kg].ix_stacked); // was obs;
 //        if(param->sliced) // handled via one global array and ix indexing
@@ -594,20 +609,89 @@ void destroy_input_data(struct param *param) {
     if(param->g_data != NULL)   free(param->g_data); // ndat of them (reordered by g)
     if(param->k_g_data != NULL) free(param->k_g_data); // nK of them
     if(param->g_k_data != NULL) free(param->g_k_data); // nG of them
+    if(param->seq_obs != NULL && !(mapped && param->seq_obs >= (NPAR*)param->bin_map && param->seq_obs < (NPAR*)(param->bin_map + param->bin_map_size))) {
+        free(param->seq_obs); // observations of all sequences
+    }
     
 	if(param->k_numg != NULL)   free(param->k_numg);
 	if(param->g_numk != NULL)   free(param->g_numk);
     // null skills
-    for(NCAT g=0;g<param->n_null_skill_group; g++)
+    for(NCAT g=0;g<param->n_null_skill_group && !mapped; g++) {
         free(param->null_skills[g].ix); // was obs
+        if( param->null_skills[g].ix_stacked != NULL ) free(param->null_skills[g].ix_stacked);
+    }
     if(param->null_skills != NULL) free(param->null_skills);
-    // vocabularies
-    delete param->map_group_fwd;
-    delete param->map_group_bwd;
-    delete param->map_step_fwd;
-    delete param->map_step_bwd;
-    delete param->map_skill_fwd;
-    delete param->map_skill_bwd;
+    param->all_data = NULL;
+    param->nSeq = 0;
+    param->k_data = NULL;
+    param->g_data = NULL;
+    param->k_g_data = NULL;
+    param->g_k_data = NULL;
+    param->seq_obs = NULL;
+    param->k_numg = NULL;
+    param->g_numk = NULL;
+    param->null_skills = NULL;
+    param->n_null_skill_group = 0;
+}
+
+struct param* create_fold_view(struct param *param, const NPAR *block_g, const NPAR *block_null, const NPAR *hide_t) {
+    struct param *view = Malloc(struct param, 1);
+    *view = *param; // everything that is not copied below is shared and only read
+    NDAT x;
+    NCAT g, k;
+    // sequence records and their indices, relinked into the copy
+    view->all_data = Malloc(struct data, (size_t)param->nSeq);
+    memcpy(view->all_data, param->all_data, sizeof(struct data)*(size_t)param->nSeq);
+    view->k_data = Malloc(struct data *, (size_t)param->nSeq);
+    view->g_data = Malloc(struct data *, (size_t)param->nSeq);
+    for(x=0; x<param->nSeq; x++) {
+        view->all_data[x].alpha = NULL; // bound to the workspace of whoever fits the view
+        view->all_data[x].beta = NULL;
+        view->all_data[x].c = NULL;
+        view->k_data[x] = &view->all_data[ param->k_data[x] - param->all_data ];
+        view->g_data[x] = &view->all_data[ param->g_data[x] - param->all_data ];
+    }
+    view->k_g_data = Malloc(struct data **, (size_t)param->nK);
+    for(k=0; k<param->nK; k++)
+        view->k_g_data[k] = &view->k_data[ param->k_g_data[k] - param->k_data ];
+    view->g_k_data = Malloc(struct data **, (size_t)param->nG);
+    for(g=0; g<param->nG; g++)
+        view->g_k_data[g] = &view->g_data[ param->g_k_data[g] - param->g_data ];
+    view->null_skills = Malloc(struct data, (size_t)param->n_null_skill_group);
+    memcpy(view->null_skills, param->null_skills, sizeof(struct data)*(size_t)param->n_null_skill_group);
+    // block
+    if(block_g != NULL)
+        for(g=0; g<param->nG; g++) // for all groups
+            if(block_g[g]!=0)
+                for(k=0; k<param->g_numk[g]; k++) // for all skills in it
+                    view->g_k_data[g][k]->cnt = 1;
+    if(block_null != NULL)
+        for(g=0; g<param->n_null_skill_group; g++)
+            if(block_null[g]!=0)
+                view->null_skills[g].cnt = 1;
+    // hide, the observations become the view's own
+    if(hide_t != NULL) {
+        view->dat_obs = Malloc(NPAR, (size_t)param->N);
+        for(x=0; x<param->N; x++)
+            view->dat_obs[x] = (hide_t[x]!=0)?(NPAR)-1:param->dat_obs[x];
+        view->seq_obs = NULL;
+        gather_seq_obs(view);
+    }
+    return view;
+}
+
+void destroy_fold_view(struct param *view, struct param *param) {
+    free(view->all_data);
+    free(view->k_data);
+    free(view->g_data);
+    free(view->k_g_data);
+    free(view->g_k_data);
+    free(view->null_skills);
+    if(view->dat_obs != param->dat_obs) {
+        free(view->dat_obs);
+        free(view->seq_obs);
+    }
+    free(view);
 }
 
 
@@ -678,33 +762,466 @@ void zeroLabels(struct param* param) { // set counts in data sequences to zero
 // clear up all forward/backward/etc variables for a skill-slice
 //
 void RecycleFitData(NCAT xndat, struct data** x_data, struct param *param) {
-	NCAT x;
-	NDAT t;
-	for(x=0; x<xndat; x++) {
-        //        if( x_data[x][0].cnt != 0)
-        //            continue;
-		if( x_data[x][0].alpha != NULL ) {
-			free2D<NUMBER>(x_data[x][0].alpha, x_data[x][0].n);  // only free data here
-			x_data[x][0].alpha = NULL;
+	// alpha, beta, and c live in a workspace, only drop the pointers
+	for(NCAT x=0; x<xndat; x++) {
+        x_data[x][0].alpha = NULL;
+        x_data[x][0].beta = NULL;
+        x_data[x][0].c = NULL;
+	}
+}
+
+void structure_data(struct param *param) {
+	// distribute data into skill-group sequences in O(N+nK+nG) time and memory, no nK x nG map or searches
+	//		positions of skills (rows, or stacked rows if multiskill) are counting-sorted by skill, by chunks of rows,
+	//		positions of a skill are split into sequences by group in order of first occurrence (k_data order),
+	//		all_data has sequences in order of their first occurrence in the data, g_data - by group in that order
+	NDAT t, s, j, x;
+	NCAT g, k;
+	NDAT S = (param->multiskill==0)?param->N:param->Nstacked; // number of skill positions
+	NCAT *skill = (param->multiskill==0)?param->dat_skill:param->dat_skill_stacked; // skill at a position
+	NDAT *row = NULL; // row of a position if multiskill, otherwise the position is the row
+	if(param->multiskill!=0) {
+		row = Malloc(NDAT, (size_t)S);
+		for(t=0; t<param->N; t++)
+			for(int l=0; l<param->dat_skill_rcount[t]; l++)
+				row[ param->dat_skill_rix[t] + l ] = t;
+	}
+	bool par = param->parallel!=0;
+	int nchunk = par?omp_get_max_threads():1;
+	size_t nK1 = (size_t)param->nK + 1;
+	
+	// Pass A: counting sort of positions by skill
+	NDAT *chunk_k = Calloc(NDAT, (size_t)nchunk*nK1); // per chunk: counts of skills, then offsets
+	#pragma omp parallel for if(par) private(s,k)
+	for(int c=0; c<nchunk; c++) {
+		NDAT *cnt = &chunk_k[(size_t)c*nK1];
+		for(s=(NDAT)((long long)S*c/nchunk); s<(NDAT)((long long)S*(c+1)/nchunk); s++)
+			if( (k = skill[s]) >= 0 ) cnt[k]++;
+	}
+	NDAT *k_start = Calloc(NDAT, nK1); // positions of skill k are by_k[ k_start[k] ... k_start[k+1]-1 ]
+	NDAT off = 0;
+	for(k=0; k<param->nK; k++) {
+		k_start[k] = off;
+		for(int c=0; c<nchunk; c++) {
+			NDAT n = chunk_k[(size_t)c*nK1 + (size_t)k];
+			chunk_k[(size_t)c*nK1 + (size_t)k] = off;
+			off += n;
 		}
-		if( x_data[x][0].c != NULL ) {
-			free(x_data[x][0].c);  // only free data here
-			x_data[x][0].c = NULL;
+	}
+	k_start[param->nK] = off;
+	NDAT *by_k = Malloc(NDAT, (size_t)off);
+	#pragma omp parallel for if(par) private(s,k)
+	for(int c=0; c<nchunk; c++) {
+		NDAT *pos = &chunk_k[(size_t)c*nK1];
+		for(s=(NDAT)((long long)S*c/nchunk); s<(NDAT)((long long)S*(c+1)/nchunk); s++)
+			if( (k = skill[s]) >= 0 ) by_k[ pos[k]++ ] = s;
+	}
+	free(chunk_k);
+	
+	// Pass B: sequences of a skill, one per group, numbered in order of first occurrence
+	param->k_numg = Calloc(NCAT, (size_t)param->nK);
+	param->g_numk = Calloc(NCAT, (size_t)param->nG);
+	NDAT *pair_of = Malloc(NDAT, (size_t)off); // sequence of a sorted position, within its skill
+	#pragma omp parallel if(par) private(j,g,k)
+	{
+		NCAT *seen = Malloc(NCAT, (size_t)param->nG); // skill the group was last seen in
+		NDAT *seq = Malloc(NDAT, (size_t)param->nG);  // and its sequence in that skill
+		for(g=0; g<param->nG; g++) seen[g] = -1;
+		#pragma omp for schedule(dynamic,64)
+		for(k=0; k<param->nK; k++) {
+			NDAT n = 0;
+			for(j=k_start[k]; j<k_start[k+1]; j++) {
+				g = param->dat_group[ (row==NULL)?by_k[j]:row[ by_k[j] ] ];
+				if( seen[g]!=k ) {
+					seen[g] = k;
+					seq[g] = n++;
+				}
+				pair_of[j] = seq[g];
+			}
+			param->k_numg[k] = (NCAT)n;
 		}
-		if( x_data[x][0].beta != NULL ) {
-			free2D<NUMBER>(x_data[x][0].beta,  x_data[x][0].n); // only free data here
-			x_data[x][0].beta = NULL;
+		free(seen);
+		free(seq);
+	}
+	NDAT *k_seq = Calloc(NDAT, nK1); // sequences of skill k start at k_data[ k_seq[k] ]
+	for(k=0; k<param->nK; k++) k_seq[k+1] = k_seq[k] + param->k_numg[k];
+	param->nSeq = k_seq[param->nK];
+	
+	// Pass C: sequence lengths and first positions, then their order in the data
+	NDAT *seq_n = Calloc(NDAT, (size_t)param->nSeq);
+	NDAT *seq_ix = Malloc(NDAT, (size_t)param->nSeq); // first position, then index in all_data
+	#pragma omp parallel for if(par) schedule(dynamic,64) private(j,x)
+	for(k=0; k<param->nK; k++)
+		for(j=k_start[k]; j<k_start[k+1]; j++) {
+			x = k_seq[k] + pair_of[j];
+			if(seq_n[x]==0) seq_ix[x] = by_k[j]; // positions of a skill are sorted
+			seq_n[x]++;
 		}
-		if( x_data[x][0].gamma != NULL ) {
-			free2D<NUMBER>(x_data[x][0].gamma, x_data[x][0].n); // only free data here
-			x_data[x][0].gamma = NULL;
+	NDAT *first_of = Malloc(NDAT, (size_t)S); // sequence that starts at the position
+	for(s=0; s<S; s++) first_of[s] = -1;
+	for(x=0; x<param->nSeq; x++) first_of[ seq_ix[x] ] = x;
+	NDAT n_all_data = 0;
+	for(s=0; s<S; s++)
+		if(first_of[s]>=0) seq_ix[ first_of[s] ] = n_all_data++;
+	free(first_of);
+	
+	// Section D: link and fill sequences
+    param->all_data = Calloc(struct data, (size_t)param->nSeq);
+	param->k_g_data = Malloc(struct data **, (size_t)param->nK);
+	param->k_data = Malloc(struct data *, (size_t)param->nSeq);
+	param->g_k_data = Calloc(struct data **, (size_t)param->nG);
+	param->g_data = Malloc(struct data *, (size_t)param->nSeq);
+	#pragma omp parallel for if(par) schedule(dynamic,64) private(j,x,t)
+	for(k=0; k<param->nK; k++) {
+		param->k_g_data[k] = &param->k_data[ k_seq[k] ];
+		for(x=k_seq[k]; x<k_seq[k+1]; x++) {
+			struct data *dt = &param->all_data[ seq_ix[x] ];
+			param->k_data[x] = dt; // in linear array
+			dt->n = seq_n[x];
+			dt->k = k;
+			dt->cnt = 0;
+			dt->obs = NULL;
+			dt->ix = Calloc(NDAT, (size_t)dt->n);
+			dt->ix_stacked = (param->multiskill!=0)?Calloc(NDAT, (size_t)dt->n):NULL;
+			dt->alpha = NULL;
+			dt->beta = NULL;
+			dt->c = NULL;
+			dt->p_O_param = 0.0;
+			dt->loglik = 0.0;
 		}
-		if( x_data[x][0].xi != NULL ) {
-			for(t=0;t<x_data[x][0].n; t++)
-				free2D<NUMBER>(x_data[x][0].xi[t],  (NDAT)param->nS); // only free data here
-			x_data[x][0].xi = NULL;
+		for(j=k_start[k]; j<k_start[k+1]; j++) { // rows, in order, use .cnt as counter
+			struct data *dt = param->k_data[ k_seq[k] + pair_of[j] ];
+			t = (row==NULL)?by_k[j]:row[ by_k[j] ];
+			dt->g = param->dat_group[t];
+			dt->ix[dt->cnt] = t;
+			if(param->multiskill!=0)
+				dt->ix_stacked[dt->cnt] = by_k[j];
+			dt->cnt++;
 		}
 	}
+	free(seq_n);
+	free(seq_ix);
+	free(k_seq);
+	free(pair_of);
+	free(by_k);
+	free(k_start);
+	if(row != NULL) free(row);
+	// by group, in order of first occurrence
+	for(x=0; x<param->nSeq; x++) param->g_numk[ param->all_data[x].g ]++;
+	NDAT *g_countk = Calloc(NDAT, (size_t)param->nG); // track current skill in group
+	off = 0;
+	for(g=0; g<param->nG; g++) {
+		g_countk[g] = off;
+		param->g_k_data[g] = &param->g_data[off];
+		off += param->g_numk[g];
+	}
+	for(x=0; x<param->nSeq; x++)
+		param->g_data[ g_countk[ param->all_data[x].g ]++ ] = &param->all_data[x];
+	free(g_countk);
+	
+	// null skills, by group
+    NDAT *count_null_skill_group = Calloc(NDAT, (size_t)param->nG); // count null skill occurences per group
+	for(t=0; t<param->N; t++)
+		if( skill[ (param->multiskill==0)?t:param->dat_skill_rix[t] ] < 0 ) {
+			g = param->dat_group[t];
+            if(count_null_skill_group[g]==0) param->n_null_skill_group++;
+            count_null_skill_group[g]++;
+		}
+	param->null_skills = Calloc(struct data, (size_t)param->n_null_skill_group);
+    NCAT *index_null_skill_group = Calloc(NCAT, (size_t)param->nG); // index of group in compressed array
+    NCAT idx = 0;
+	for(g=0; g<param->nG; g++)
+        if( count_null_skill_group[g] >0 ) {
+			index_null_skill_group[g] = idx;
+			param->null_skills[idx].n = count_null_skill_group[g];
+			param->null_skills[idx].g = g;
+			param->null_skills[idx].k = -1;
+			param->null_skills[idx].cnt = 0;
+			param->null_skills[idx].ix = Calloc(NDAT, (size_t)count_null_skill_group[g]);
+			if(param->multiskill!=0)
+				param->null_skills[idx].ix_stacked = Calloc(NDAT, (size_t)count_null_skill_group[g]);
+			param->null_skills[idx].alpha = NULL;
+			param->null_skills[idx].beta = NULL;
+			param->null_skills[idx].c = NULL;
+			param->null_skills[idx].p_O_param = 0.0;
+			idx++;
+		}
+	for(t=0; t<param->N; t++)
+		if( skill[ (param->multiskill==0)?t:param->dat_skill_rix[t] ] < 0 ) {
+			struct data *dt = &param->null_skills[ index_null_skill_group[ param->dat_group[t] ] ];
+			if(param->multiskill!=0)
+				dt->ix_stacked[dt->cnt] = param->dat_skill_rix[t];
+			dt->ix[ dt->cnt++ ] = t; // use .cnt as counter
+		}
+	// recycle
+    free(count_null_skill_group);
+    free(index_null_skill_group);
+    // reset `cnt'
+    for(g=0; g<param->nG; g++) // for all groups
+        for(k=0; k<param->g_numk[g]; k++) // for all skills in it
+            param->g_k_data[g][k]->cnt = 0;
+    for(NCAT x=0; x<param->n_null_skill_group; x++)
+        param->null_skills[x].cnt = 0;
+    // contiguous observations for fitting
+    gather_seq_obs(param);
+}
+
+void gather_seq_obs(struct param *param) {
+    // lay sequences out in the order they are fit in
+    struct data **x_data = (param->structure==STRUCTURE_GROUP)?param->g_data:param->k_data;
+    NCAT x;
+    NDAT t, off = 0;
+    if(param->seq_obs == NULL) {
+        NDAT n = 0;
+        for(x=0; x<param->nSeq; x++)
+            n += x_data[x]->n;
+        param->seq_obs = Calloc(NPAR, (size_t)n);
+    }
+    for(x=0; x<param->nSeq; x++) {
+        x_data[x]->obs = &param->seq_obs[off];
+        for(t=0; t<x_data[x]->n; t++)
+            x_data[x]->obs[t] = param->dat_obs[ x_data[x]->ix[t] ];
+        off += x_data[x]->n;
+    }
+}
+
+void bindWorkspace(struct workspace *ws, NCAT xndat, struct data** x_data, NPAR nS) {
+    NCAT x;
+    size_t need = 0, off = 0;
+	for(x=0; x<xndat; x++)
+        if( x_data[x]->cnt==0 )
+            need += (size_t)x_data[x]->n * (size_t)(2*nS+1);
+    if( need > ws->size ) { // grow geometrically
+        size_t size = MAX(need, 2*ws->size);
+        if(ws->slab != NULL) free(ws->slab);
+        ws->slab = Malloc(NUMBER, size);
+        if(ws->slab == NULL) {
+            fprintf(stderr,"Failed to allocate %lu bytes of workspace for fitting.\n", (unsigned long)(size*sizeof(NUMBER)));
+            exit(1);
+        }
+        ws->size = size;
+    }
+	for(x=0; x<xndat; x++) {
+        if( x_data[x]->cnt!=0 ) continue;
+        x_data[x]->alpha = ws->slab + off; // per sequence: alpha, beta, c next to each other
+        off += (size_t)x_data[x]->n * (size_t)nS;
+        x_data[x]->beta  = ws->slab + off;
+        off += (size_t)x_data[x]->n * (size_t)nS;
+        x_data[x]->c     = ws->slab + off;
+        off += (size_t)x_data[x]->n;
+	}
+}
+
+void freeWorkspace(struct workspace *ws) {
+    if(ws->slab != NULL) free(ws->slab);
+    ws->slab = NULL;
+    ws->size = 0;
+}
+
+void initStateStore(struct state_store *ss, NPAR nS) {
+    ss->nS = nS;
+    ss->n = 0;
+    ss->cap = 1024;
+    ss->g = Malloc(NCAT, (size_t)ss->cap);
+    ss->k = Malloc(NCAT, (size_t)ss->cap);
+    ss->p = Malloc(NUMBER, (size_t)ss->cap * (size_t)nS);
+    ss->set = Malloc(NPAR, (size_t)ss->cap);
+    ss->mask = 2*ss->cap - 1; // at most half full
+    ss->table = Calloc(NDAT, (size_t)ss->mask + 1);
+}
+
+NDAT findState(struct state_store *ss, NCAT g, NCAT k) {
+    NDAT h = hashState(g, k, ss->mask), ix;
+    while( (ix = ss->table[h]) != 0 ) { // linear probing
+        if( ss->g[ix-1]==g && ss->k[ix-1]==k )
+            return ix-1;
+        h = (h + 1) & ss->mask;
+    }
+    return -1;
+}
+
+NDAT addState(struct state_store *ss, NCAT g, NCAT k) {
+    NDAT h = hashState(g, k, ss->mask), ix;
+    while( (ix = ss->table[h]) != 0 ) {
+        if( ss->g[ix-1]==g && ss->k[ix-1]==k )
+            return ix-1;
+        h = (h + 1) & ss->mask;
+    }
+    if( ss->n == ss->cap ) { // grow geometrically and rehash
+        ss->cap *= 2;
+        ss->g = (NCAT*)realloc(ss->g, sizeof(NCAT)*(size_t)ss->cap);
+        ss->k = (NCAT*)realloc(ss->k, sizeof(NCAT)*(size_t)ss->cap);
+        ss->p = (NUMBER*)realloc(ss->p, sizeof(NUMBER)*(size_t)ss->cap*(size_t)ss->nS);
+        ss->set = (NPAR*)realloc(ss->set, sizeof(NPAR)*(size_t)ss->cap);
+        if(ss->g == NULL || ss->k == NULL || ss->p == NULL || ss->set == NULL) {
+            fprintf(stderr,"Failed to allocate memory for states of %d student-skill pairs.\n", ss->cap);
+            exit(1);
+        }
+        free(ss->table);
+        ss->mask = 2*ss->cap - 1;
+        ss->table = Calloc(NDAT, (size_t)ss->mask + 1);
+        for(ix=0; ix<ss->n; ix++) {
+            h = hashState(ss->g[ix], ss->k[ix], ss->mask);
+            while( ss->table[h] != 0 )
+                h = (h + 1) & ss->mask;
+            ss->table[h] = ix + 1;
+        }
+        h = hashState(g, k, ss->mask);
+        while( ss->table[h] != 0 )
+            h = (h + 1) & ss->mask;
+    }
+    ix = ss->n++;
+    ss->g[ix] = g;
+    ss->k[ix] = k;
+    ss->set[ix] = 0;
+    ss->table[h] = ix + 1;
+    return ix;
+}
+
+void freeStateStore(struct state_store *ss) {
+    free(ss->g);
+    free(ss->k);
+    free(ss->p);
+    free(ss->set);
+    free(ss->table);
+    ss->n = ss->cap = 0;
+}
+
+struct vocab* newVocab() {
+    struct vocab *v = Malloc(struct vocab, 1);
+    v->n = 0;
+    v->cap = 256;
+    v->capacity = 4096;
+    v->size = 0;
+    v->arena = Malloc(char, v->capacity);
+    v->offset = Malloc(size_t, (size_t)v->cap + 1);
+    v->offset[0] = 0;
+    v->hash = Malloc(unsigned int, (size_t)v->cap);
+    v->mask = 2*(unsigned int)v->cap - 1; // at most half full
+    v->table = Calloc(NCAT, (size_t)v->mask + 1);
+    v->mapped = 0;
+    return v;
+}
+
+struct vocab* mapVocab(NCAT n, char *arena, size_t size, size_t *offset, unsigned int *hash, NCAT *table, unsigned int mask) {
+    struct vocab *v = Malloc(struct vocab, 1);
+    v->n = n;
+    v->cap = n;
+    v->arena = arena;
+    v->size = size;
+    v->capacity = size;
+    v->offset = offset;
+    v->hash = hash;
+    v->table = table;
+    v->mask = mask;
+    v->mapped = 1;
+    return v;
+}
+
+static void ownVocab(struct vocab *v) { // copy arrays of a mapped vocabulary into memory of its own
+    v->cap = MAX(v->n, 256);
+    v->capacity = MAX(v->size, 4096);
+    char *arena = Malloc(char, v->capacity);
+    size_t *offset = Malloc(size_t, (size_t)v->cap + 1);
+    unsigned int *hash = Malloc(unsigned int, (size_t)v->cap);
+    memcpy(arena, v->arena, v->size);
+    memcpy(offset, v->offset, sizeof(size_t)*((size_t)v->n + 1));
+    memcpy(hash, v->hash, sizeof(unsigned int)*(size_t)v->n);
+    NCAT *table = v->table;
+    if( (unsigned int)v->cap*2-1 > v->mask ) { // rehash into a table for the capacity
+        v->mask = 2*(unsigned int)v->cap - 1;
+        table = Calloc(NCAT, (size_t)v->mask + 1);
+        for(NCAT ix=0; ix<v->n; ix++) {
+            unsigned int h = hash[ix] & v->mask;
+            while( table[h] != 0 )
+                h = (h + 1) & v->mask;
+            table[h] = ix + 1;
+        }
+    } else {
+        table = Malloc(NCAT, (size_t)v->mask + 1);
+        memcpy(table, v->table, sizeof(NCAT)*((size_t)v->mask + 1));
+    }
+    v->arena = arena;
+    v->offset = offset;
+    v->hash = hash;
+    v->table = table;
+    v->mapped = 0;
+}
+
+void freeVocab(struct vocab *v) {
+    if(!v->mapped) {
+        free(v->arena);
+        free(v->offset);
+        free(v->hash);
+        free(v->table);
+    }
+    free(v);
+}
+
+NCAT findVocab(const struct vocab *v, const char *s, size_t len) {
+    unsigned int hs = hashString(s, len), h = hs & v->mask;
+    NCAT ix;
+    while( (ix = v->table[h]) != 0 ) { // linear probing
+        if( v->hash[ix-1]==hs && vocabLength(v, ix-1)==len && memcmp(vocabString(v, ix-1), s, len)==0 )
+            return ix-1;
+        h = (h + 1) & v->mask;
+    }
+    return -1;
+}
+
+NCAT addVocab(struct vocab *v, const char *s, size_t len) {
+    unsigned int hs = hashString(s, len), h = hs & v->mask;
+    NCAT ix;
+    while( (ix = v->table[h]) != 0 ) {
+        if( v->hash[ix-1]==hs && vocabLength(v, ix-1)==len && memcmp(vocabString(v, ix-1), s, len)==0 )
+            return ix-1;
+        h = (h + 1) & v->mask;
+    }
+    if( v->n == NCAT_MAX )
+        return -1;
+    if( v->mapped ) {
+        ownVocab(v);
+        h = hs & v->mask;
+        while( v->table[h] != 0 )
+            h = (h + 1) & v->mask;
+    }
+    if( v->size + len + 1 > v->capacity ) { // grow the arena geometrically
+        while( v->size + len + 1 > v->capacity ) v->capacity *= 2;
+        v->arena = (char*)realloc(v->arena, v->capacity);
+        if(v->arena == NULL) {
+            fprintf(stderr,"Failed to allocate memory for %lu bytes of labels.\n", (unsigned long)v->capacity);
+            exit(1);
+        }
+    }
+    if( v->n == v->cap ) { // grow geometrically and rehash
+        v->cap = (v->cap > NCAT_MAX/2)?NCAT_MAX:2*v->cap;
+        v->offset = (size_t*)realloc(v->offset, sizeof(size_t)*((size_t)v->cap + 1));
+        v->hash = (unsigned int*)realloc(v->hash, sizeof(unsigned int)*(size_t)v->cap);
+        if(v->offset == NULL || v->hash == NULL) {
+            fprintf(stderr,"Failed to allocate memory for %d labels.\n", v->cap);
+            exit(1);
+        }
+        free(v->table);
+        v->mask = (v->cap==NCAT_MAX)?UINT_MAX:2*(unsigned int)v->cap - 1;
+        v->table = Calloc(NCAT, (size_t)v->mask + 1);
+        for(ix=0; ix<v->n; ix++) {
+            h = v->hash[ix] & v->mask;
+            while( v->table[h] != 0 )
+                h = (h + 1) & v->mask;
+            v->table[h] = ix + 1;
+        }
+        h = hs & v->mask;
+        while( v->table[h] != 0 )
+            h = (h + 1) & v->mask;
+    }
+    ix = v->n++;
+    memcpy(v->arena + v->size, s, len);
+    v->arena[v->size + len] = 0;
+    v->size += len + 1;
+    v->offset[ix+1] = v->size;
+    v->hash[ix] = hs;
+    v->table[h] = ix + 1;
+    return ix;
 }
 
 // penalties
@@ -31,7 +31,6 @@
  *  this header file is for helper functions as well as for some common functionality
  */
 
-#include <map>
 #include <string>
 #include <limits.h>
 #include <stdlib.h>
@@ -42,7 +41,7 @@
 #include <time.h>
 #include <limits>
 
-//#include <omp.h> //PAR
+#include <omp.h>
 
 using namespace std;
 
@@ -108,19 +107,53 @@ struct FitResult {
 struct data {
 	NDAT n; // number of data points (observations)
 	NDAT cnt;  // help counter, used for building the data and "banning" data from being fit when cross-valudating based on group
-    //	NPAR *obs; // onservations array - will become the pointer array to the big data
-    NDAT *ix; // these are 'ndat' indices to the through arrays (e.g. param.dat_obs and param.dat_item)
+	NPAR *obs; // 'ndat' observations, points into param.seq_obs, this is what fitting reads
+    NDAT *ix; // these are 'ndat' indices to the through arrays (e.g. param.dat_obs and param.dat_item), for mapping back to rows
     NDAT *ix_stacked; // these are 'ndat' indices to the stacked version through arrays (for example the case of multi-skills per row)
-	NUMBER *c; // nS  - scaling factor vector
-	NUMBER **alpha; // ndat x nS
-	NUMBER **beta;  // ndat x nS
-	NUMBER **gamma; // ndat x nS
-	NUMBER ***xi; // ndat x nS x nS
+	NUMBER *c; // ndat  - scaling factor vector
+	NUMBER *alpha; // ndat x nS, alpha_t(i) is alpha[t*nS+i]
+	NUMBER *beta;  // ndat x nS, beta_t(i) is beta[t*nS+i]
 	NUMBER p_O_param; // likelihood of the observations under parameters
     NUMBER loglik; // loglikelihood
 	NCAT k,g; // pointers to skill (k) and group (g)
 };
 
+// scratch memory of a fitting thread: alpha, beta, and c of the sequences being fit are laid out
+// in one block that only grows (geometrically) and is reused across iterations and skills
+struct workspace {
+    NUMBER *slab;
+    size_t size; // in NUMBERs
+};
+
+// running probabilities of states of student-skill pairs that occur in the data (sparse, instead of nG x nK x nS),
+// pairs are found via an open-addressing hash table, their states are contiguous, nS per pair
+struct state_store {
+    NPAR nS;
+    NDAT n;      // number of pairs
+    NDAT cap;    // pairs allocated
+    NCAT *g, *k; // pair
+    NUMBER *p;   // n x nS states
+    NPAR *set;   // states of the pair are set
+    NDAT *table; // hash table, pair index + 1, 0 - empty slot
+    NDAT mask;   // hash table size - 1, size is a power of 2
+};
+
+// vocabulary of interned strings (labels of groups, steps, or skills): the bytes of all strings are in one arena,
+// string to id is via an open-addressing hash table, id to string via offsets into the arena; ids are 0..n-1
+// in the order the strings were added
+struct vocab {
+    NCAT n;              // number of strings
+    NCAT cap;            // strings allocated
+    char *arena;         // strings back to back, each 0-terminated
+    size_t size;         // bytes of arena used
+    size_t capacity;     // bytes of arena allocated
+    size_t *offset;      // cap+1 of them, string id starts at offset[id], offset[n] == size
+    unsigned int *hash;  // hash of string id
+    NCAT *table;         // hash table, id + 1, 0 - empty slot
+    unsigned int mask;   // hash table size - 1, size is a power of 2
+    char mapped;         // arrays are in a memory-mapped file (binary input), copied before the first addition
+};
+
 // parameters of the problem, including configuration parameters, vocabularies of string values, and data
 struct param {
     //
@@ -140,7 +173,9 @@ struct param {
 	NPAR structure; // whether to fit by skill, by group, or mixture of them
 	NPAR solver; // whether to first fit all skills as skingle skill, to set a starting point
 	NPAR solver_setting; // to be used by individual solver
-	NPAR parallel;   // parallelization flag
+	NPAR parallel;   // parallelization flag, 0 - none, 1 - skills (groups), 2 - sequences within a skill
+	int num_threads; // number of threads for parallel processing, 0 - OpenMP default
+	NPAR reproducible; // 1 - parallel sums are done in fixed chunks and order, results do not depend on the number of threads
     NPAR    Cslices; // 0 - do not use L2 norm penalty, >0 - number of "slices" (e.g. 1 - for by skill, 2 - for by skill and by group/user)
     NUMBER* Cw;// weight of the L2 norm penalty, for skill or group parameters (or however many there might be)
     NUMBER* Ccenters;// center values for L2 penalties
@@ -150,6 +185,7 @@ struct param {
     char update_known; // controls how update of the probabilities of the states is done when the observations are known
     char update_unknown; // controls how update of the probabilities of the states is done when the observations are not known
     int binaryinput; // input file is in binary format
+    int binarymodel; // model file is written in binary format
     char initfile[1024]; // flag if we are using a model file as input
 	NPAR cv_folds; // cross-validation folds
 	NPAR cv_strat; // cross-validation stratification
@@ -188,6 +224,8 @@ struct param {
 	NCAT *g_numk; // num skills for group
 	struct data **g_data; // all group-skill data sequence pointers in one array (by group)
 	struct data ***g_k_data; // group_skill data pointer, it is a pointer itself
+    // observations of sequences, contiguous, by skill (or by group if structure is by group), see gather_seq_obs
+    NPAR *seq_obs;
 	char multiskill; // multiskill per observation flag, 0 - single skill, [separator character] otherwise
     // parse running settings
     bool init_reset; // init parameters specified
@@ -195,12 +233,12 @@ struct param {
     bool hi_lims_specd; // parameter limits specified
     bool stat_specd_gt2; // number of states specified to be >2
     // vocabilaries
-    map<string,NCAT> *map_group_fwd; // string to id
-    map<NCAT,string> *map_group_bwd; // id to string
-    map<string,NCAT> *map_step_fwd; // string to id
-    map<NCAT,string> *map_step_bwd; // id to string
-    map<string,NCAT> *map_skill_fwd; // string to id
-    map<NCAT,string> *map_skill_bwd; // id to string
+    struct vocab *voc_group; // group labels
+    struct vocab *voc_step; // step (item) labels
+    struct vocab *voc_skill; // skill labels
+    // binary input (version 4) mapped into memory, row arrays, sequence indices, and vocabularies point into it
+    char *bin_map;
+    size_t bin_map_size;
 	// fitting specific
 	NUMBER ArmijoC1;				// c1 param for Armijo rule (rf. http://en.wikipedia.org/wiki/Wolfe_conditions)
 	NUMBER ArmijoC2;				// c2 param for 2nd Wolfe criterion (rf. http://en.wikipedia.org/wiki/Wolfe_conditions)
@@ -212,6 +250,14 @@ struct param {
 };
 
 void destroy_input_data(struct param *param);
+void destroy_structured_data(struct param *param); // sequences of skill-group pairs (structure_data), row arrays are kept
+
+// view of the data for fitting one cross-validation fold: configuration, vocabularies, and row arrays are shared,
+// sequence records (cnt, obs, alpha, beta, etc.) are its own, so folds can be fit at the same time
+// block_g - per group, non-0 blocks all sequences of the group; block_null - same per null-skill group;
+// hide_t - per row, non-0 hides the observation (-1) from fitting; any of them can be NULL
+struct param* create_fold_view(struct param *param, const NPAR *block_g, const NPAR *block_null, const NPAR *hide_t);
+void destroy_fold_view(struct param *view, struct param *param);
 
 // reading/writing solver info
 void writeSolverInfo(FILE *fid, struct param *param);
@@ -404,6 +450,35 @@ void zeroLabels(struct param* param); // set counts in all data sequences to zer
 //
 void set_param_defaults(struct param *param);
 void RecycleFitData(NCAT xndat, struct data** x_data, struct param *param);
+void structure_data(struct param *param); // sequences of skill-group pairs and null skill rows of groups from the row arrays
+void gather_seq_obs(struct param *param); // (re)fill seq_obs and data.obs from dat_obs
+void bindWorkspace(struct workspace *ws, NCAT xndat, struct data** x_data, NPAR nS); // point alpha, beta, c of unblocked sequences into ws
+void freeWorkspace(struct workspace *ws);
+void initStateStore(struct state_store *ss, NPAR nS);
+NDAT addState(struct state_store *ss, NCAT g, NCAT k); // index of the pair, added if new (not thread-safe)
+NDAT findState(struct state_store *ss, NCAT g, NCAT k); // index of the pair or -1
+void freeStateStore(struct state_store *ss);
+inline NDAT hashState(NCAT g, NCAT k, NDAT mask) { // slot of a pair in the hash table of a state store
+    unsigned long long h = ((unsigned long long)(unsigned int)g << 32) | (unsigned int)k;
+    h *= 0x9E3779B97F4A7C15ULL; // Fibonacci hashing
+    return (NDAT)((h >> 32) & (unsigned long long)mask);
+}
+struct vocab* newVocab();
+struct vocab* mapVocab(NCAT n, char *arena, size_t size, size_t *offset, unsigned int *hash, NCAT *table, unsigned int mask); // over arrays that are not owned
+void freeVocab(struct vocab *v); // frees the vocabulary itself too
+NCAT addVocab(struct vocab *v, const char *s, size_t len); // id of the string, added if new (not thread-safe), -1 if there are NCAT_MAX strings already
+NCAT findVocab(const struct vocab *v, const char *s, size_t len); // id of the string or -1
+// string of an id and its length, the pointer is valid until the next string is added
+inline const char* vocabString(const struct vocab *v, NCAT id) { return v->arena + v->offset[id]; }
+inline size_t vocabLength(const struct vocab *v, NCAT id) { return v->offset[id+1] - v->offset[id] - 1; }
+inline unsigned int hashString(const char *s, size_t len) { // FNV-1a
+    unsigned int h = 2166136261u;
+    for(size_t i=0; i<len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
 // penalties
 NUMBER L2penalty(NUMBER C, NUMBER w, NUMBER Ccenter);